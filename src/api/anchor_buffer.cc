@@ -0,0 +1,111 @@
+#include "api/anchor_buffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+void AnchorBuffer::initialize(unsigned int const max_anchors) {
+  max_anchor_count_ = max_anchors;
+  anchor_count_ = 0u;
+
+  glGenBuffers(1u, &anchors_buffer_id_);
+  glBindBuffer(GL_TEXTURE_BUFFER, anchors_buffer_id_);
+    glBufferData(GL_TEXTURE_BUFFER, max_anchor_count_ * sizeof(vec4), nullptr, GL_STATIC_DRAW);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0u);
+
+  glGenTextures(1u, &anchors_texture_id_);
+  glBindTexture(GL_TEXTURE_BUFFER, anchors_texture_id_);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, anchors_buffer_id_);
+  glBindTexture(GL_TEXTURE_BUFFER, 0u);
+
+  //models default to identity.
+  mat4x4 models[kMaxModelCount];
+  for (auto &m : models) {
+    mat4x4_identity(m);
+  }
+  glGenBuffers(1u, &models_buffer_id_);
+  glBindBuffer(GL_UNIFORM_BUFFER, models_buffer_id_);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(models), models, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0u);
+
+  CHECKGLERROR();
+}
+
+void AnchorBuffer::deinitialize() {
+  glDeleteTextures(1u, &anchors_texture_id_);
+  glDeleteBuffers(1u, &anchors_buffer_id_);
+  glDeleteBuffers(1u, &models_buffer_id_);
+}
+
+unsigned int AnchorBuffer::add_mesh(float const *positions, unsigned int const nvertices,
+                                    unsigned int const *indices, unsigned int const nindices,
+                                    unsigned int const model_index, unsigned int const count) {
+  unsigned int const ntriangles = nindices / 3u;
+  unsigned int const nanchors = std::min(count, max_anchor_count_ - anchor_count_);
+
+  if ((ntriangles == 0u) || (nanchors == 0u) || (model_index >= kMaxModelCount)) {
+    return 0u;
+  }
+
+  //cumulated triangles area, to pick them proportionally to their area.
+  std::vector<float> areas(ntriangles);
+  float total_area = 0.0f;
+  for (unsigned int i = 0u; i < ntriangles; ++i) {
+    float const *a = positions + 3u * std::min(indices[3u*i + 0u], nvertices - 1u);
+    float const *b = positions + 3u * std::min(indices[3u*i + 1u], nvertices - 1u);
+    float const *c = positions + 3u * std::min(indices[3u*i + 2u], nvertices - 1u);
+    vec3 ab, ac, n;
+    vec3_sub(ab, b, a);
+    vec3_sub(ac, c, a);
+    vec3_mul_cross(n, ab, ac);
+    total_area += 0.5f * vec3_len(n);
+    areas[i] = total_area;
+  }
+
+  std::mt19937 generator(anchor_count_);
+  std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+
+  std::vector<GLfloat> anchors(4u * nanchors);
+  for (unsigned int i = 0u; i < nanchors; ++i) {
+    GLfloat *anchor = &anchors[4u * i];
+    float const r = distribution(generator) * total_area;
+    unsigned int const tri = std::min(
+      static_cast<unsigned int>(std::upper_bound(areas.begin(), areas.end(), r) - areas.begin()),
+      ntriangles - 1u);
+
+    float const *a = positions + 3u * std::min(indices[3u*tri + 0u], nvertices - 1u);
+    float const *b = positions + 3u * std::min(indices[3u*tri + 1u], nvertices - 1u);
+    float const *c = positions + 3u * std::min(indices[3u*tri + 2u], nvertices - 1u);
+
+    //uniform barycentric coordinates.
+    float const su = std::sqrt(distribution(generator));
+    float const v = distribution(generator);
+    float const wa = 1.0f - su;
+    float const wb = su * (1.0f - v);
+    float const wc = su * v;
+
+    for (unsigned int k = 0u; k < 3u; ++k) {
+      anchor[k] = wa * a[k] + wb * b[k] + wc * c[k];
+    }
+    anchor[3u] = static_cast<float>(model_index);
+  }
+
+  glBindBuffer(GL_TEXTURE_BUFFER, anchors_buffer_id_);
+    glBufferSubData(GL_TEXTURE_BUFFER, anchor_count_ * sizeof(vec4), anchors.size() * sizeof(GLfloat), anchors.data());
+  glBindBuffer(GL_TEXTURE_BUFFER, 0u);
+
+  anchor_count_ += nanchors;
+
+  CHECKGLERROR();
+
+  return nanchors;
+}
+
+void AnchorBuffer::model(unsigned int const index, mat4x4 const &model) {
+  if (index >= kMaxModelCount) {
+    return;
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, models_buffer_id_);
+    glBufferSubData(GL_UNIFORM_BUFFER, index * sizeof(mat4x4), sizeof(mat4x4), model);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0u);
+}
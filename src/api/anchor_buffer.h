@@ -0,0 +1,53 @@
+#ifndef API_ANCHOR_BUFFER_H_
+#define API_ANCHOR_BUFFER_H_
+
+#include <vector>
+#include "opengl.h"
+#include "linmath.h"
+
+///
+/// Anchor points targeted by the particles, sampled on triangle meshes.
+///
+/// Anchors are stored once in mesh space, each one referencing a model
+/// matrix. Matrices live in their own uniform buffer, so meshes are animated
+/// by updating their matrix without touching the anchors.
+///
+class AnchorBuffer {
+public:
+  static unsigned int const kMaxModelCount = 64u;
+
+  AnchorBuffer():
+      max_anchor_count_(0u),
+      anchor_count_(0u),
+      anchors_buffer_id_(0u),
+      anchors_texture_id_(0u),
+      models_buffer_id_(0u)
+      {}
+
+  void initialize(unsigned int const max_anchors);
+  void deinitialize();
+
+  //sample count anchors uniformly on the surface of an indexed triangle mesh,
+  //bound to the given model matrix. Return the number of anchors added.
+  unsigned int add_mesh(float const *positions, unsigned int const nvertices,
+                        unsigned int const *indices, unsigned int const nindices,
+                        unsigned int const model_index, unsigned int const count);
+  void clear() { anchor_count_ = 0u; }
+
+  //set a model matrix, mesh space to world space.
+  void model(unsigned int const index, mat4x4 const &model);
+
+  unsigned int anchor_count() const { return anchor_count_; }
+
+  GLuint texture_id() const { return anchors_texture_id_; }
+  GLuint models_buffer_id() const { return models_buffer_id_; }
+
+private:
+  unsigned int max_anchor_count_;
+  unsigned int anchor_count_;
+  GLuint anchors_buffer_id_;                  //< xyz : mesh space position, w : model index.
+  GLuint anchors_texture_id_;                 //< buffer texture over the anchors.
+  GLuint models_buffer_id_;                   //< uniform buffer of the model matrices.
+};
+
+#endif // API_ANCHOR_BUFFER_H_
@@ -5,23 +5,14 @@
 
 #include <iostream>
 
-namespace {
-  void SwapUint(unsigned int &a, unsigned int &b) {
-    a ^= b;
-    b ^= a;
-    a ^= b;
-  }
-}
-
 void AppendConsumeBuffer::initialize() {
   //storage buffers.
-  glGenBuffers(2u, array_buffer_ids_);
+  glGenBuffers(kNumBuffers, array_buffer_ids_);
 
-  glBindBuffer(GL_ARRAY_BUFFER, array_buffer_ids_[0u]);
-    glBufferData(GL_ARRAY_BUFFER, storage_buffer_size_, nullptr, GL_STREAM_DRAW);
-
-  glBindBuffer(GL_ARRAY_BUFFER, array_buffer_ids_[1u]);
-    glBufferData(GL_ARRAY_BUFFER, storage_buffer_size_, nullptr, GL_STREAM_DRAW);
+  for (unsigned int i = 0u; i < kNumBuffers; ++i) {
+    glBindBuffer(GL_ARRAY_BUFFER, array_buffer_ids_[i]);
+      glBufferData(GL_ARRAY_BUFFER, storage_buffer_size_, nullptr, GL_STREAM_DRAW);
+  }
 
   //unbind buffers.
   glBindBuffer(GL_ARRAY_BUFFER, 0u);
@@ -30,7 +21,13 @@ void AppendConsumeBuffer::initialize() {
 }
 
 void AppendConsumeBuffer::deinitialize() {
-  glDeleteBuffers(2u, array_buffer_ids_);
+  for (unsigned int i = 0u; i < kNumBuffers; ++i) {
+    if (fences_[i]) {
+      glDeleteSync(fences_[i]);
+      fences_[i] = nullptr;
+    }
+  }
+  glDeleteBuffers(kNumBuffers, array_buffer_ids_);
 
   CHECKGLERROR();
 }
@@ -52,12 +49,20 @@ void AppendConsumeBuffer::unbind_attributes() {
 }
 
 void AppendConsumeBuffer::swap_storage() {
-#if 0
-  //costly but safe.
-  //glCopyBufferSubData(...?
-#else
-  // Cheapest alternative but can makes some particle flicks
-  // due to non updated rendering params (workaround possible).
-  SwapUint(array_buffer_ids_[0u], array_buffer_ids_[1u]);
-#endif
+  //the commands consuming the first buffer have been issued.
+  if (fences_[first_]) {
+    glDeleteSync(fences_[first_]);
+  }
+  fences_[first_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  //the appended buffer is consumed next.
+  first_ = second_index();
+
+  //wait for the device to be done with the buffer to append to.
+  GLsync &fence = fences_[second_index()];
+  if (fence) {
+    while (GL_TIMEOUT_EXPIRED == glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000u)) {}
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
 }
@@ -3,13 +3,24 @@
 
 #include "opengl.h"
 
+///
+/// Ring of particle buffers : the first is consumed, the second appended to.
+///
+/// Swapping moves the ring forward by one buffer. The one just consumed is
+/// fenced and only written again once the fence is signaled, so the device
+/// can queue steps without the writes of one racing the reads of another.
+///
 class AppendConsumeBuffer {
 public:
+  static unsigned int const kNumBuffers = 3u;
+
   AppendConsumeBuffer( unsigned int const element_count, unsigned int const attrib_buffer_count)
     : element_count_(element_count),
     attrib_buffer_count_(attrib_buffer_count),
-    storage_buffer_size_(element_count * 8 * sizeof(GLfloat)),
-    array_buffer_ids_{0u, 0u}
+    storage_buffer_size_(element_count * attrib_buffer_count * 4u * sizeof(GLfloat)),
+    first_(0u),
+    array_buffer_ids_{0u, 0u, 0u},
+    fences_{nullptr, nullptr, nullptr}
     {}
 
   void initialize();
@@ -26,8 +37,13 @@ public:
   unsigned int element_count() const { return element_count_;}
   unsigned int storage_buffer_size() const { return storage_buffer_size_; }
 
-  GLuint first_array_buffer_id() const { return array_buffer_ids_[0u]; }
-  GLuint second_array_buffer_id() const { return array_buffer_ids_[1u]; }
+  //ring indices of the consumed and appended buffers.
+  unsigned int first_index() const { return first_; }
+  unsigned int second_index() const { return (first_ + 1u) % kNumBuffers; }
+
+  GLuint array_buffer_id(unsigned int const index) const { return array_buffer_ids_[index]; }
+  GLuint first_array_buffer_id() const { return array_buffer_ids_[first_index()]; }
+  GLuint second_array_buffer_id() const { return array_buffer_ids_[second_index()]; }
 
 private:
   unsigned int const element_count_;              //number of elements in one buffer.
@@ -35,7 +51,9 @@ private:
   unsigned int const attrib_buffer_count_;
   unsigned int const storage_buffer_size_;        //one buffer bytesize
 
-  GLuint array_buffer_ids_[2u];                     //array buffer (append and consume)
+  unsigned int first_;                            //consumed buffer of the ring.
+  GLuint array_buffer_ids_[kNumBuffers];          //array buffers (append and consume)
+  GLsync fences_[kNumBuffers];                    //last reader of each buffer, if any.
 };
 
 #endif //API_APPEND_CONSUME_BUFFER_H_
@@ -0,0 +1,313 @@
+#include "api/bucket_depth_sort.h"
+
+#include "linmath.h"
+#include "shaders/sparkle/interop.h"
+
+#include <algorithm>
+
+namespace {
+  unsigned int GetClosestPowerOfTwo(unsigned int const n) {
+    unsigned int r = 1u;
+    while (r < n) {
+      r <<= 1u;
+    }
+    return r;
+  }
+
+  unsigned int GetNumTrailingBits(unsigned int const n) {
+    unsigned int r = 0u;
+    for (unsigned int i = n; i > 1u; i >>= 1u) {
+      ++r;
+    }
+    return r;
+  }
+
+  GLuint GetThreadsGroupCount(unsigned int const nthreads) {
+    return (nthreads + PARTICLES_KERNEL_GROUP_WIDTH - 1u) / PARTICLES_KERNEL_GROUP_WIDTH;
+  }
+
+  //power of two width of the indices texture laid out for a count of keys,
+  //in texels of four indices, and the rows holding them.
+  void GetIndicesTextureSize(unsigned int const count, GLuint *width, GLuint *rows) {
+    unsigned int const texels = (count + 3u) / 4u;
+    unsigned int const size = GetClosestPowerOfTwo(texels);
+    *width = 1u << (GetNumTrailingBits(size) / 2u);
+    *rows = std::max(1u, (texels + *width - 1u) / *width);
+  }
+} //namespace
+
+void BucketDepthSort::initialize(unsigned int const max_count, bool const compute) {
+  compute_ = compute;
+
+  char *src_buffer = new char[MAX_SHADER_BUFFERSIZE]();
+  if (compute_) {
+    pgm_.histogram = CompileComputeProgram(SHADERS_DIR "/sparkle/cs_bucket_histogram.glsl", src_buffer);
+    LinkProgram(pgm_.histogram, SHADERS_DIR "/sparkle/cs_bucket_histogram.glsl");
+
+    pgm_.scan = CompileComputeProgram(SHADERS_DIR "/sparkle/cs_bucket_scan.glsl", src_buffer);
+    LinkProgram(pgm_.scan, SHADERS_DIR "/sparkle/cs_bucket_scan.glsl");
+
+    pgm_.scatter = CompileComputeProgram(SHADERS_DIR "/sparkle/cs_bucket_scatter.glsl", src_buffer);
+    LinkProgram(pgm_.scatter, SHADERS_DIR "/sparkle/cs_bucket_scatter.glsl");
+    delete[] src_buffer;
+
+    ulocation_.histogram.bucketBits = GetUniformLocation(pgm_.histogram, "uBucketBits");
+    ulocation_.histogram.depthScale = GetUniformLocation(pgm_.histogram, "uDepthScale");
+    ulocation_.scan.bucketCount = GetUniformLocation(pgm_.scan, "uBucketCount");
+    ulocation_.scatter.bucketBits = GetUniformLocation(pgm_.scatter, "uBucketBits");
+    ulocation_.scatter.depthScale = GetUniformLocation(pgm_.scatter, "uDepthScale");
+
+    //count, then first slot, of each bucket.
+    glGenBuffers(1u, &buckets_buffer_id_);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buckets_buffer_id_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_SORT_BUCKET_COUNT * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0u);
+
+    CHECKGLERROR();
+    return;
+  }
+
+  const char* varyings[1] = { "tfKey" };
+  pgm_.keys = CompileProgram(SHADERS_DIR "/sparkle/vs_bucket_keys.glsl", nullptr, src_buffer);
+  glTransformFeedbackVaryings(pgm_.keys, 1, varyings, GL_INTERLEAVED_ATTRIBS);
+  LinkProgram(pgm_.keys, SHADERS_DIR "/sparkle/vs_bucket_keys.glsl");
+
+  pgm_.partition = CompileProgram(
+        SHADERS_DIR "/sparkle/vs_bucket_partition.glsl",
+        SHADERS_DIR "/sparkle/gs_bucket_partition.glsl",
+        nullptr,
+        src_buffer);
+  glTransformFeedbackVaryings(pgm_.partition, 1, varyings, GL_INTERLEAVED_ATTRIBS);
+  LinkProgram(pgm_.partition, SHADERS_DIR "/sparkle/gs_bucket_partition.glsl");
+
+  pgm_.unpack = CompileProgram(
+        SHADERS_DIR "/sparkle/vs_sort_step.glsl",
+        SHADERS_DIR "/sparkle/fs_bucket_unpack.glsl",
+        src_buffer);
+  LinkProgram(pgm_.unpack, SHADERS_DIR "/sparkle/fs_bucket_unpack.glsl");
+  delete[] src_buffer;
+
+  ulocation_.keys.depthScale = GetUniformLocation(pgm_.keys, "uDepthScale");
+  ulocation_.partition.bit = GetUniformLocation(pgm_.partition, "uBit");
+  ulocation_.partition.bitValue = GetUniformLocation(pgm_.partition, "uBitValue");
+  ulocation_.unpack.width = GetUniformLocation(pgm_.unpack, "width");
+  ulocation_.unpack.count = GetUniformLocation(pgm_.unpack, "uCount");
+  glProgramUniform1i(pgm_.keys, GetUniformLocation(pgm_.keys, "uVisibleCount"), 0);
+  glProgramUniform1i(pgm_.unpack, GetUniformLocation(pgm_.unpack, "keys"), 0);
+
+  //keys partitioned on a bit, ping-ponging.
+  glGenBuffers(2u, keys_buffer_ids_);
+  for (unsigned int i = 0u; i < 2u; ++i) {
+    glBindBuffer(GL_ARRAY_BUFFER, keys_buffer_ids_[i]);
+    glBufferData(GL_ARRAY_BUFFER, max_count * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+  }
+
+  //depth keys of the visible particles, their buffer attached by the sort.
+  glGenVertexArrays(1u, &keys_vao_);
+
+  glGenVertexArrays(2u, partition_vaos_);
+  GLint const key_attrib = glGetAttribLocation(pgm_.partition, "key");
+  for (unsigned int i = 0u; i < 2u; ++i) {
+    glBindVertexArray(partition_vaos_[i]);
+    glBindBuffer(GL_ARRAY_BUFFER, keys_buffer_ids_[i]);
+    glVertexAttribIPointer(key_attrib, 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
+    glEnableVertexAttribArray(key_attrib);
+  }
+
+  //a quad over the indices texture.
+  GLfloat const vertices[] = {
+    -1.0f, -1.0f,
+     1.0f, -1.0f,
+     1.0f,  1.0f,
+    -1.0f,  1.0f
+  };
+  glGenBuffers(1u, &quad_buffer_id_);
+  glGenVertexArrays(1u, &quad_vao_);
+  glBindVertexArray(quad_vao_);
+  glBindBuffer(GL_ARRAY_BUFFER, quad_buffer_id_); {
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    GLint const position_attrib = glGetAttribLocation(pgm_.unpack, "position");
+    glVertexAttribPointer(position_attrib, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), nullptr);
+    glEnableVertexAttribArray(position_attrib);
+  }
+  glBindVertexArray(0u);
+  glBindBuffer(GL_ARRAY_BUFFER, 0u);
+
+  //attached to the buffer holding the last partition.
+  glGenTextures(1u, &keys_texture_id_);
+
+  //indices of the sorted keys, four per texel.
+  GLuint width = 0u;
+  GLuint rows = 0u;
+  GetIndicesTextureSize(max_count, &width, &rows);
+  glGenTextures(1u, &indices_texture_id_);
+  glBindTexture(GL_TEXTURE_2D, indices_texture_id_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16UI, width, rows, 0, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0u);
+
+  glGenFramebuffers(1u, &indices_framebuffer_);
+  glBindFramebuffer(GL_FRAMEBUFFER, indices_framebuffer_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, indices_texture_id_, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0u);
+
+  CHECKGLERROR();
+}
+
+void BucketDepthSort::deinitialize() {
+  if (compute_) {
+    glDeleteProgram(pgm_.histogram);
+    glDeleteProgram(pgm_.scan);
+    glDeleteProgram(pgm_.scatter);
+    glDeleteBuffers(1u, &buckets_buffer_id_);
+    return;
+  }
+  glDeleteProgram(pgm_.keys);
+  glDeleteProgram(pgm_.partition);
+  glDeleteProgram(pgm_.unpack);
+  glDeleteVertexArrays(1u, &keys_vao_);
+  glDeleteVertexArrays(2u, partition_vaos_);
+  glDeleteVertexArrays(1u, &quad_vao_);
+  glDeleteBuffers(1u, &quad_buffer_id_);
+  glDeleteBuffers(2u, keys_buffer_ids_);
+  glDeleteTextures(1u, &keys_texture_id_);
+  glDeleteTextures(1u, &indices_texture_id_);
+  glDeleteFramebuffers(1u, &indices_framebuffer_);
+}
+
+void BucketDepthSort::sort(GLuint const keys_buffer, GLuint const count_texture, unsigned int const max_count,
+                           float const depth_scale, unsigned int const bucket_count, GLuint const indices_buffer) {
+  unsigned int const bucket_bits = GetNumTrailingBits(GetClosestPowerOfTwo(bucket_count));
+  pass_count_ = 0u;
+
+/* 1) Pack the depth keys of the visible particles with their index, in culling order.
+ *    Sized from the upper bound, the keys past the visible ones are padding :
+ *    their count is only known on the device. */
+  glEnable(GL_RASTERIZER_DISCARD);
+  glBindVertexArray(keys_vao_);
+  glBindBuffer(GL_ARRAY_BUFFER, keys_buffer); {
+    GLint const dp_attrib = glGetAttribLocation(pgm_.keys, "dp");
+    glVertexAttribPointer(dp_attrib, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat), nullptr);
+    glEnableVertexAttribArray(dp_attrib);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0u);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, count_texture);
+  glUseProgram(pgm_.keys);
+  {
+    glUniform1f(ulocation_.keys.depthScale, depth_scale);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, keys_buffer_ids_[0]);
+
+    glBeginTransformFeedback(GL_POINTS);
+      glDrawArrays(GL_POINTS, 0, max_count);
+    glEndTransformFeedback();
+    ++pass_count_;
+  }
+  glBindTexture(GL_TEXTURE_2D, 0u);
+
+/* 2) Radix sort on the bucket bits, least significant first : each pass
+ *    appends the keys whose bit is set, then the others. */
+  unsigned int binding = 0u;
+  glUseProgram(pgm_.partition);
+  for (unsigned int bit = 32u - bucket_bits; bit < 32u; ++bit) {
+    glBindVertexArray(partition_vaos_[binding]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, keys_buffer_ids_[binding ^ 1u]);
+    binding ^= 1u;
+
+    glUniform1ui(ulocation_.partition.bit, bit);
+    glBeginTransformFeedback(GL_POINTS);
+      glUniform1ui(ulocation_.partition.bitValue, 1u);
+      glDrawArrays(GL_POINTS, 0, max_count);
+      glUniform1ui(ulocation_.partition.bitValue, 0u);
+      glDrawArrays(GL_POINTS, 0, max_count);
+    glEndTransformFeedback();
+    ++pass_count_;
+  }
+  glDisable(GL_RASTERIZER_DISCARD);
+
+  CHECKGLERROR();
+
+/* 3) Write their index to the indices texture, read back as elements. */
+  GLuint texture_width = 0u;
+  GLuint texture_height = 0u;
+  GetIndicesTextureSize(max_count, &texture_width, &texture_height);
+
+  glViewport(0, 0, texture_width, texture_height);
+  glBindVertexArray(quad_vao_);
+  glBindFramebuffer(GL_FRAMEBUFFER, indices_framebuffer_);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_BUFFER, keys_texture_id_);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, keys_buffer_ids_[binding]);
+  glUseProgram(pgm_.unpack);
+  {
+    glUniform1ui(ulocation_.unpack.width, texture_width);
+    glUniform1ui(ulocation_.unpack.count, max_count);
+
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    ++pass_count_;
+  }
+  glUseProgram(0u);
+  glBindTexture(GL_TEXTURE_BUFFER, 0u);
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, indices_buffer);
+    glReadPixels(0, 0, texture_width, texture_height, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0u);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glBindVertexArray(0u);
+
+  CHECKGLERROR();
+}
+
+void BucketDepthSort::sort_kernel(GLuint const keys_buffer, GLuint const draw_args_buffer,
+                                  unsigned int const max_count, float const depth_scale,
+                                  unsigned int const bucket_count, GLuint const indices_buffer) {
+  GLuint const buckets = GetClosestPowerOfTwo(bucket_count);
+  GLuint const bucket_bits = GetNumTrailingBits(buckets);
+  GLuint const zero = 0u;
+
+  //bucket counts and packed slots are accumulated.
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buckets_buffer_id_);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, indices_buffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0u);
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_DOT_PRODUCTS, keys_buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_SORT_BUCKETS, buckets_buffer_id_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_SORTED_INDICES, indices_buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_DRAW_ARGS, draw_args_buffer);
+
+  //sized from the upper bound, the visible count is only known on the device.
+  GLuint const ngroups = GetThreadsGroupCount(std::max(1u, max_count));
+
+  glUseProgram(pgm_.histogram);
+  {
+    glUniform1ui(ulocation_.histogram.bucketBits, bucket_bits);
+    glUniform1f(ulocation_.histogram.depthScale, depth_scale);
+    glDispatchCompute(ngroups, 1u, 1u);
+  }
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  glUseProgram(pgm_.scan);
+  {
+    glUniform1ui(ulocation_.scan.bucketCount, buckets);
+    glDispatchCompute(1u, 1u, 1u);
+  }
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  glUseProgram(pgm_.scatter);
+  {
+    glUniform1ui(ulocation_.scatter.bucketBits, bucket_bits);
+    glUniform1f(ulocation_.scatter.depthScale, depth_scale);
+    glDispatchCompute(ngroups, 1u, 1u);
+  }
+  glUseProgram(0u);
+  pass_count_ = 3u;
+
+  //sorted indices are next read as elements.
+  glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT);
+
+  CHECKGLERROR();
+}
@@ -0,0 +1,103 @@
+#ifndef API_BUCKET_DEPTH_SORT_H_
+#define API_BUCKET_DEPTH_SORT_H_
+
+#include "opengl.h"
+
+///
+/// Approximate back-to-front sort of the visible particles, by depth buckets.
+///
+/// The depth range is quantised in a power of two count of buckets. The
+/// transform feedback passes partition the depth keys on each bit of their
+/// bucket, least significant first, keeping the culling order within a
+/// bucket : the indices are then unpacked to a texture and read back as
+/// elements. The compute kernels count the particles of each bucket, sum the
+/// counts and scatter them in any order within a bucket.
+///
+/// The passes are linear in the visible count, a few of them whatever it is.
+///
+class BucketDepthSort {
+public:
+  BucketDepthSort():
+      compute_(false),
+      pgm_{0u, 0u, 0u, 0u, 0u, 0u},
+      ulocation_{},
+      keys_vao_(0u),
+      partition_vaos_{0u, 0u},
+      keys_buffer_ids_{0u, 0u},
+      keys_texture_id_(0u),
+      quad_vao_(0u),
+      quad_buffer_id_(0u),
+      indices_texture_id_(0u),
+      indices_framebuffer_(0u),
+      buckets_buffer_id_(0u),
+      pass_count_(0u)
+      {}
+
+  //either the compute kernels, or the transform feedback passes.
+  void initialize(unsigned int const max_count, bool const compute);
+  void deinitialize();
+
+  //transform feedback : sort the depth keys of keys_buffer, their count on
+  //the device in the single texel of count_texture and bounded by
+  //max_count, in bucket_count buckets. Write their indices as GLushort, the
+  //viewport being left to the texture unpacking them.
+  void sort(GLuint const keys_buffer, GLuint const count_texture, unsigned int const max_count,
+            float const depth_scale, unsigned int const bucket_count, GLuint const indices_buffer);
+
+  //compute : as sort, the count being read from the draw arguments. The
+  //indices are next read as elements.
+  void sort_kernel(GLuint const keys_buffer, GLuint const draw_args_buffer, unsigned int const max_count,
+                   float const depth_scale, unsigned int const bucket_count, GLuint const indices_buffer);
+
+  unsigned int pass_count() const { return pass_count_; }
+
+private:
+  bool compute_;
+
+  struct {
+    GLuint keys;
+    GLuint partition;
+    GLuint unpack;
+    GLuint histogram;
+    GLuint scan;
+    GLuint scatter;
+  } pgm_;
+
+  struct {
+    struct {
+      GLint depthScale;
+    } keys;
+    struct {
+      GLint bit;
+      GLint bitValue;
+    } partition;
+    struct {
+      GLint width;
+      GLint count;
+    } unpack;
+    struct {
+      GLint bucketBits;
+      GLint depthScale;
+    } histogram;
+    struct {
+      GLint bucketCount;
+    } scan;
+    struct {
+      GLint bucketBits;
+      GLint depthScale;
+    } scatter;
+  } ulocation_;
+
+  GLuint keys_vao_;                           //< depth keys of the culled particles.
+  GLuint partition_vaos_[2];                  //< keys partitioned, ping-pong.
+  GLuint keys_buffer_ids_[2];
+  GLuint keys_texture_id_;                    //< buffer texture over the last partition.
+  GLuint quad_vao_;                           //< unpacking pass over the indices texture.
+  GLuint quad_buffer_id_;
+  GLuint indices_texture_id_;                 //< four indices per texel, read back as elements.
+  GLuint indices_framebuffer_;
+  GLuint buckets_buffer_id_;                  //< compute : count then first slot of the buckets.
+  unsigned int pass_count_;
+};
+
+#endif // API_BUCKET_DEPTH_SORT_H_
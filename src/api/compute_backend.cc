@@ -0,0 +1,236 @@
+#include "api/compute_backend.h"
+
+#include "linmath.h"
+#include "shaders/sparkle/interop.h"
+
+unsigned int const ComputeBackend::kNumCounts;
+
+static_assert(GRID_CELL_COUNT % GRID_SCAN_BLOCK_WIDTH == 0, "grid cells are scanned by whole blocks");
+static_assert(GRID_SCAN_BLOCK_COUNT <= MAX_SORT_BUCKET_COUNT, "grid blocks are scanned as buckets");
+
+namespace {
+  GLuint GetThreadsGroupCount(unsigned int const nthreads) {
+    return (nthreads + PARTICLES_KERNEL_GROUP_WIDTH - 1u) / PARTICLES_KERNEL_GROUP_WIDTH;
+  }
+} //namespace
+
+void ComputeBackend::initialize(unsigned int const max_count) {
+  char *src_buffer = new char[MAX_SHADER_BUFFERSIZE]();
+  pgm_.update_args = CompileComputeProgram(SHADERS_DIR "/sparkle/cs_update_args.glsl", src_buffer);
+  LinkProgram(pgm_.update_args, SHADERS_DIR "/sparkle/cs_update_args.glsl");
+
+  //neighbours grid, as cells lists : the blocks starts are scanned as buckets.
+  pgm_.grid_count = CompileComputeProgram(SHADERS_DIR "/sparkle/cs_grid_count.glsl", src_buffer);
+  LinkProgram(pgm_.grid_count, SHADERS_DIR "/sparkle/cs_grid_count.glsl");
+
+  pgm_.grid_scan = CompileComputeProgram(SHADERS_DIR "/sparkle/cs_grid_scan.glsl", src_buffer);
+  LinkProgram(pgm_.grid_scan, SHADERS_DIR "/sparkle/cs_grid_scan.glsl");
+
+  pgm_.grid_scatter = CompileComputeProgram(SHADERS_DIR "/sparkle/cs_grid_scatter.glsl", src_buffer);
+  LinkProgram(pgm_.grid_scatter, SHADERS_DIR "/sparkle/cs_grid_scatter.glsl");
+
+  pgm_.scan = CompileComputeProgram(SHADERS_DIR "/sparkle/cs_bucket_scan.glsl", src_buffer);
+  LinkProgram(pgm_.scan, SHADERS_DIR "/sparkle/cs_bucket_scan.glsl");
+  delete[] src_buffer;
+
+  ulocation_.update_args.emitCount = GetUniformLocation(pgm_.update_args, "uEmitCount");
+  ulocation_.update_args.maxParticleCount = GetUniformLocation(pgm_.update_args, "uMaxParticleCount");
+  ulocation_.update_args.stableSlots = GetUniformLocation(pgm_.update_args, "uStableSlots");
+  ulocation_.update_args.resetSlots = GetUniformLocation(pgm_.update_args, "uResetSlots");
+  ulocation_.grid_count.bboxSize = GetUniformLocation(pgm_.grid_count, "uBBoxSize");
+  ulocation_.grid_scatter.bboxSize = GetUniformLocation(pgm_.grid_scatter, "uBBoxSize");
+  ulocation_.scan.bucketCount = GetUniformLocation(pgm_.scan, "uBucketCount");
+
+  //draw arguments of the particles written by the simulation, the count
+  //being its append counter.
+  TDrawArraysArgs const particles_args = {0u, 1u, 0u, 0u};
+  glGenBuffers(1u, &counters_buffer_id_);
+  glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, counters_buffer_id_);
+  glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(TDrawArraysArgs), &particles_args, GL_DYNAMIC_COPY);
+  glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0u);
+
+  glGenBuffers(1u, &indirect_args_buffer_id_);
+  glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, indirect_args_buffer_id_);
+  glBufferData(GL_DISPATCH_INDIRECT_BUFFER, sizeof(TIndirectArgs), nullptr, GL_DYNAMIC_COPY);
+  glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0u);
+
+  //queue of the dead slots, emptied by the first step updating in place.
+  glGenBuffers(1u, &dead_queue_buffer_id_);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, dead_queue_buffer_id_);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(TDeadSlots), nullptr, GL_DYNAMIC_COPY);
+
+  //cells lists : counts, ends and blocks starts.
+  glGenBuffers(1u, &grid_cells_buffer_id_);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, grid_cells_buffer_id_);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, (2u * GRID_CELL_COUNT + GRID_SCAN_BLOCK_COUNT) * sizeof(GLuint),
+               nullptr, GL_DYNAMIC_COPY);
+
+  //positions sorted by cell, the particles being updated in place when
+  //their slots are stable.
+  glGenBuffers(1u, &grid_positions_buffer_id_);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, grid_positions_buffer_id_);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, max_count * 4u * sizeof(GLfloat), nullptr, GL_DYNAMIC_COPY);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0u);
+
+  //alive and visible counts, copied back for the host statistics, then the
+  //inversions and the disorder measured by the incremental sort.
+  glGenBuffers(1u, &readback_buffer_id_);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, readback_buffer_id_);
+  glBufferData(GL_COPY_WRITE_BUFFER, kNumCounts * sizeof(GLuint), nullptr, GL_STREAM_READ);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0u);
+
+  CHECKGLERROR();
+}
+
+void ComputeBackend::deinitialize() {
+  glDeleteProgram(pgm_.update_args);
+  glDeleteProgram(pgm_.grid_count);
+  glDeleteProgram(pgm_.grid_scan);
+  glDeleteProgram(pgm_.grid_scatter);
+  glDeleteProgram(pgm_.scan);
+  glDeleteBuffers(1u, &counters_buffer_id_);
+  glDeleteBuffers(1u, &indirect_args_buffer_id_);
+  glDeleteBuffers(1u, &dead_queue_buffer_id_);
+  glDeleteBuffers(1u, &grid_cells_buffer_id_);
+  glDeleteBuffers(1u, &grid_positions_buffer_id_);
+  glDeleteBuffers(1u, &readback_buffer_id_);
+  if (readback_fence_) {
+    glDeleteSync(readback_fence_);
+    readback_fence_ = nullptr;
+  }
+}
+
+void ComputeBackend::update_args(unsigned int const emit_count, unsigned int const max_count,
+                                 bool const in_place, bool const reset) {
+  glUseProgram(pgm_.update_args);
+  {
+    glUniform1ui(ulocation_.update_args.emitCount, emit_count);
+    glUniform1ui(ulocation_.update_args.maxParticleCount, max_count);
+    glUniform1i(ulocation_.update_args.stableSlots, (in_place) ? GL_TRUE : GL_FALSE);
+    glUniform1i(ulocation_.update_args.resetSlots, (reset) ? GL_TRUE : GL_FALSE);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_DEAD_SLOTS, dead_queue_buffer_id_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_COUNTERS, counters_buffer_id_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_INDIRECT_ARGS, indirect_args_buffer_id_);
+
+    glDispatchCompute(1u, 1u, 1u);
+  }
+  glUseProgram(0u);
+
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_ATOMIC_COUNTER_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+  CHECKGLERROR();
+}
+
+void ComputeBackend::bind_simulation() const {
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_INDIRECT_ARGS, indirect_args_buffer_id_);
+  glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, ATOMIC_COUNTER_BINDING_COUNTERS, counters_buffer_id_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_DEAD_SLOTS, dead_queue_buffer_id_);
+}
+
+void ComputeBackend::dispatch() const {
+  glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, indirect_args_buffer_id_);
+    glDispatchComputeIndirect(0);
+  glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0u);
+}
+
+void ComputeBackend::build_grid(GLuint const particles_buffer, GLuint const indices_buffer,
+                                unsigned int const max_count, float const box_size) {
+  GLuint const zero = 0u;
+  GLintptr const blocks_offset = 2u * GRID_CELL_COUNT * sizeof(GLuint);
+  GLsizeiptr const blocks_size = GRID_SCAN_BLOCK_COUNT * sizeof(GLuint);
+
+  //counting sort of the particles by cell, every particle being listed.
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, grid_cells_buffer_id_);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, GRID_CELL_COUNT * sizeof(GLuint),
+                         GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0u);
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_PARTICLES_FIRST, particles_buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_COUNTERS, counters_buffer_id_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_GRID_CELLS, grid_cells_buffer_id_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_GRID_INDICES, indices_buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_GRID_POSITIONS, grid_positions_buffer_id_);
+
+  //sized from the alive particles upper bound, the count is only known on
+  //the device.
+  GLuint const nparticle_groups = GetThreadsGroupCount(max_count);
+
+  glUseProgram(pgm_.grid_count);
+  {
+    glUniform1f(ulocation_.grid_count.bboxSize, box_size);
+    glDispatchCompute(nparticle_groups, 1u, 1u);
+  }
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  //first slot of each cell within its block, then of each block.
+  glUseProgram(pgm_.grid_scan);
+  {
+    glDispatchCompute(GRID_SCAN_BLOCK_COUNT, 1u, 1u);
+  }
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  glBindBufferRange(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_SORT_BUCKETS,
+                    grid_cells_buffer_id_, blocks_offset, blocks_size);
+  glUseProgram(pgm_.scan);
+  {
+    glUniform1ui(ulocation_.scan.bucketCount, GRID_SCAN_BLOCK_COUNT);
+    glDispatchCompute(1u, 1u, 1u);
+  }
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  glUseProgram(pgm_.grid_scatter);
+  {
+    glUniform1f(ulocation_.grid_scatter.bboxSize, box_size);
+    glDispatchCompute(nparticle_groups, 1u, 1u);
+  }
+  glUseProgram(0u);
+
+  //read by the simulation.
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  CHECKGLERROR();
+}
+
+void ComputeBackend::bind_grid(GLuint const indices_buffer) const {
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_GRID_CELLS, grid_cells_buffer_id_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_GRID_INDICES, indices_buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_GRID_POSITIONS, grid_positions_buffer_id_);
+}
+
+bool ComputeBackend::read_counts(GLuint counts[kNumCounts]) {
+  if (!readback_fence_ ||
+      (GL_TIMEOUT_EXPIRED == glClientWaitSync(readback_fence_, 0, 0u))) {
+    return false;
+  }
+  glBindBuffer(GL_COPY_READ_BUFFER, readback_buffer_id_);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, kNumCounts * sizeof(GLuint), counts);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0u);
+  glDeleteSync(readback_fence_);
+  readback_fence_ = nullptr;
+
+  return true;
+}
+
+void ComputeBackend::copy_counts(GLuint const draw_args_buffer, GLuint const carry_buffer,
+                                 GLintptr const inversions_offset, bool const inversions, bool const disorder) {
+  glBindBuffer(GL_COPY_WRITE_BUFFER, readback_buffer_id_);
+  glBindBuffer(GL_COPY_READ_BUFFER, counters_buffer_id_);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint));
+  glBindBuffer(GL_COPY_READ_BUFFER, draw_args_buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, sizeof(GLuint), sizeof(GLuint));
+  if (inversions) {
+    glBindBuffer(GL_COPY_READ_BUFFER, carry_buffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                          inversions_offset, 2u * sizeof(GLuint), sizeof(GLuint));
+  }
+  if (disorder) {
+    glBindBuffer(GL_COPY_READ_BUFFER, carry_buffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                          inversions_offset + sizeof(GLuint), 3u * sizeof(GLuint), sizeof(GLuint));
+  }
+  glBindBuffer(GL_COPY_READ_BUFFER, 0u);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0u);
+  readback_fence_ = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  CHECKGLERROR();
+}
@@ -0,0 +1,110 @@
+#ifndef API_COMPUTE_BACKEND_H_
+#define API_COMPUTE_BACKEND_H_
+
+#include "opengl.h"
+
+///
+/// Device side state of the compute simulation, shared by its kernels.
+///
+/// The simulation appends the particles to the buffer of the ring written,
+/// counted by an atomic counter : its dispatch arguments, and the emission
+/// clamped to the free storage, are written on the device from the count of
+/// the last step. The counts are copied back for the host a few frames late,
+/// without waiting for them.
+///
+/// The neighbours grid is built as cells lists, by a counting sort of the
+/// particles by cell : their indices, and their positions next to each other
+/// for the simulation to read them.
+///
+class ComputeBackend {
+public:
+  //counts copied back : alive, visible, then inversions of a refined and of a
+  //carried order.
+  static unsigned int const kNumCounts = 4u;
+
+  ComputeBackend():
+      pgm_{0u, 0u, 0u, 0u, 0u},
+      ulocation_{},
+      counters_buffer_id_(0u),
+      indirect_args_buffer_id_(0u),
+      dead_queue_buffer_id_(0u),
+      grid_cells_buffer_id_(0u),
+      grid_positions_buffer_id_(0u),
+      readback_buffer_id_(0u),
+      readback_fence_(nullptr)
+      {}
+
+  void initialize(unsigned int const max_count);
+  void deinitialize();
+
+  //consume the particles appended last step, clamp the emission to the free
+  //storage of max_count and write the simulation dispatch. The dead slots
+  //are queued when updated in place, the queue emptied when reset.
+  void update_args(unsigned int const emit_count, unsigned int const max_count,
+                   bool const in_place, bool const reset);
+
+  //bind the counters, the dispatch arguments and the dead slots queue to
+  //the simulation.
+  void bind_simulation() const;
+
+  //dispatch the kernel in use over the particles of the last step.
+  void dispatch() const;
+
+  //list the particles of particles_buffer by cell, their count on the
+  //device and bounded by max_count : their indices to indices_buffer.
+  void build_grid(GLuint const particles_buffer, GLuint const indices_buffer, unsigned int const max_count,
+                  float const box_size);
+
+  //bind the cells lists, read by the simulation.
+  void bind_grid(GLuint const indices_buffer) const;
+
+  //true, and the counts filled, if the last copy is complete.
+  bool read_counts(GLuint counts[kNumCounts]);
+
+  //true while a copy is not read.
+  bool readback_pending() const { return nullptr != readback_fence_; }
+
+  //copy the alive and visible counts, then the inversions counted in the
+  //carry buffer when measured, without waiting for them.
+  void copy_counts(GLuint const draw_args_buffer, GLuint const carry_buffer, GLintptr const inversions_offset,
+                   bool const inversions, bool const disorder);
+
+  GLuint counters_buffer_id() const { return counters_buffer_id_; }
+
+private:
+  struct {
+    GLuint update_args;
+    GLuint grid_count;
+    GLuint grid_scan;
+    GLuint grid_scatter;
+    GLuint scan;
+  } pgm_;
+
+  struct {
+    struct {
+      GLint emitCount;
+      GLint maxParticleCount;
+      GLint stableSlots;
+      GLint resetSlots;
+    } update_args;
+    struct {
+      GLint bboxSize;
+    } grid_count;
+    struct {
+      GLint bboxSize;
+    } grid_scatter;
+    struct {
+      GLint bucketCount;
+    } scan;
+  } ulocation_;
+
+  GLuint counters_buffer_id_;                 //< particles appended by the last simulation, as draw arguments.
+  GLuint indirect_args_buffer_id_;            //< simulation dispatch arguments.
+  GLuint dead_queue_buffer_id_;               //< queue of the dead slots, as a TDeadSlots.
+  GLuint grid_cells_buffer_id_;               //< count, end and block start of the cells lists.
+  GLuint grid_positions_buffer_id_;           //< positions of the particles sorted by cell.
+  GLuint readback_buffer_id_;                 //< counts copied back for the host.
+  GLsync readback_fence_;                     //< signaled once the counts are copied.
+};
+
+#endif // API_COMPUTE_BACKEND_H_
@@ -0,0 +1,309 @@
+#include "api/compute_depth_sort.h"
+
+#include "linmath.h"
+#include "shaders/sparkle/interop.h"
+
+#include <algorithm>
+#include <cstddef>
+
+unsigned int const ComputeDepthSort::kNumBuffers;
+
+namespace {
+  unsigned int GetClosestPowerOfTwo(unsigned int const n) {
+    unsigned int r = 1u;
+    while (r < n) {
+      r <<= 1u;
+    }
+    return r;
+  }
+
+  unsigned int GetNumTrailingBits(unsigned int const n) {
+    unsigned int r = 0u;
+    for (unsigned int i = n; i > 1u; i >>= 1u) {
+      ++r;
+    }
+    return r;
+  }
+
+  GLuint GetThreadsGroupCount(unsigned int const nthreads) {
+    return (nthreads + PARTICLES_KERNEL_GROUP_WIDTH - 1u) / PARTICLES_KERNEL_GROUP_WIDTH;
+  }
+
+  //std430 layout of the carried order, as read by inc_sort_carry.glsl.
+  struct TSortCarry {
+    GLuint rank_offsets[MAX_SORT_RANK_COUNT];
+    GLuint rank_block_starts[SORT_RANK_BLOCK_COUNT + 1];
+    GLuint unranked_count;
+    GLuint inversion_counts[2];
+  };
+} //namespace
+
+static_assert(MAX_SORT_RANK_COUNT % SORT_RANK_BLOCK_WIDTH == 0, "sort ranks are scanned by whole blocks");
+static_assert(SORT_RANK_BLOCK_COUNT < MAX_SORT_BUCKET_COUNT, "sort ranks blocks are scanned as buckets, their total after them");
+
+void ComputeDepthSort::initialize(unsigned int const max_count) {
+  char *src_buffer = new char[MAX_SHADER_BUFFERSIZE]();
+  pgm_.fill = CompileComputeProgram(SHADERS_DIR "/sparkle/cs_fill_indices.glsl", src_buffer);
+  LinkProgram(pgm_.fill, SHADERS_DIR "/sparkle/cs_fill_indices.glsl");
+
+  pgm_.step = CompileComputeProgram(SHADERS_DIR "/sparkle/cs_sort_step.glsl", src_buffer);
+  LinkProgram(pgm_.step, SHADERS_DIR "/sparkle/cs_sort_step.glsl");
+
+  //carried order, as ranks compacted : the blocks starts are scanned as buckets.
+  pgm_.carry_marks = CompileComputeProgram(SHADERS_DIR "/sparkle/cs_carry_marks.glsl", src_buffer);
+  LinkProgram(pgm_.carry_marks, SHADERS_DIR "/sparkle/cs_carry_marks.glsl");
+
+  pgm_.carry_scan = CompileComputeProgram(SHADERS_DIR "/sparkle/cs_carry_scan.glsl", src_buffer);
+  LinkProgram(pgm_.carry_scan, SHADERS_DIR "/sparkle/cs_carry_scan.glsl");
+
+  pgm_.scan = CompileComputeProgram(SHADERS_DIR "/sparkle/cs_bucket_scan.glsl", src_buffer);
+  LinkProgram(pgm_.scan, SHADERS_DIR "/sparkle/cs_bucket_scan.glsl");
+
+  pgm_.inversions = CompileComputeProgram(SHADERS_DIR "/sparkle/cs_sort_inversions.glsl", src_buffer);
+  LinkProgram(pgm_.inversions, SHADERS_DIR "/sparkle/cs_sort_inversions.glsl");
+  delete[] src_buffer;
+
+  ulocation_.fill.count = GetUniformLocation(pgm_.fill, "uCount");
+  ulocation_.fill.depthScale = GetUniformLocation(pgm_.fill, "uDepthScale");
+  ulocation_.fill.carried = GetUniformLocation(pgm_.fill, "uCarried");
+  ulocation_.fill.rankCount = GetUniformLocation(pgm_.fill, "uRankCount");
+  ulocation_.step.blockWidth = GetUniformLocation(pgm_.step, "uBlockWidth");
+  ulocation_.step.offset = GetUniformLocation(pgm_.step, "uOffset");
+  ulocation_.step.count = GetUniformLocation(pgm_.step, "uCount");
+  ulocation_.step.flip = GetUniformLocation(pgm_.step, "uFlip");
+  ulocation_.step.packOutput = GetUniformLocation(pgm_.step, "uPackOutput");
+  ulocation_.step.writeRanks = GetUniformLocation(pgm_.step, "uWriteRanks");
+  ulocation_.carry_marks.rankCount = GetUniformLocation(pgm_.carry_marks, "uRankCount");
+  ulocation_.scan.bucketCount = GetUniformLocation(pgm_.scan, "uBucketCount");
+  ulocation_.inversions.distance = GetUniformLocation(pgm_.inversions, "uDistance");
+  ulocation_.inversions.carried = GetUniformLocation(pgm_.inversions, "uCarried");
+  ulocation_.inversions.depthScale = GetUniformLocation(pgm_.inversions, "uDepthScale");
+
+  glGenBuffers(2u, keys_buffer_ids_);
+  for (GLuint buffer : keys_buffer_ids_) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, max_count * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+  }
+
+  //rank of the particles in the last sorted order, following their storage.
+  glGenBuffers(kNumBuffers, ranks_buffer_ids_);
+  for (GLuint buffer : ranks_buffer_ids_) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, max_count * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+  }
+
+  //ranks of the visible particles compacted, and the inversions counted.
+  glGenBuffers(1u, &carry_buffer_id_);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, carry_buffer_id_);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(TSortCarry), nullptr, GL_DYNAMIC_COPY);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0u);
+
+  CHECKGLERROR();
+}
+
+void ComputeDepthSort::deinitialize() {
+  glDeleteProgram(pgm_.fill);
+  glDeleteProgram(pgm_.step);
+  glDeleteProgram(pgm_.carry_marks);
+  glDeleteProgram(pgm_.carry_scan);
+  glDeleteProgram(pgm_.scan);
+  glDeleteProgram(pgm_.inversions);
+  glDeleteBuffers(2u, keys_buffer_ids_);
+  glDeleteBuffers(kNumBuffers, ranks_buffer_ids_);
+  glDeleteBuffers(1u, &carry_buffer_id_);
+}
+
+GLintptr ComputeDepthSort::inversions_offset() const {
+  return offsetof(TSortCarry, inversion_counts);
+}
+
+void ComputeDepthSort::pack(GLuint const keys_buffer, GLuint const draw_args_buffer, GLuint const culled_ids_buffer,
+                            unsigned int const ranks_index, GLuint const indices_buffer,
+                            unsigned int const max_count, float const depth_scale, bool const carried) {
+  //a pair at least, for the last stage to write the sorted indices.
+  max_count_ = max_count;
+  count_ = std::max(2u, max_count);
+  binding_ = 0u;
+  pass_count_ = 0u;
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_DOT_PRODUCTS, keys_buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_SORTED_INDICES, indices_buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_DRAW_ARGS, draw_args_buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_CULLED_IDS, culled_ids_buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_SORT_RANKS_SECOND, ranks_buffer_ids_[ranks_index]);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_SORT_CARRY, carry_buffer_id_);
+
+  if (carried) {
+    _carry_ranks();
+  }
+
+  //the padding past the visible keys sorts last.
+  glUseProgram(pgm_.fill);
+  {
+    glUniform1ui(ulocation_.fill.count, count_);
+    glUniform1f(ulocation_.fill.depthScale, depth_scale);
+    glUniform1i(ulocation_.fill.carried, (carried) ? GL_TRUE : GL_FALSE);
+    glUniform1ui(ulocation_.fill.rankCount, rank_count_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_INDICES_FIRST, keys_buffer_ids_[0]);
+
+    glDispatchCompute(GetThreadsGroupCount(count_), 1u, 1u);
+  }
+  glUseProgram(0u);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  CHECKGLERROR();
+}
+
+void ComputeDepthSort::sort(bool const write_ranks) {
+  //the network spans a power of two of keys.
+  unsigned int const nsteps = GetNumTrailingBits(GetClosestPowerOfTwo(count_));
+
+  _use_sort_program(write_ranks);
+  for (unsigned int step = 0u; step < nsteps; ++step) {
+    _stages(2u << step, true, step + 1u == nsteps);
+  }
+  glUseProgram(0u);
+  rank_count_ = count_;
+
+  //sorted indices are next read as elements.
+  glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT);
+}
+
+void ComputeDepthSort::refine(GLuint const block_width, unsigned int const rounds, unsigned int &parity,
+                              bool const write_ranks) {
+  //blocks sorted, then merged with a neighbour per round : one round at
+  //least, for the last pass to write the sorted indices.
+  unsigned int const nsteps = GetNumTrailingBits(block_width);
+
+  _use_sort_program(write_ranks);
+  for (unsigned int step = 0u; step < nsteps; ++step) {
+    _stages(2u << step, true, false);
+  }
+  for (unsigned int round = 0u; round < rounds; ++round) {
+    GLuint const offset = (parity & 1u) ? block_width : 0u;
+    _pass(2u * block_width, offset, true, false);
+    ++parity;
+
+    _stages(block_width, false, round + 1u == rounds);
+  }
+  glUseProgram(0u);
+  rank_count_ = count_;
+
+  //sorted indices are next read as elements.
+  glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT);
+}
+
+void ComputeDepthSort::copy(bool const write_ranks) {
+  _use_sort_program(write_ranks);
+  _pass(2u, 0u, false, true);
+  glUseProgram(0u);
+  rank_count_ = count_;
+
+  //sorted indices are next read as elements.
+  glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT);
+}
+
+void ComputeDepthSort::count_inversions(GLuint const distance, bool const carried, float const depth_scale) {
+  GLuint const zero = 0u;
+  GLintptr const offset = inversions_offset() + ((carried) ? sizeof(GLuint) : 0u);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, carry_buffer_id_);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, offset, sizeof(GLuint),
+                         GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0u);
+
+  glUseProgram(pgm_.inversions);
+  {
+    glUniform1ui(ulocation_.inversions.distance, distance);
+    glUniform1i(ulocation_.inversions.carried, (carried) ? GL_TRUE : GL_FALSE);
+    glUniform1f(ulocation_.inversions.depthScale, depth_scale);
+    glDispatchCompute(GetThreadsGroupCount(std::max(1u, max_count_)), 1u, 1u);
+  }
+  glUseProgram(0u);
+
+  //copied back by the host.
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+  CHECKGLERROR();
+}
+
+void ComputeDepthSort::_carry_ranks() {
+  //ranks of the last sort marked, then compacted by blocks : the first slot
+  //of each block, the last one past the ranked particles.
+  GLuint const zero = 0u;
+  GLuint const block_count = (rank_count_ + SORT_RANK_BLOCK_WIDTH - 1u) / SORT_RANK_BLOCK_WIDTH;
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, carry_buffer_id_);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, block_count * SORT_RANK_BLOCK_WIDTH * sizeof(GLuint),
+                         GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, offsetof(TSortCarry, rank_block_starts),
+                         (SORT_RANK_BLOCK_COUNT + 2u) * sizeof(GLuint),
+                         GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0u);
+
+  glUseProgram(pgm_.carry_marks);
+  {
+    glUniform1ui(ulocation_.carry_marks.rankCount, rank_count_);
+    glDispatchCompute(GetThreadsGroupCount(std::max(1u, max_count_)), 1u, 1u);
+  }
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  glUseProgram(pgm_.carry_scan);
+  {
+    glDispatchCompute(block_count, 1u, 1u);
+  }
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  glBindBufferRange(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_SORT_BUCKETS, carry_buffer_id_,
+                    offsetof(TSortCarry, rank_block_starts), (SORT_RANK_BLOCK_COUNT + 1u) * sizeof(GLuint));
+  glUseProgram(pgm_.scan);
+  {
+    glUniform1ui(ulocation_.scan.bucketCount, block_count + 1u);
+    glDispatchCompute(1u, 1u, 1u);
+  }
+  glUseProgram(0u);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  CHECKGLERROR();
+}
+
+void ComputeDepthSort::_use_sort_program(bool const write_ranks) {
+  glUseProgram(pgm_.step);
+  glUniform1ui(ulocation_.step.count, count_);
+  glUniform1i(ulocation_.step.writeRanks, (write_ranks) ? GL_TRUE : GL_FALSE);
+}
+
+void ComputeDepthSort::_stages(GLuint const block_width, bool const flip, bool const last) {
+  //from the pair distance of the block width down to 1, the first one
+  //flipped when merging sorted halves of the blocks.
+  unsigned int const nstages = GetNumTrailingBits(block_width);
+  for (unsigned int stage = 0u; stage < nstages; ++stage) {
+    bool const last_stage = last && (stage + 1u == nstages);
+    _pass(block_width >> stage, 0u, flip && (stage == 0u), last_stage);
+  }
+}
+
+void ComputeDepthSort::_pass(GLuint const block_width, GLuint const offset, bool const flip, bool const last) {
+  glUniform1ui(ulocation_.step.blockWidth, block_width);
+  glUniform1ui(ulocation_.step.offset, offset);
+  glUniform1i(ulocation_.step.flip, (flip) ? GL_TRUE : GL_FALSE);
+  glUniform1i(ulocation_.step.packOutput, (last) ? GL_TRUE : GL_FALSE);
+
+  //pairs whose lower key is counted, past the offset.
+  GLuint const pair_distance = block_width / 2u;
+  unsigned int const span = count_ - std::min(count_, offset);
+  unsigned int const npairs = (span / block_width) * pair_distance
+                            + std::min(span % block_width, pair_distance);
+
+  //ping-pong between the keys buffers. The keys before an offset are not
+  //dispatched : its pairs are swapped in place, each one read and written by
+  //the same thread.
+  GLuint const target = (offset > 0u) ? binding_ : binding_ ^ 1u;
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_INDICES_FIRST, keys_buffer_ids_[binding_]);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_INDICES_SECOND, keys_buffer_ids_[target]);
+  binding_ = target;
+
+  glDispatchCompute(GetThreadsGroupCount(std::max(1u, npairs)), 1u, 1u);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+  ++pass_count_;
+
+  CHECKGLERROR();
+}
@@ -0,0 +1,130 @@
+#ifndef API_COMPUTE_DEPTH_SORT_H_
+#define API_COMPUTE_DEPTH_SORT_H_
+
+#include "opengl.h"
+#include "api/append_consume_buffer.h"
+
+///
+/// Back-to-front bitonic sort of the visible particles, by compute kernels.
+///
+/// The depth keys of the visible particles are packed with their index, then
+/// sorted by a kernel per stage of the network, only the pairs holding a key
+/// counted on the device being dispatched. The last pass unpacks the indices
+/// as GLushort, and writes the rank of each particle in the sorted order.
+///
+/// The simulation appends the particles in any order : instead of their
+/// storage, each one carries that rank, in the ranks buffer of its buffer of
+/// the ring. Packed again from the ranks compacted by blocks, the keys follow
+/// the last sorted order, newcomers last, and may only be refined.
+///
+class ComputeDepthSort {
+public:
+  static unsigned int const kNumBuffers = AppendConsumeBuffer::kNumBuffers;
+
+  ComputeDepthSort():
+      pgm_{0u, 0u, 0u, 0u, 0u, 0u},
+      ulocation_{},
+      keys_buffer_ids_{0u, 0u},
+      ranks_buffer_ids_{0u, 0u, 0u},
+      carry_buffer_id_(0u),
+      max_count_(0u),
+      count_(0u),
+      rank_count_(0u),
+      binding_(0u),
+      pass_count_(0u)
+      {}
+
+  void initialize(unsigned int const max_count);
+  void deinitialize();
+
+  //pack the depth keys of keys_buffer with their index, their count read
+  //from the draw arguments and bounded by max_count. Carried, in the last
+  //sorted order : the ranks of the particles of culled_ids_buffer are read
+  //from the ranks buffer ranks_index. The sorted indices are written to
+  //indices_buffer.
+  void pack(GLuint const keys_buffer, GLuint const draw_args_buffer, GLuint const culled_ids_buffer,
+            unsigned int const ranks_index, GLuint const indices_buffer,
+            unsigned int const max_count, float const depth_scale, bool const carried);
+
+  //sort the keys packed, merging sorted blocks of doubling width. The ranks
+  //are written for the next sort to carry when write_ranks is set.
+  void sort(bool const write_ranks);
+
+  //sort blocks of block_width, then merge each one with a neighbour for a
+  //number of rounds, alternately on each side from the parity.
+  void refine(GLuint const block_width, unsigned int const rounds, unsigned int &parity,
+              bool const write_ranks);
+
+  //take the keys packed as sorted, by a single pass over their pairs.
+  void copy(bool const write_ranks);
+
+  //count the sorted particles nearer than the one a distance after them, or
+  //the keys packed when carried, each count apart in the carry buffer.
+  void count_inversions(GLuint const distance, bool const carried, float const depth_scale);
+
+  //passes since the keys were packed.
+  unsigned int pass_count() const { return pass_count_; }
+
+  //keys of the last sort, bounding the ranks carried.
+  unsigned int rank_count() const { return rank_count_; }
+
+  GLuint ranks_buffer_id(unsigned int const index) const { return ranks_buffer_ids_[index]; }
+
+  //inversions counted in the carry buffer, the sorted then the carried ones.
+  GLuint carry_buffer_id() const { return carry_buffer_id_; }
+  GLintptr inversions_offset() const;
+
+private:
+  void _carry_ranks();
+  void _stages(GLuint const block_width, bool const flip, bool const last);
+  void _pass(GLuint const block_width, GLuint const offset, bool const flip, bool const last);
+  void _use_sort_program(bool const write_ranks);
+
+  struct {
+    GLuint fill;
+    GLuint step;
+    GLuint carry_marks;
+    GLuint carry_scan;
+    GLuint scan;
+    GLuint inversions;
+  } pgm_;
+
+  struct {
+    struct {
+      GLint count;
+      GLint depthScale;
+      GLint carried;
+      GLint rankCount;
+    } fill;
+    struct {
+      GLint blockWidth;
+      GLint offset;
+      GLint count;
+      GLint flip;
+      GLint packOutput;
+      GLint writeRanks;
+    } step;
+    struct {
+      GLint rankCount;
+    } carry_marks;
+    struct {
+      GLint bucketCount;
+    } scan;
+    struct {
+      GLint distance;
+      GLint carried;
+      GLint depthScale;
+    } inversions;
+  } ulocation_;
+
+  GLuint keys_buffer_ids_[2];                 //< keys sorted, ping-pong.
+  GLuint ranks_buffer_ids_[kNumBuffers];      //< rank of the particles in the last sorted order, per buffer of the ring.
+  GLuint carry_buffer_id_;                    //< ranks compacted by blocks, and the inversions counted.
+  unsigned int max_count_;
+  unsigned int count_;                        //< keys packed, a pair at least.
+  unsigned int rank_count_;
+  unsigned int binding_;                      //< keys buffer read by the next pass.
+  unsigned int pass_count_;
+};
+
+#endif // API_COMPUTE_DEPTH_SORT_H_
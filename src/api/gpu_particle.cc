@@ -3,10 +3,27 @@
 
 #include "shaders/sparkle/interop.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
 #include <iostream>
 
 unsigned int const GPUParticle::kThreadsGroupWidth = PARTICLES_KERNEL_GROUP_WIDTH;
-unsigned int const GPUParticle::kBatchEmitCount;
+unsigned int const GPUParticle::kMaxEmitterCount;
+unsigned int const GPUParticle::kMaxSortStagesPerPass;
+unsigned int const GPUParticle::kMaxSortBucketCount;
+unsigned int const GPUParticle::kDefaultSortBucketCount;
+unsigned int const GPUParticle::kMaxSortTileGrid;
+unsigned int const GPUParticle::kDefaultSortTileGrid;
+
+static_assert(GPUParticle::kMaxEmitterCount == MAX_NUM_EMITTERS, "emitter count mismatch");
+static_assert(GPUParticle::kEmitterSphere == EMITTER_SHAPE_SPHERE, "emitter shape mismatch");
+static_assert(GPUParticle::kEmitterDisk == EMITTER_SHAPE_DISK, "emitter shape mismatch");
+static_assert(GPUParticle::kEmitterBox == EMITTER_SHAPE_BOX, "emitter shape mismatch");
+static_assert(GPUParticle::kMaxSortBucketCount == MAX_SORT_BUCKET_COUNT, "sort buckets count mismatch");
+static_assert(GPUParticle::kMaxSortTileGrid == MAX_SORT_TILE_GRID, "sort tiles grid mismatch");
+static_assert(MAX_SORT_TILE_GRID * MAX_SORT_TILE_GRID < MAX_SORT_BUCKET_COUNT, "sort tiles are scanned as buckets, their total after them");
+static_assert(AnchorBuffer::kMaxModelCount == MAX_NUM_ANCHOR_MODELS, "anchor models count mismatch");
 
 #define _BENCHMARK(block) \
 { \
@@ -57,23 +74,132 @@ namespace {
     return r;
   }
 
+  //std140 layout of an emitter, as read by the emission shader.
+  struct TEmitterData {
+    mat4x4 transform;
+    vec4 velocity;
+    vec4 params;
+    GLuint batch[4u];
+  };
+  static_assert(sizeof(TEmitterData) == 112u, "TEmitterData must match the std140 layout");
+
+  //bytesize of a particle in the particles buffers.
+  GLsizei const kParticleStride = PARTICLE_ATTRIB_BUFFER_COUNT * sizeof(vec4);
+
+  //bytesize of a particle in the culled buffer.
+  GLsizei const kCulledStride = CULLED_ATTRIB_BUFFER_COUNT * sizeof(vec4);
+
+  //camera motion since the last sort past which a previous order is not
+  //refined : a rotation of 2 degrees, or a move of a fraction of the depth range.
+  float const kSortJumpCosine = 0.99939f;
+  float const kSortJumpDistance = 0.02f;
+
+  //camera motion since the last sort under which it may be skipped : a
+  //rotation of a quarter degree, or a move of a thousandth of the depth range.
+  float const kSortSkipCosine = 0.99999f;
+  float const kSortSkipDistance = 0.001f;
+
+  //particles compared in the carried order to measure its disorder : swaps
+  //of closer particles, of about the same depth, barely change the blending.
+  GLuint const kSortDisorderDistance = 64u;
+
+  //weight of the last measure in the average time of a sort pass.
+  float const kSortPassTimeWeight = 0.25f;
+
+  //blend factors of the blend modes, for a sprite color (rgb * a, a).
+  struct TBlendProfile {
+    GLenum src_factor;
+    GLenum dst_factor;
+    bool order_independent;
+  };
+  TBlendProfile const kBlendProfiles[GPUParticle::kNumBlendModes] = {
+    {GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, false},    //< kBlendAlpha
+    {GL_ONE, GL_ONE_MINUS_SRC_ALPHA, false},          //< kBlendPremultiplied
+    {GL_SRC_ALPHA, GL_ONE, true},                     //< kBlendAdditive
+    {GL_DST_COLOR, GL_ONE_MINUS_SRC_ALPHA, true},     //< kBlendMultiply : dst * (rgb + 1 - a).
+    {GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA, true},     //< kBlendWeighted : composite, alpha being the revealage.
+  };
+
+  //power of two width of the sort textures laid out for a count of keys,
+  //in texels of four keys, and the rows holding them : the passes are bound
+  //to those rows.
+  void GetSortTextureSize(unsigned int const count, GLuint *width, GLuint *rows) {
+    unsigned int const texels = (count + 3u) / 4u;
+    unsigned int const size = GetClosestPowerOfTwo(texels);
+    *width = 1u << (GetNumTrailingBits(size) / 2u);
+    *rows = std::max(1u, (texels + *width - 1u) / *width);
+  }
+
+  //world space planes of the frustum of a view-projection matrix, normals
+  //pointing inside, with (xyz) unit length so w is a signed distance.
+  void ExtractFrustumPlanes(mat4x4 const m, vec4 planes[6]) {
+    for (int i = 0; i < 6; ++i) {
+      int const row = i / 2;
+      float const sign = (i & 1) ? -1.0f : 1.0f;
+      for (int j = 0; j < 4; ++j) {
+        planes[i][j] = m[j][3] + sign * m[j][row];
+      }
+      float const len = vec3_len(planes[i]);
+      vec4_scale(planes[i], planes[i], 1.0f / len);
+    }
+  }
+
+  //camera position, from the rigid view transform.
+  void GetViewPosition(mat4x4 const view, vec3 eye) {
+    for (int i = 0; i < 3; ++i) {
+      eye[i] = -(view[i][0] * view[3][0] + view[i][1] * view[3][1] + view[i][2] * view[3][2]);
+    }
+  }
+
+  //cosine between the view directions of two cameras, and distance between them.
+  void GetViewDelta(mat4x4 const a, mat4x4 const b, float *cosine, float *distance) {
+    vec3 eye_a;
+    vec3 eye_b;
+    vec3 move;
+    GetViewPosition(a, eye_a);
+    GetViewPosition(b, eye_b);
+    vec3_sub(move, eye_a, eye_b);
+    *distance = vec3_len(move);
+    *cosine = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+      *cosine += a[i][2] * b[i][2];
+    }
+  }
+
+  //depth range of the visible particles, up to the far plane (the last one).
+  //Deeper particles, kept by the culling margin, clamp to its end.
+  float GetSortDepthRange(mat4x4 const view, vec4 const planes[6], float const max_distance) {
+    vec3 eye;
+    GetViewPosition(view, eye);
+    float const far_distance = vec3_mul_inner(planes[5], eye) + planes[5][3];
+    float const range = std::min(far_distance, max_distance);
+    return (range > 0.0f && std::isfinite(range)) ? range : 1.0f;
+  }
+
 } //namespace
 
 void GPUParticle::init() {
 
   //assert that the number of particles will be a factor of threadGroupWidth.
   unsigned int const num_particles = FloorParticleCount(kMaxParticleCount);
-  fprintf(stderr, "[ %u particles, %u per batch ]\n", num_particles, kBatchEmitCount);
+  fprintf(stderr, "[ %u particles ]\n", num_particles);
 
   //append consume buffer.
-  unsigned int const num_attrib_buffer = 3u; //(sizeof(TParticle) + sizeof(vec4) - 1u) / sizeof(vec4); // = 3 ?
+  unsigned int const num_attrib_buffer = PARTICLE_ATTRIB_BUFFER_COUNT;
   pbuffer_ = new AppendConsumeBuffer(num_particles, num_attrib_buffer);
   pbuffer_->initialize();
 
-  //random value buffer. generate a random vector for each particle.
-  unsigned int const num_randvalues = 3u * num_particles;
-  randbuffer_.initialize(num_randvalues);
-  randbuffer_.generate_values();
+  //compute kernels need an OpenGL 4.3 context.
+  if ((backend_ == kBackendCompute) && !HasComputeShaderSupport()) {
+    fprintf(stderr, "warning: compute shaders not supported, fallback to transform feedback.\n");
+    backend_ = kBackendTransformFeedback;
+  }
+
+  //random numbers are hashed on the device from (slot, frame, seed).
+  random_seed_ = static_cast<unsigned int>(rand());
+
+  //target meshes anchors, set by the application.
+  anchors_.initialize(kMaxParticleCount);
 
   //vector field generator.
   if (1) {
@@ -87,17 +213,26 @@ void GPUParticle::init() {
         SHADERS_DIR "/sparkle/cs_emission.glsl",
         nullptr,
         src_buffer);
-  const char* varyings[3] = { "tfPosition",  "tfVelocity", "tfAge" };
-  glTransformFeedbackVaryings(pgm_.emission, 3, varyings, GL_INTERLEAVED_ATTRIBS);
+  //fill the PARTICLE_ATTRIB_BUFFER_COUNT vec4 of a particle.
+  const char* varyings[5] = { "tfPosition",  "tfVelocity", "tfAge", "tfAnchor", "tfCurl" };
+  glTransformFeedbackVaryings(pgm_.emission, 5, varyings, GL_INTERLEAVED_ATTRIBS);
   LinkProgram(pgm_.emission, SHADERS_DIR "/sparkle/cs_emission.glsl");
 
-  pgm_.simulation = CompileProgram(
-        SHADERS_DIR "/sparkle/cs_simulation.glsl",
-        SHADERS_DIR "/sparkle/gs_simulation.glsl",
-        nullptr,
-        src_buffer);
-  glTransformFeedbackVaryings(pgm_.simulation, 3, varyings, GL_INTERLEAVED_ATTRIBS);
-  LinkProgram(pgm_.simulation, SHADERS_DIR "/sparkle/gs_simulation.glsl");
+  if (backend_ == kBackendCompute) {
+    //same uniforms and samplers as the transform feedback simulation.
+    pgm_.simulation = CompileComputeProgram(
+          SHADERS_DIR "/sparkle/cs_simulation_kernel.glsl",
+          src_buffer);
+    LinkProgram(pgm_.simulation, SHADERS_DIR "/sparkle/cs_simulation_kernel.glsl");
+  } else {
+    pgm_.simulation = CompileProgram(
+          SHADERS_DIR "/sparkle/cs_simulation.glsl",
+          SHADERS_DIR "/sparkle/gs_simulation.glsl",
+          nullptr,
+          src_buffer);
+    glTransformFeedbackVaryings(pgm_.simulation, 5, varyings, GL_INTERLEAVED_ATTRIBS);
+    LinkProgram(pgm_.simulation, SHADERS_DIR "/sparkle/gs_simulation.glsl");
+  }
 
   pgm_.fill_indices = CompileProgram(
         SHADERS_DIR "/sparkle/vs_fill_indices.glsl",
@@ -105,13 +240,97 @@ void GPUParticle::init() {
         src_buffer);
   LinkProgram(pgm_.fill_indices, SHADERS_DIR "/sparkle/fs_fill_indices.glsl");
 
-  pgm_.calculate_dp = CompileProgram(
-      SHADERS_DIR "/sparkle/vs_calculate_dp.glsl",
+  if (backend_ == kBackendCompute) {
+    pgm_.cull = CompileComputeProgram(
+        SHADERS_DIR "/sparkle/cs_cull_kernel.glsl",
+        src_buffer);
+    LinkProgram(pgm_.cull, SHADERS_DIR "/sparkle/cs_cull_kernel.glsl");
+  } else {
+    pgm_.cull = CompileProgram(
+        SHADERS_DIR "/sparkle/vs_cull.glsl",
+        SHADERS_DIR "/sparkle/gs_cull.glsl",
+        nullptr,
+        src_buffer);
+    //depth keys of the visible particles in a first buffer, the particles
+    //in a second and their storage index in a third. The index of the others
+    //in a fourth.
+    const char* varyings1[9] = {
+      "tfDp", "gl_NextBuffer", "tfPosition", "tfVelocity", "tfAge",
+      "gl_NextBuffer", "tfId", "gl_NextBuffer", "tfHiddenId"
+    };
+    glTransformFeedbackVaryings(pgm_.cull, 9, varyings1, GL_INTERLEAVED_ATTRIBS);
+    LinkProgram(pgm_.cull, SHADERS_DIR "/sparkle/gs_cull.glsl");
+
+    pgm_.visible_count = CompileProgram(
+        SHADERS_DIR "/sparkle/vs_visible_count.glsl",
+        SHADERS_DIR "/sparkle/fs_visible_count.glsl",
+        src_buffer);
+    LinkProgram(pgm_.visible_count, SHADERS_DIR "/sparkle/fs_visible_count.glsl");
+  }
+
+  //neighbours grid, as cells tables and lists.
+  if (backend_ == kBackendTransformFeedback) {
+    pgm_.grid_count = CompileProgram(
+        SHADERS_DIR "/sparkle/vs_grid_count.glsl",
+        SHADERS_DIR "/sparkle/fs_grid_count.glsl",
+        src_buffer);
+    LinkProgram(pgm_.grid_count, SHADERS_DIR "/sparkle/fs_grid_count.glsl");
+
+    pgm_.grid_reduce = CompileProgram(
+        SHADERS_DIR "/sparkle/vs_sort_step.glsl",
+        SHADERS_DIR "/sparkle/fs_grid_reduce.glsl",
+        src_buffer);
+    LinkProgram(pgm_.grid_reduce, SHADERS_DIR "/sparkle/fs_grid_reduce.glsl");
+
+    pgm_.grid_scan = CompileProgram(
+        SHADERS_DIR "/sparkle/vs_sort_step.glsl",
+        SHADERS_DIR "/sparkle/fs_grid_scan.glsl",
+        src_buffer);
+    LinkProgram(pgm_.grid_scan, SHADERS_DIR "/sparkle/fs_grid_scan.glsl");
+
+    //keys of each digit in a buffer of their own, from the particles first.
+    const char* varyings5[7] = {
+      "tfKey0", "gl_NextBuffer", "tfKey1", "gl_NextBuffer", "tfKey2", "gl_NextBuffer", "tfKey3"
+    };
+    pgm_.grid_keys = CompileProgram(
+        SHADERS_DIR "/sparkle/vs_grid_keys.glsl",
+        SHADERS_DIR "/sparkle/gs_grid_partition.glsl",
+        nullptr,
+        src_buffer);
+    glTransformFeedbackVaryings(pgm_.grid_keys, 7, varyings5, GL_INTERLEAVED_ATTRIBS);
+    LinkProgram(pgm_.grid_keys, SHADERS_DIR "/sparkle/gs_grid_partition.glsl");
+
+    pgm_.grid_scatter = CompileProgram(
+        SHADERS_DIR "/sparkle/vs_grid_partition.glsl",
+        SHADERS_DIR "/sparkle/gs_grid_partition.glsl",
+        nullptr,
+        src_buffer);
+    glTransformFeedbackVaryings(pgm_.grid_scatter, 7, varyings5, GL_INTERLEAVED_ATTRIBS);
+    LinkProgram(pgm_.grid_scatter, SHADERS_DIR "/sparkle/gs_grid_partition.glsl");
+
+    pgm_.grid_gather = CompileProgram(
+        SHADERS_DIR "/sparkle/vs_grid_gather.glsl",
+        nullptr,
+        src_buffer);
+    const char* varyings6[1] = { "tfIndex" };
+    glTransformFeedbackVaryings(pgm_.grid_gather, 1, varyings6, GL_INTERLEAVED_ATTRIBS);
+    LinkProgram(pgm_.grid_gather, SHADERS_DIR "/sparkle/vs_grid_gather.glsl");
+  }
+
+  pgm_.dead_list = CompileProgram(
+      SHADERS_DIR "/sparkle/vs_dead_list.glsl",
+      SHADERS_DIR "/sparkle/gs_dead_list.glsl",
       nullptr,
       src_buffer);
-  const char* varyings1[1] = { "tfDp" };
-  glTransformFeedbackVaryings(pgm_.calculate_dp, 1, varyings1, GL_INTERLEAVED_ATTRIBS);
-  LinkProgram(pgm_.calculate_dp, SHADERS_DIR "/sparkle/vs_calculate_dp.glsl");
+  const char* varyings2[1] = { "tfSlot" };
+  glTransformFeedbackVaryings(pgm_.dead_list, 1, varyings2, GL_INTERLEAVED_ATTRIBS);
+  LinkProgram(pgm_.dead_list, SHADERS_DIR "/sparkle/gs_dead_list.glsl");
+
+  pgm_.emit_map = CompileProgram(
+      SHADERS_DIR "/sparkle/vs_emit_map.glsl",
+      SHADERS_DIR "/sparkle/fs_emit_map.glsl",
+      src_buffer);
+  LinkProgram(pgm_.emit_map, SHADERS_DIR "/sparkle/fs_emit_map.glsl");
 
   pgm_.sort_step = CompileProgram(
       SHADERS_DIR "/sparkle/vs_sort_step.glsl",
@@ -119,6 +338,32 @@ void GPUParticle::init() {
       src_buffer);
   LinkProgram(pgm_.sort_step, SHADERS_DIR "/sparkle/fs_sort_step.glsl");
 
+  pgm_.sort_stages = CompileProgram(
+      SHADERS_DIR "/sparkle/vs_sort_step.glsl",
+      SHADERS_DIR "/sparkle/fs_sort_stages.glsl",
+      src_buffer);
+  LinkProgram(pgm_.sort_stages, SHADERS_DIR "/sparkle/fs_sort_stages.glsl");
+
+  pgm_.sort_flip = CompileProgram(
+      SHADERS_DIR "/sparkle/vs_sort_step.glsl",
+      SHADERS_DIR "/sparkle/fs_sort_flip.glsl",
+      src_buffer);
+  LinkProgram(pgm_.sort_flip, SHADERS_DIR "/sparkle/fs_sort_flip.glsl");
+
+  pgm_.sort_inversions = CompileProgram(
+      SHADERS_DIR "/sparkle/vs_sort_step.glsl",
+      SHADERS_DIR "/sparkle/fs_sort_inversions.glsl",
+      src_buffer);
+  LinkProgram(pgm_.sort_inversions, SHADERS_DIR "/sparkle/fs_sort_inversions.glsl");
+
+  pgm_.gather_ids = CompileProgram(
+      SHADERS_DIR "/sparkle/vs_gather_ids.glsl",
+      nullptr,
+      src_buffer);
+  const char* varyings3[1] = { "tfSortedId" };
+  glTransformFeedbackVaryings(pgm_.gather_ids, 1, varyings3, GL_INTERLEAVED_ATTRIBS);
+  LinkProgram(pgm_.gather_ids, SHADERS_DIR "/sparkle/vs_gather_ids.glsl");
+
   /*pgm_.render_point_sprite = CompileProgram(
           SHADERS_DIR "/sparkle/vs_generic.glsl",
           SHADERS_DIR "/sparkle/fs_point_sprite.glsl",
@@ -131,94 +376,196 @@ void GPUParticle::init() {
           SHADERS_DIR "/sparkle/fs_stretched_sprite.glsl",
           src_buffer);
   LinkProgram(pgm_.render_stretched_sprite, SHADERS_DIR "/sparkle/fs_stretched_sprite.glsl");
+
+  pgm_.oit_composite = CompileProgram(
+          SHADERS_DIR "/sparkle/vs_fill_indices.glsl",
+          SHADERS_DIR "/sparkle/fs_oit_composite.glsl",
+          src_buffer);
+  LinkProgram(pgm_.oit_composite, SHADERS_DIR "/sparkle/fs_oit_composite.glsl");
   delete[] src_buffer;
 
   //get attributes location.
-  alocation_.emission.randvector = glGetAttribLocation(pgm_.emission, "randvec");
   alocation_.simulation.position = glGetAttribLocation(pgm_.simulation, "position");
   alocation_.simulation.velocity = glGetAttribLocation(pgm_.simulation, "velocity");
   alocation_.simulation.age = glGetAttribLocation(pgm_.simulation, "age");
-  alocation_.simulation.randvector = glGetAttribLocation(pgm_.simulation, "randvec");
-  alocation_.calculate_dp.position = glGetAttribLocation(pgm_.calculate_dp, "position");
-  alocation_.calculate_dp.velocity = glGetAttribLocation(pgm_.calculate_dp, "velocity");
-  alocation_.calculate_dp.age = glGetAttribLocation(pgm_.calculate_dp, "age");
+  alocation_.simulation.anchor = glGetAttribLocation(pgm_.simulation, "anchor");
+  alocation_.simulation.curl = glGetAttribLocation(pgm_.simulation, "curl");
+  alocation_.cull.position = glGetAttribLocation(pgm_.cull, "position");
+  alocation_.cull.velocity = glGetAttribLocation(pgm_.cull, "velocity");
+  alocation_.cull.age = glGetAttribLocation(pgm_.cull, "age");
   alocation_.render_stretched_sprite.position = glGetAttribLocation(pgm_.render_stretched_sprite, "position");
   alocation_.render_stretched_sprite.velocity = glGetAttribLocation(pgm_.render_stretched_sprite, "velocity");
   alocation_.render_stretched_sprite.age = glGetAttribLocation(pgm_.render_stretched_sprite, "age_info");
 
   //get uniform location.
-  ulocation_.emission.count = GetUniformLocation(pgm_.emission, "uEmitCount");
-  ulocation_.emission.particleMaxAge = GetUniformLocation(pgm_.emission, "uParticleMaxAge");
+  ulocation_.emission.numEmitters = GetUniformLocation(pgm_.emission, "uNumEmitters");
+  ulocation_.emission.emitFirst = GetUniformLocation(pgm_.emission, "uEmitFirst");
+  ulocation_.emission.anchorCount = GetUniformLocation(pgm_.emission, "uAnchorCount");
+  ulocation_.emission.frame = GetUniformLocation(pgm_.emission, "uFrame");
   ulocation_.simulation.deltaT = GetUniformLocation(pgm_.simulation, "uDeltaT");
   ulocation_.simulation.vectorFieldSampler = GetUniformLocation(pgm_.simulation, "uVectorFieldSampler");
   ulocation_.simulation.bboxSize = GetUniformLocation(pgm_.simulation, "uBBoxSize");
-  ulocation_.calculate_dp.view = GetUniformLocation(pgm_.calculate_dp, "uViewMatrix");
+  ulocation_.simulation.numEmitters = GetUniformLocation(pgm_.simulation, "uNumEmitters");
+  ulocation_.simulation.emitFirst = glGetUniformLocation(pgm_.simulation, "uEmitFirst");
+  ulocation_.simulation.frame = glGetUniformLocation(pgm_.simulation, "uFrame");
+  ulocation_.simulation.interactionRadius = GetUniformLocation(pgm_.simulation, "uInteractionRadius");
+  ulocation_.simulation.repulsion = GetUniformLocation(pgm_.simulation, "uRepulsion");
+  ulocation_.simulation.cohesion = GetUniformLocation(pgm_.simulation, "uCohesion");
+  ulocation_.simulation.anchorCount = GetUniformLocation(pgm_.simulation, "uAnchorCount");
+  ulocation_.simulation.targetAttraction = GetUniformLocation(pgm_.simulation, "uTargetAttraction");
+  ulocation_.simulation.view = GetUniformLocation(pgm_.simulation, "uViewMatrix");
+  ulocation_.simulation.frustumPlanes = GetUniformLocation(pgm_.simulation, "uFrustumPlanes");
+  ulocation_.simulation.lodDistance = GetUniformLocation(pgm_.simulation, "uLodDistance");
+  ulocation_.simulation.lodPeriod = GetUniformLocation(pgm_.simulation, "uLodPeriod");
+  ulocation_.simulation.curlNoisePeriod = GetUniformLocation(pgm_.simulation, "uCurlNoisePeriod");
+  ulocation_.simulation.stableSlots = glGetUniformLocation(pgm_.simulation, "uStableSlots");
+  ulocation_.simulation.maxParticleCount = glGetUniformLocation(pgm_.simulation, "uMaxParticleCount");
+  ulocation_.simulation.carryRanks = glGetUniformLocation(pgm_.simulation, "uCarryRanks");
+  ulocation_.dead_list.firstFreshSlot = GetUniformLocation(pgm_.dead_list, "uFirstFreshSlot");
+  ulocation_.emit_map.emitMapSize = GetUniformLocation(pgm_.emit_map, "uEmitMapSize");
+  if (backend_ == kBackendTransformFeedback) {
+    ulocation_.grid_count.bboxSize = GetUniformLocation(pgm_.grid_count, "uBBoxSize");
+    alocation_.grid_count.position = glGetAttribLocation(pgm_.grid_count, "position");
+    alocation_.grid_count.age = glGetAttribLocation(pgm_.grid_count, "age");
+    ulocation_.grid_reduce.width = GetUniformLocation(pgm_.grid_reduce, "width");
+    ulocation_.grid_reduce.groupWidth = GetUniformLocation(pgm_.grid_reduce, "uGroupWidth");
+    ulocation_.grid_scan.width = GetUniformLocation(pgm_.grid_scan, "width");
+    ulocation_.grid_scan.groupWidth = GetUniformLocation(pgm_.grid_scan, "uGroupWidth");
+    ulocation_.grid_scan.topLevel = GetUniformLocation(pgm_.grid_scan, "uTopLevel");
+    ulocation_.grid_keys.bboxSize = GetUniformLocation(pgm_.grid_keys, "uBBoxSize");
+    ulocation_.grid_keys.shift = GetUniformLocation(pgm_.grid_keys, "uShift");
+    ulocation_.grid_scatter.shift = GetUniformLocation(pgm_.grid_scatter, "uShift");
+  }
+  ulocation_.cull.view = GetUniformLocation(pgm_.cull, "uViewMatrix");
+  ulocation_.cull.frustumPlanes = GetUniformLocation(pgm_.cull, "uFrustumPlanes");
+  ulocation_.cull.cullMargin = GetUniformLocation(pgm_.cull, "uCullMargin");
+  ulocation_.cull.timeStep = GetUniformLocation(pgm_.cull, "uTimeStep");
+  ulocation_.cull.maxDistance = GetUniformLocation(pgm_.cull, "uMaxDistance");
+  ulocation_.cull.enableCulling = GetUniformLocation(pgm_.cull, "uEnableCulling");
+  if (backend_ == kBackendCompute) {
+    ulocation_.cull.storeDepthKeys = GetUniformLocation(pgm_.cull, "uStoreDepthKeys");
+    ulocation_.cull.carryRanks = GetUniformLocation(pgm_.cull, "uCarryRanks");
+  }
   ulocation_.fill_indices.width = GetUniformLocation(pgm_.fill_indices, "width");
-  ulocation_.fill_indices.height = GetUniformLocation(pgm_.fill_indices, "height");
+  ulocation_.fill_indices.depthScale = GetUniformLocation(pgm_.fill_indices, "uDepthScale");
   ulocation_.sort_step.blockWidth = GetUniformLocation(pgm_.sort_step, "uBlockWidth");
-  ulocation_.sort_step.maxBlockWidth = GetUniformLocation(pgm_.sort_step, "uMaxBlockWidth");
+  ulocation_.sort_step.flip = GetUniformLocation(pgm_.sort_step, "uFlip");
+  ulocation_.sort_step.count = GetUniformLocation(pgm_.sort_step, "uCount");
   ulocation_.sort_step.width = GetUniformLocation(pgm_.sort_step, "width");
-  ulocation_.sort_step.height = GetUniformLocation(pgm_.sort_step, "height");
-  ulocation_.sort_step.texWidth = GetUniformLocation(pgm_.sort_step, "texWidth");
-  ulocation_.sort_step.texHeight = GetUniformLocation(pgm_.sort_step, "texHeight");
+  ulocation_.sort_stages.blockWidth = GetUniformLocation(pgm_.sort_stages, "uBlockWidth");
+  ulocation_.sort_stages.stageCount = GetUniformLocation(pgm_.sort_stages, "uStageCount");
+  ulocation_.sort_stages.flip = GetUniformLocation(pgm_.sort_stages, "uFlip");
+  ulocation_.sort_stages.count = GetUniformLocation(pgm_.sort_stages, "uCount");
+  ulocation_.sort_stages.width = GetUniformLocation(pgm_.sort_stages, "width");
+  ulocation_.sort_stages.unpackIndices = GetUniformLocation(pgm_.sort_stages, "uUnpackIndices");
+  ulocation_.sort_flip.blockWidth = GetUniformLocation(pgm_.sort_flip, "uBlockWidth");
+  ulocation_.sort_flip.offset = GetUniformLocation(pgm_.sort_flip, "uOffset");
+  ulocation_.sort_flip.size = GetUniformLocation(pgm_.sort_flip, "uSize");
+  ulocation_.sort_flip.count = GetUniformLocation(pgm_.sort_flip, "uCount");
+  ulocation_.sort_flip.width = GetUniformLocation(pgm_.sort_flip, "width");
+  ulocation_.sort_inversions.width = GetUniformLocation(pgm_.sort_inversions, "width");
+  ulocation_.sort_inversions.component = GetUniformLocation(pgm_.sort_inversions, "uComponent");
+  ulocation_.sort_inversions.distance = GetUniformLocation(pgm_.sort_inversions, "uDistance");
+  ulocation_.sort_inversions.carried = GetUniformLocation(pgm_.sort_inversions, "uCarried");
+  ulocation_.sort_inversions.depthScale = GetUniformLocation(pgm_.sort_inversions, "uDepthScale");
   //ulocation_.render_point_sprite.mvp = GetUniformLocation(pgm_.render_point_sprite, "uMVP");
   ulocation_.render_stretched_sprite.view = GetUniformLocation(pgm_.render_stretched_sprite, "uView");
   ulocation_.render_stretched_sprite.mvp = GetUniformLocation(pgm_.render_stretched_sprite, "uMVP");
+  ulocation_.render_stretched_sprite.weighted = GetUniformLocation(pgm_.render_stretched_sprite, "uWeighted");
+  ulocation_.oit_composite.offset = GetUniformLocation(pgm_.oit_composite, "uOffset");
+  ulocation_.render_stretched_sprite.timeLag = GetUniformLocation(pgm_.render_stretched_sprite, "uTimeLag");
 
   //one time uniform setting.
   glProgramUniform1i(pgm_.simulation,
                       GetUniformLocation(pgm_.simulation, "uPerlinNoisePermutationSeed"),
                     rand());
+  glProgramUniform1ui(pgm_.emission, GetUniformLocation(pgm_.emission, "uSeed"), random_seed_);
+  glProgramUniform1i(pgm_.fill_indices, GetUniformLocation(pgm_.fill_indices, "dp"), 0);
+  glProgramUniform1i(pgm_.sort_step, GetUniformLocation(pgm_.sort_step, "keys"), 0);
+  glProgramUniform1i(pgm_.sort_stages, GetUniformLocation(pgm_.sort_stages, "keys"), 0);
+  glProgramUniform1i(pgm_.sort_flip, GetUniformLocation(pgm_.sort_flip, "keys"), 0);
+  glProgramUniform1i(pgm_.sort_inversions, GetUniformLocation(pgm_.sort_inversions, "sorted"), 0);
+  glProgramUniform1i(pgm_.sort_inversions, GetUniformLocation(pgm_.sort_inversions, "dp"), 1);
+  if (backend_ == kBackendTransformFeedback) {
+    glProgramUniform1i(pgm_.fill_indices, GetUniformLocation(pgm_.fill_indices, "uVisibleCount"), 1);
+    glProgramUniform1i(pgm_.sort_inversions, GetUniformLocation(pgm_.sort_inversions, "uVisibleCount"), 2);
+  }
+  //only used when scattering is enabled.
+  glProgramUniform1ui(pgm_.simulation, glGetUniformLocation(pgm_.simulation, "uSeed"), random_seed_);
 
   GLuint ln_size = (GLuint)(std::log2(kMaxParticleCount)/ 2);
   texture_width_1 = 1 << (GLuint) (ln_size);
   texture_height_1 = 1 << (GLuint)(std::log2(kMaxParticleCount) - ln_size);
 
-  // texture for indices sorting.
+  //sort keys textures, the depth quantised on the high 16 bits and the index
+  //on the low ones, four consecutive keys per texel.
+  GLuint sort_width = 0u;
+  GLuint sort_rows = 0u;
+  GetSortTextureSize(kMaxParticleCount, &sort_width, &sort_rows);
   glGenTextures(2, indices_texture_ids_);
+  glGenTextures(1, &sorted_texture_id_);
+  for (unsigned int i = 0u; i < 3u; ++i) {
+    bool const sorted = (i == 2u);
+    glBindTexture(GL_TEXTURE_2D, (sorted) ? sorted_texture_id_ : indices_texture_ids_[i]);
+    if (sorted) {
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16UI, sort_width, sort_rows, 0, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+    } else {
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32UI, sort_width, sort_rows, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, nullptr);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
 
-  glBindTexture(GL_TEXTURE_2D, indices_texture_ids_[0]);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, texture_width_1, texture_height_1, 0, GL_RED_INTEGER, GL_UNSIGNED_SHORT, nullptr);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glBindTexture(GL_TEXTURE_2D, indices_texture_ids_[1]);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, texture_width_1, texture_height_1, 0, GL_RED_INTEGER, GL_UNSIGNED_SHORT, nullptr);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-  //framebuffer.
-  glGenFramebuffers(1, &framebuffer_);
+  //framebuffers, ping-ponging between the keys textures.
   glGenFramebuffers(2u, framebuf);
   glGenFramebuffers(1, &framebuffer1_);
-
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuf[0]);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, indices_texture_ids_[1], 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuf[1]);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, indices_texture_ids_[0], 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer1_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sorted_texture_id_, 0);
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-  //dot products float texture.
-  glGenTextures(1, &dp_texture_id_);
-  glBindTexture(GL_TEXTURE_2D, dp_texture_id_);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, texture_width_1, texture_height_1, 0, GL_RED, GL_FLOAT, nullptr);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-  glBindTexture(GL_TEXTURE_2D, 0);
-
   glGenBuffers(1, &vbo_);
   glBindBuffer(GL_ARRAY_BUFFER, vbo_);
   glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * kMaxParticleCount, nullptr, GL_DYNAMIC_DRAW);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
 
+  //depth keys read in place by the keys packing.
+  glGenTextures(1, &dp_texture_id_);
+  glBindTexture(GL_TEXTURE_BUFFER, dp_texture_id_);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, vbo_);
+  glBindTexture(GL_TEXTURE_BUFFER, 0u);
+
   //set up VAOs.
   _setup_emission();
-  _setup_simulation();
+  if (backend_ == kBackendCompute) {
+    compute_backend_.initialize(kMaxParticleCount);
+  } else {
+    _setup_simulation();
+  }
   _setup_render();
   _setup_fill_indices();
-  _setup_calculate_dp();
+  if (backend_ == kBackendTransformFeedback) {
+    _setup_culling();
+  }
+  _setup_grid();
+  _setup_stable_slots();
+  _setup_incremental_sort();
+  _setup_weighted_oit();
+  bucket_sort_.initialize(kMaxParticleCount, backend_ == kBackendCompute);
+  if (backend_ == kBackendCompute) {
+    tile_sort_.initialize(kSortTileCapacity, kMaxSortTileGrid);
+    compute_sort_.initialize(kMaxParticleCount);
+  }
+  host_sort_.initialize(kMaxParticleCount, kCulledStride);
+
+  //timestamps around the sort.
+  glGenQueries(2, sort_queries_);
 
   //query used for the benchmarking.
   glGenQueries(1, &query_time_);
@@ -231,76 +578,241 @@ void GPUParticle::deinit() {
   pbuffer_->deinitialize();
   delete pbuffer_;
 
-  randbuffer_.deinitialize();
-
   if (enable_vectorfield_) {
     vectorfield_.deinitialize();
   }
+  anchors_.deinitialize();
+  bucket_sort_.deinitialize();
+  if (backend_ == kBackendCompute) {
+    tile_sort_.deinitialize();
+    compute_sort_.deinitialize();
+  }
+  host_sort_.deinitialize();
+  if (backend_ == kBackendCompute) {
+    compute_backend_.deinitialize();
+  }
 
   glUseProgram(0);
   glDeleteProgram(pgm_.emission);
-  glDeleteProgram(pgm_.update_args);
   glDeleteProgram(pgm_.simulation);
   glDeleteProgram(pgm_.fill_indices);
-  glDeleteProgram(pgm_.calculate_dp);
+  glDeleteProgram(pgm_.cull);
+  glDeleteProgram(pgm_.dead_list);
+  glDeleteProgram(pgm_.emit_map);
   glDeleteProgram(pgm_.sort_step);
+  glDeleteProgram(pgm_.sort_stages);
+  glDeleteProgram(pgm_.sort_flip);
+  glDeleteProgram(pgm_.sort_inversions);
+  glDeleteProgram(pgm_.gather_ids);
+  if (backend_ == kBackendTransformFeedback) {
+    glDeleteProgram(pgm_.visible_count);
+    glDeleteProgram(pgm_.grid_count);
+    glDeleteProgram(pgm_.grid_reduce);
+    glDeleteProgram(pgm_.grid_scan);
+    glDeleteProgram(pgm_.grid_keys);
+    glDeleteProgram(pgm_.grid_scatter);
+    glDeleteProgram(pgm_.grid_gather);
+  }
   //glDeleteProgram(pgm_.sort_final);
   //glDeleteProgram(pgm_.render_point_sprite);
   glDeleteProgram(pgm_.render_stretched_sprite);
+  glDeleteProgram(pgm_.oit_composite);
 
   glDeleteVertexArrays(1u, vao_e_);
-  glDeleteVertexArrays(2u, vao_s_);
-  glDeleteVertexArrays(2u, vao_);
+  glDeleteBuffers(1u, &emitters_ubo_);
+  glDeleteVertexArrays(AppendConsumeBuffer::kNumBuffers, vao_s_);
+  glDeleteVertexArrays(1u, &vao_);
   glDeleteVertexArrays(1u, &vao_f_);
-  glDeleteVertexArrays(2u, vao_c_);
+  glDeleteVertexArrays(AppendConsumeBuffer::kNumBuffers, vao_c_);
+  glDeleteVertexArrays(AppendConsumeBuffer::kNumBuffers, vao_g_);
+  glDeleteVertexArrays(2u * kGridPartitionCount, vao_gk_[0]);
+  glDeleteVertexArrays(1u, &vao_o_);
+  glDeleteVertexArrays(1u, &vao_h_);
+  glDeleteVertexArrays(1u, &vao_k_);
   glDeleteQueries(1u,&query_time_);
+  glDeleteQueries(2u, sort_queries_);
+  glDeleteQueries(1u, &inversions_query_);
+  glDeleteQueries(1u, &disorder_query_);
+  glDeleteQueries(2u, budget_queries_);
 
   glDeleteTextures(1, &dp_texture_id_);
   glDeleteTextures(2, indices_texture_ids_);
+  glDeleteTextures(1, &sorted_texture_id_);
 
-  glDeleteFramebuffers(1, &framebuffer_);
   glDeleteFramebuffers(2, framebuf);
   glDeleteFramebuffers(1, &framebuffer1_);
+  glDeleteFramebuffers(1, &oit_framebuffer_);
+  glDeleteTextures(2, oit_texture_ids_);
+  glDeleteFramebuffers(1, &grid_framebuffer_);
+  glDeleteTextures(kGridScanLevelCount, grid_sums_texture_ids_);
+  glDeleteTextures(kGridScanLevelCount, grid_starts_texture_ids_);
+  glDeleteTextures(1, &particles_texture_id_);
+  glDeleteBuffers(1, &grid_indices_buffer_);
+  glDeleteTextures(1, &grid_indices_texture_id_);
+  glDeleteBuffers(2u * kGridPartitionCount, grid_keys_buffers_[0]);
+  glDeleteTransformFeedbacks(2, grid_feedbacks_);
+  glDeleteBuffers(1, &dead_slots_buffer_);
+  glDeleteTextures(1, &dead_slots_texture_id_);
+  glDeleteTextures(1, &emit_map_texture_id_);
+  glDeleteFramebuffers(1, &emit_map_framebuffer_);
+  glDeleteQueries(kDeadListQueryCount, dead_list_queries_);
+  glDeleteTransformFeedbacks(1, &cull_feedback_);
+  glDeleteQueries(kCullQueryCount, cull_queries_);
+  glDeleteTextures(1, &visible_count_texture_id_);
+  glDeleteFramebuffers(1, &visible_count_framebuffer_);
+  glDeleteBuffers(1, &culled_ids_buffer_);
+  glDeleteBuffers(1, &hidden_ids_buffer_);
+  glDeleteBuffers(1, &sort_order_buffer_);
+  glDeleteBuffers(1, &identity_indices_);
 
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
   glDeleteBuffers(1, &vbo_);
+  glDeleteBuffers(1, &culled_vbo_);
   glDeleteBuffers(1, &sorted_indices_);
+  glDeleteBuffers(1, &render_args_buffer_);
 
   CHECKGLERROR();
 }
 
-void GPUParticle::update(const float dt, mat4x4 const &view) {
-  //max number of particles able to be spawned.
-  unsigned int const num_dead_particles = pbuffer_->element_count() - num_alive_particles_;
-  //number of particles to be emitted.
-  unsigned int const emit_count = std::min(kBatchEmitCount, num_dead_particles);
+bool GPUParticle::add_emitter(Emitter const& emitter) {
+  if (emitters_.size() >= kMaxEmitterCount) {
+    fprintf(stderr, "warning: emitter discarded, %u emitters max.\n", kMaxEmitterCount);
+    return false;
+  }
+  emitters_.push_back(emitter);
+  emission_accumulators_.push_back(0.0f);
+  return true;
+}
+
+void GPUParticle::clear_emitters() {
+  emitters_.clear();
+  emission_accumulators_.clear();
+}
+
+void GPUParticle::update(const float dt, mat4x4 const &view, mat4x4 const &viewProj) {
+  float const timestep = simulation_timestep_;
+
+  time_accumulator_ += dt;
+  unsigned int nsteps = static_cast<unsigned int>(time_accumulator_ / timestep);
+  if (nsteps > max_substeps_) {
+    //too far behind : skip time rather than spiral into more steps each frame.
+    nsteps = max_substeps_;
+    time_accumulator_ = nsteps * timestep;
+  }
+  time_accumulator_ = std::max(0.0f, time_accumulator_ - nsteps * timestep);
+
+  //camera used by the levels of detail and the culling.
+  mat4x4_dup(camera_.view, view);
+  mat4x4_dup(camera_.view_proj, viewProj);
+  ExtractFrustumPlanes(viewProj, camera_.frustum_planes);
+  camera_.depth_scale = 65535.0f / GetSortDepthRange(view, camera_.frustum_planes, cull_distance_ + cull_margin_);
+
+  for (unsigned int step = 0u; step < nsteps; ++step) {
+    //slots counted by the previous steps, when particles keep their slot.
+    if (stable_slots()) {
+      _read_dead_slot_counts();
+    }
+
+    unsigned int const emit_count = _update_emitters(timestep);
+    emitted_since_sort_ += emit_count;
+
+    //free slots of buffer A, then fresh ones past them.
+    if (stable_slots()) {
+      _build_dead_list(emit_count);
+    }
+
+    //neighbours search structure of buffer A.
+    _build_grid();
+
+    if (stable_slots()) {
+      //slots of the newborns, then simulation stage: read buffer A, create
+      //newborns in their slots, write buffer B slot for slot.
+      _build_emit_map(emit_count);
+      _simulation(timestep, emit_count);
+    } else if (enable_fused_emission_ || (backend_ == kBackendCompute)) {
+      //emission and simulation stage: read buffer A, create newborns, write buffer B.
+      _simulation(timestep, emit_count);
+    } else {
+      //emission stage: write in buffer A.
+      _emission(emit_count);
+
+      //simulation stage: read buffer A, write buffer B.
+      _simulation(timestep, 0u);
+    }
 
-  //update random buffer with new values.too heavy.
-  //randbuffer_.generate_values();
+    //cull then sort particles for the over blending, once the last state is known.
+    if ((step + 1u == nsteps) and simulated_) {
+      _culling();
+      sorted_ = sorting();
+      if (sorted_) {
+        //the host sort times itself.
+        bool const device_timing = enable_sort_timing_ && (sort_mode_ != kSortHost);
+        if (device_timing) {
+          glQueryCounter(sort_queries_[0], GL_TIMESTAMP);
+        }
+        bool const buckets = (sort_mode_ == kSortBuckets);
+        sort_skipped_ = false;
+        sort_tiled_ = false;
+        if (sort_mode_ == kSortHost) {
+          _sorting_host();
+        } else if ((backend_ == kBackendCompute) && (sort_mode_ == kSortTiles)) {
+          _sorting_tiles_kernel();
+        } else if (backend_ == kBackendCompute) {
+          (buckets) ? _sorting_buckets_kernel() : _sorting_kernel();
+        } else {
+          (buckets) ? _sorting_buckets() : _sorting();
+        }
+        if (device_timing) {
+          //waits for the sort, benchmarking only.
+          GLuint64 start = 0u;
+          GLuint64 end = 0u;
+          glQueryCounter(sort_queries_[1], GL_TIMESTAMP);
+          glGetQueryObjectui64v(sort_queries_[0], GL_QUERY_RESULT, &start);
+          glGetQueryObjectui64v(sort_queries_[1], GL_QUERY_RESULT, &end);
+          sort_time_ = static_cast<float>(end - start) * 1.0e-6f;
+        }
+        if (!sort_skipped_) {
+          emitted_since_sort_ = 0u;
+          sorted_visible_count_ = num_visible_particles_;
+          sort_skip_count_ = 0u;
+        }
+      } else {
+        //drawn in culling order, the next sort starts anew.
+        sort_tiled_ = false;
+        sort_order_carried_ = false;
+        sort_full_ = false;
+        sort_pass_count_ = 0u;
+        sort_time_ = 0.0f;
+        host_sort_.reset();
+      }
+    }
 
-  //emission stage: write in buffer A.
-  _emission(emit_count);
+    _postprocess();
 
-  //simulation stage: read buffer A, write buffer B.
-  _simulation(dt);
-//std::cout << "simulated:" << enable_sorting_ << '\n';
-  //sort particles for alpha-blending.
-  if (1 and simulated_) {
-    _sorting(view);
+    ++frame_index_;
   }
 
-  _postprocess();
+  if (backend_ == kBackendCompute) {
+    _readback_counts();
+  }
 
   CHECKGLERROR();
 }
 
+bool GPUParticle::order_independent() const {
+  return kBlendProfiles[blend_mode_].order_independent;
+}
+
 void GPUParticle::render(mat4x4 const &view, mat4x4 const &viewProj) {
   #if 1
   glUseProgram(pgm_.render_stretched_sprite);
   {
     glUniformMatrix4fv(ulocation_.render_stretched_sprite.view, 1, GL_FALSE, (GLfloat *const) view);
     glUniformMatrix4fv(ulocation_.render_stretched_sprite.mvp, 1, GL_FALSE, (GLfloat *const)viewProj);
+    //the last state is ahead of the rendered instant by what is left to simulate.
+    float const time_lag = (enable_interpolation_) ? simulation_timestep_ - time_accumulator_ : 0.0f;
+    glUniform1f(ulocation_.render_stretched_sprite.timeLag, time_lag);
   #else
     glUseProgram(pgm_.render_point_sprite);
     {
@@ -339,57 +851,394 @@ void GPUParticle::render(mat4x4 const &view, mat4x4 const &viewProj) {
       }
       glUnmapBuffer(GL_ARRAY_BUFFER);*/
 
-    glBindVertexArray(vao_[0]);
-      glDrawElements(GL_POINTS, num_alive_particles_, GL_UNSIGNED_SHORT, 0);
+    //the weighted blended mode draws offscreen, composited once drawn.
+    bool const weighted = (blend_mode_ == kBlendWeighted);
+    GLint framebuffer = 0;
+    GLint viewport[4] = {0, 0, 0, 0};
+    glUniform1i(ulocation_.render_stretched_sprite.weighted, (weighted) ? GL_TRUE : GL_FALSE);
+    if (weighted) {
+      glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+      glGetIntegerv(GL_VIEWPORT, viewport);
+      _begin_weighted_oit(viewport[2], viewport[3]);
+    } else {
+      TBlendProfile const& profile = kBlendProfiles[blend_mode_];
+      glEnable(GL_BLEND);
+      glBlendEquation(GL_FUNC_ADD);
+      glBlendFunc(profile.src_factor, profile.dst_factor);
+    }
+
+    //the count of visible particles is written on the device. Unsorted, they
+    //are drawn in culling order : the draw elements arguments start with the
+    //draw arrays ones, first index and base vertex being 0.
+    glBindVertexArray(vao_);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, render_args_buffer_);
+    if (sort_tiled_) {
+      //the vertex array draws the sorted indices otherwise.
+      tile_sort_.draw();
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sorted_indices_);
+    } else if (sorted_) {
+      glDrawElementsIndirect(GL_POINTS, GL_UNSIGNED_SHORT, nullptr);
+    } else {
+      glDrawArraysIndirect(GL_POINTS, nullptr);
+    }
       //glDrawArrays(GL_POINTS, 0, num_alive_particles_);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0u);
     glBindVertexArray(0u);
+
+    if (weighted) {
+      _composite_weighted_oit(static_cast<GLuint>(framebuffer), viewport);
+    }
   }
   glUseProgram(0u);
 
   CHECKGLERROR();
 }
 
+void GPUParticle::_begin_weighted_oit(GLsizei const width, GLsizei const height) {
+  //targets follow the viewport size.
+  if ((width != oit_width_) || (height != oit_height_)) {
+    glBindTexture(GL_TEXTURE_2D, oit_texture_ids_[0]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+    glBindTexture(GL_TEXTURE_2D, oit_texture_ids_[1]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, width, height, 0, GL_RED, GL_HALF_FLOAT, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0u);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, oit_framebuffer_);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, oit_texture_ids_[0], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, oit_texture_ids_[1], 0);
+    GLenum const buffers[2u] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, buffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      fprintf(stderr, "warning: incomplete weighted blending framebuffer.\n");
+    }
+    oit_width_ = width;
+    oit_height_ = height;
+  }
+
+  //nothing accumulated, everything revealed.
+  glBindFramebuffer(GL_FRAMEBUFFER, oit_framebuffer_);
+  glViewport(0, 0, width, height);
+  GLfloat const accumulation[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  GLfloat const revealage[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+  glClearBufferfv(GL_COLOR, 0, accumulation);
+  glClearBufferfv(GL_COLOR, 1, revealage);
+
+  //sum of the weighted colors, product of the sprites (1 - alpha).
+  glEnable(GL_BLEND);
+  glBlendEquation(GL_FUNC_ADD);
+  glBlendFunci(0, GL_ONE, GL_ONE);
+  glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+
+  CHECKGLERROR();
+}
+
+void GPUParticle::_composite_weighted_oit(GLuint const framebuffer, GLint const viewport[4]) {
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+  TBlendProfile const& profile = kBlendProfiles[kBlendWeighted];
+  glBlendFunc(profile.src_factor, profile.dst_factor);
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, oit_texture_ids_[0]);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, oit_texture_ids_[1]);
+
+  glUseProgram(pgm_.oit_composite);
+  glUniform2i(ulocation_.oit_composite.offset, viewport[0], viewport[1]);
+  glBindVertexArray(vao_f_);
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+  glBindVertexArray(0u);
+
+  glBindTexture(GL_TEXTURE_2D, 0u);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, 0u);
+
+  CHECKGLERROR();
+}
+
 void GPUParticle::_setup_emission() {
+  //no attributes : particles are generated from their slot index only.
   glGenVertexArrays(1u,&vao_e_[0]);
-  glBindVertexArray(vao_e_[0]);
 
-  randbuffer_.bind();{
-    glVertexAttribPointer(alocation_.emission.randvector, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-    glEnableVertexAttribArray(alocation_.emission.randvector);
-  }
-randbuffer_.unbind();
-  glBindVertexArray(0);
+  glGenBuffers(1u, &emitters_ubo_);
+  glBindBuffer(GL_UNIFORM_BUFFER, emitters_ubo_);
+    glBufferData(GL_UNIFORM_BUFFER, kMaxEmitterCount * sizeof(TEmitterData), nullptr, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0u);
+
+  glUniformBlockBinding(pgm_.emission,
+                        glGetUniformBlockIndex(pgm_.emission, "Emitters"),
+                        UNIFORM_BINDING_EMITTERS);
+  glUniformBlockBinding(pgm_.simulation,
+                        glGetUniformBlockIndex(pgm_.simulation, "Emitters"),
+                        UNIFORM_BINDING_EMITTERS);
+  glUniformBlockBinding(pgm_.simulation,
+                        glGetUniformBlockIndex(pgm_.simulation, "AnchorModels"),
+                        UNIFORM_BINDING_ANCHOR_MODELS);
+  glProgramUniform1i(pgm_.simulation,
+                     GetUniformLocation(pgm_.simulation, "uAnchorsSampler"),
+                     2 + kGridSamplerCount);
 
   CHECKGLERROR();
 }
 
-void GPUParticle::_setup_calculate_dp() {
+void GPUParticle::_setup_culling() {
+  //one per buffer of the ring.
+  glGenVertexArrays(AppendConsumeBuffer::kNumBuffers, vao_c_);
 
-  glUseProgram(pgm_.calculate_dp);
-  {
+  for (unsigned int i = 0u; i < AppendConsumeBuffer::kNumBuffers; ++i) {
+    glBindVertexArray(vao_c_[i]);
+    glBindBuffer(GL_ARRAY_BUFFER, pbuffer_->array_buffer_id(i)); {
+      glVertexAttribPointer(alocation_.cull.position, 3, GL_FLOAT, GL_FALSE, kParticleStride, nullptr);
+      glEnableVertexAttribArray(alocation_.cull.position);
+
+      glVertexAttribPointer(alocation_.cull.velocity, 3, GL_FLOAT, GL_FALSE, kParticleStride, (void*)(3 * sizeof(GLfloat)));
+      glEnableVertexAttribArray(alocation_.cull.velocity);
+
+      glVertexAttribPointer(alocation_.cull.age, 2, GL_FLOAT, GL_FALSE, kParticleStride, (void*)(6 * sizeof(GLfloat)));
+      glEnableVertexAttribArray(alocation_.cull.age);
+    }
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0u);
+  glBindVertexArray(0u);
+
+  //captures of the culling, drawn again from their count on the device, and
+  //counted by the host a few frames later.
+  glGenTransformFeedbacks(1, &cull_feedback_);
+  glGenQueries(kCullQueryCount, cull_queries_);
+  cull_query_first_ = 0u;
+  cull_query_pending_ = 0u;
+
+  //count of the visible particles, a single texel.
+  glGenTextures(1, &visible_count_texture_id_);
+  glBindTexture(GL_TEXTURE_2D, visible_count_texture_id_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, 1, 1, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0u);
+
+  glGenFramebuffers(1, &visible_count_framebuffer_);
+  glBindFramebuffer(GL_FRAMEBUFFER, visible_count_framebuffer_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, visible_count_texture_id_, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0u);
+
+  //depth keys of the visible particles, drawn to count them.
+  glGenVertexArrays(1u, &vao_k_);
+  glBindVertexArray(vao_k_);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo_); {
+    GLint const dp_attrib = glGetAttribLocation(pgm_.visible_count, "dp");
+    glVertexAttribPointer(dp_attrib, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat), nullptr);
+    glEnableVertexAttribArray(dp_attrib);
+  }
+  glBindVertexArray(0u);
+  glBindBuffer(GL_ARRAY_BUFFER, 0u);
+
+  CHECKGLERROR();
+}
 
-    glGenVertexArrays(2, vao_c_);
-    glBindVertexArray(vao_c_[0]);
+void GPUParticle::_setup_grid() {
+  static_assert(kGridPartitionCount == GRID_PARTITION_COUNT, "grid partition count mismatch");
+  static_assert(GRID_CELL_COUNT == GRID_TABLE_WIDTH * GRID_TABLE_WIDTH, "grid tables are square");
+  static_assert(GRID_CELL_COUNT % (kGridScanGroupWidth * kGridScanGroupWidth) == 0u,
+                "grid tables levels group whole values");
+  static_assert(GRID_CELL_COUNT / (kGridScanGroupWidth * kGridScanGroupWidth) <= GRID_TABLE_WIDTH,
+                "the last level of the grid tables is scanned as a single group");
+
+  //particle indices sorted by cell, scattered by either backend.
+  glGenBuffers(1u, &grid_indices_buffer_);
+  glBindBuffer(GL_ARRAY_BUFFER, grid_indices_buffer_);
+  glBufferData(GL_ARRAY_BUFFER, kMaxParticleCount * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+  glBindBuffer(GL_ARRAY_BUFFER, 0u);
+
+  if (backend_ == kBackendCompute) {
+    //the cells lists are held by the compute backend.
+    CHECKGLERROR();
+    return;
+  }
 
-    GLuint vboB = pbuffer_->second_array_buffer_id();
+  //buffer texture, attached to the buffer read when simulating.
+  glGenTextures(1, &particles_texture_id_);
 
-    glBindBuffer(GL_ARRAY_BUFFER, vboB); {
-      glVertexAttribPointer(alocation_.calculate_dp.position, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), nullptr);
-      glEnableVertexAttribArray(alocation_.calculate_dp.position);
+  //the simulation reads the grid from units 1 to kGridSamplerCount, and the particles next.
+  glProgramUniform1i(pgm_.simulation,
+                     GetUniformLocation(pgm_.simulation, "uParticlesSampler"),
+                     1 + kGridSamplerCount);
+
+  //cells tables, each level of the scan grouping kGridScanGroupWidth values
+  //of the finer one. The cells ranges hold their first slot and their end.
+  glGenTextures(kGridScanLevelCount, grid_sums_texture_ids_);
+  glGenTextures(kGridScanLevelCount, grid_starts_texture_ids_);
+  unsigned int count = GRID_CELL_COUNT;
+  for (unsigned int level = 0u; level < kGridScanLevelCount; ++level) {
+    GLsizei const width = std::min(count, static_cast<unsigned int>(GRID_TABLE_WIDTH));
+    GLsizei const height = count / width;
+    GLuint const textures[2] = { grid_sums_texture_ids_[level], grid_starts_texture_ids_[level] };
+    for (unsigned int i = 0u; i < 2u; ++i) {
+      bool const ranges = (i == 1u) && (level == 0u);
+      glBindTexture(GL_TEXTURE_2D, textures[i]);
+      glTexImage2D(GL_TEXTURE_2D, 0, (ranges) ? GL_RG32F : GL_R32F, width, height, 0,
+                   (ranges) ? GL_RG : GL_RED, GL_FLOAT, nullptr);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    count /= kGridScanGroupWidth;
+  }
+  glBindTexture(GL_TEXTURE_2D, 0u);
+
+  glGenFramebuffers(1, &grid_framebuffer_);
+
+  glGenTextures(1, &grid_indices_texture_id_);
+  glBindTexture(GL_TEXTURE_BUFFER, grid_indices_texture_id_);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, grid_indices_buffer_);
+  glBindTexture(GL_TEXTURE_BUFFER, 0u);
+
+  glProgramUniform1i(pgm_.simulation, GetUniformLocation(pgm_.simulation, "uGridRangesSampler"), 1);
+  glProgramUniform1i(pgm_.simulation, GetUniformLocation(pgm_.simulation, "uGridIndicesSampler"), 2);
+  glProgramUniform1i(pgm_.grid_reduce, GetUniformLocation(pgm_.grid_reduce, "uValues"), 0);
+  glProgramUniform1i(pgm_.grid_scan, GetUniformLocation(pgm_.grid_scan, "uValues"), 0);
+  glProgramUniform1i(pgm_.grid_scan, GetUniformLocation(pgm_.grid_scan, "uGroupStarts"), 1);
+
+  //keys partitioned by cell, a buffer per stream, ping-ponging between two
+  //feedbacks drawn again from their counts.
+  glGenTransformFeedbacks(2, grid_feedbacks_);
+  glGenBuffers(2u * kGridPartitionCount, grid_keys_buffers_[0]);
+  glGenVertexArrays(2u * kGridPartitionCount, vao_gk_[0]);
+  GLint const key_attrib = glGetAttribLocation(pgm_.grid_scatter, "key");
+  for (unsigned int i = 0u; i < 2u; ++i) {
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, grid_feedbacks_[i]);
+    for (unsigned int stream = 0u; stream < kGridPartitionCount; ++stream) {
+      GLuint const buffer = grid_keys_buffers_[i][stream];
+      glBindBuffer(GL_ARRAY_BUFFER, buffer);
+      glBufferData(GL_ARRAY_BUFFER, kMaxParticleCount * 2u * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+      glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, stream, buffer);
+
+      glBindVertexArray(vao_gk_[i][stream]);
+      glVertexAttribIPointer(key_attrib, 2, GL_UNSIGNED_INT, 2u * sizeof(GLuint), nullptr);
+      glEnableVertexAttribArray(key_attrib);
     }
-    glBindBuffer(GL_ARRAY_BUFFER, 0u);
+  }
+  glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0u);
 
-    glBindVertexArray(vao_c_[1]);
-    vboB = pbuffer_->first_array_buffer_id();
+  //position only VAOs, one per buffer of the ring.
+  glGenVertexArrays(AppendConsumeBuffer::kNumBuffers, vao_g_);
 
-    glBindBuffer(GL_ARRAY_BUFFER, vboB); {
-      glVertexAttribPointer(alocation_.calculate_dp.position, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), nullptr);
-      glEnableVertexAttribArray(alocation_.calculate_dp.position);
+  for (unsigned int i = 0u; i < AppendConsumeBuffer::kNumBuffers; ++i) {
+    glBindVertexArray(vao_g_[i]);
+    glBindBuffer(GL_ARRAY_BUFFER, pbuffer_->array_buffer_id(i)); {
+      glVertexAttribPointer(alocation_.grid_count.position, 3, GL_FLOAT, GL_FALSE, kParticleStride, nullptr);
+      glEnableVertexAttribArray(alocation_.grid_count.position);
+
+      glVertexAttribPointer(alocation_.grid_count.age, 2, GL_FLOAT, GL_FALSE, kParticleStride, (void*)(6 * sizeof(GLfloat)));
+      glEnableVertexAttribArray(alocation_.grid_count.age);
     }
-    glBindBuffer(GL_ARRAY_BUFFER, 0u);
   }
-  glUseProgram(0u);
-  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0u);
+  glBindVertexArray(0u);
+
+  CHECKGLERROR();
+}
+
+void GPUParticle::_setup_stable_slots() {
+  //dead slots, written by transform feedback and read as a buffer texture.
+  glGenBuffers(1u, &dead_slots_buffer_);
+  glBindBuffer(GL_ARRAY_BUFFER, dead_slots_buffer_);
+  glBufferData(GL_ARRAY_BUFFER, kMaxParticleCount * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+  glBindBuffer(GL_ARRAY_BUFFER, 0u);
+
+  glGenTextures(1, &dead_slots_texture_id_);
+  glBindTexture(GL_TEXTURE_BUFFER, dead_slots_texture_id_);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, dead_slots_buffer_);
+  glBindTexture(GL_TEXTURE_BUFFER, 0u);
+
+  //emission map, one texel per slot.
+  glGenTextures(1, &emit_map_texture_id_);
+  glBindTexture(GL_TEXTURE_2D, emit_map_texture_id_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, texture_width_1, texture_height_1, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0u);
+
+  glGenFramebuffers(1, &emit_map_framebuffer_);
+  glBindFramebuffer(GL_FRAMEBUFFER, emit_map_framebuffer_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, emit_map_texture_id_, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0u);
+
+  //slots listed by the last steps, counted without waiting for them.
+  glGenQueries(kDeadListQueryCount, dead_list_queries_);
+
+  glProgramUniform1i(pgm_.emit_map, GetUniformLocation(pgm_.emit_map, "uDeadSlotsSampler"), 0);
+  glProgramUniform1i(pgm_.simulation,
+                     glGetUniformLocation(pgm_.simulation, "uEmitMapSampler"),
+                     3 + kGridSamplerCount);
+
+  CHECKGLERROR();
+}
+
+void GPUParticle::_setup_incremental_sort() {
+  //storage index of the particles, written by transform feedback.
+  GLuint *buffers[3u] = {&culled_ids_buffer_, &hidden_ids_buffer_, &sort_order_buffer_};
+  for (GLuint *buffer : buffers) {
+    glGenBuffers(1u, buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, *buffer);
+    glBufferData(GL_ARRAY_BUFFER, kMaxParticleCount * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0u);
+
+  //storage index of the culled particles, read through the sorted indices.
+  glGenVertexArrays(1u, &vao_o_);
+  glBindVertexArray(vao_o_);
+  glBindBuffer(GL_ARRAY_BUFFER, culled_ids_buffer_); {
+    GLint const id_attrib = glGetAttribLocation(pgm_.gather_ids, "id");
+    glVertexAttribIPointer(id_attrib, 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
+    glEnableVertexAttribArray(id_attrib);
+  }
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sorted_indices_);
+
+  //storage index of the culled out particles, appended after them.
+  glGenVertexArrays(1u, &vao_h_);
+  glBindVertexArray(vao_h_);
+  glBindBuffer(GL_ARRAY_BUFFER, hidden_ids_buffer_); {
+    GLint const id_attrib = glGetAttribLocation(pgm_.gather_ids, "id");
+    glVertexAttribIPointer(id_attrib, 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
+    glEnableVertexAttribArray(id_attrib);
+  }
+  glBindVertexArray(0u);
+  glBindBuffer(GL_ARRAY_BUFFER, 0u);
+
+  //indices of the carried order, copied as sorted when a sort is skipped.
+  std::vector<GLushort> indices(kMaxParticleCount);
+  for (unsigned int i = 0u; i < kMaxParticleCount; ++i) {
+    indices[i] = static_cast<GLushort>(i);
+  }
+  glGenBuffers(1u, &identity_indices_);
+  glBindBuffer(GL_COPY_READ_BUFFER, identity_indices_);
+  glBufferData(GL_COPY_READ_BUFFER, kMaxParticleCount * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0u);
+
+  glGenQueries(1, &inversions_query_);
+  glGenQueries(1, &disorder_query_);
+  glGenQueries(2, budget_queries_);
+
+  CHECKGLERROR();
+}
+
+void GPUParticle::_setup_weighted_oit() {
+  //accumulation and revealage targets, allocated to the viewport when drawn.
+  glGenTextures(2, oit_texture_ids_);
+  for (GLuint texture : oit_texture_ids_) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0u);
+  glGenFramebuffers(1, &oit_framebuffer_);
+
+  glProgramUniform1i(pgm_.oit_composite, GetUniformLocation(pgm_.oit_composite, "uAccumulation"), 0);
+  glProgramUniform1i(pgm_.oit_composite, GetUniformLocation(pgm_.oit_composite, "uRevealage"), 1);
 
   CHECKGLERROR();
 }
@@ -399,13 +1248,12 @@ void GPUParticle::_setup_fill_indices() {
   glBindVertexArray(vao_f_);
 
     GLfloat vertices[] = {
-        -1.0f, -1.0f, 0.0f, 0.0f,
-         1.0f, -1.0f, 1.0f  , 0.0f,
-         1.0f, 1.0f, 1.0f, 1.0f,
-         -1.0f, 1.0f, 0.0f, 1.0f
+        -1.0f, -1.0f,
+         1.0f, -1.0f,
+         1.0f, 1.0f,
+         -1.0f, 1.0f
     };
 
-    ;
     glGenBuffers(1, &vbo_f_);
     glUseProgram(pgm_.fill_indices);
     {
@@ -413,10 +1261,7 @@ void GPUParticle::_setup_fill_indices() {
       glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
       GLint posAttrib = glGetAttribLocation(pgm_.fill_indices, "position");
       glEnableVertexAttribArray(posAttrib);
-      glVertexAttribPointer(posAttrib, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), 0);
-      GLint texAttrib = glGetAttribLocation(pgm_.fill_indices, "texcoord");
-      glEnableVertexAttribArray(texAttrib);
-      glVertexAttribPointer(texAttrib, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)(2 * sizeof(GLfloat)));
+      glVertexAttribPointer(posAttrib, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), 0);
 
   CHECKGLERROR();
     }
@@ -425,137 +1270,399 @@ void GPUParticle::_setup_fill_indices() {
 }
 
 void GPUParticle::_setup_simulation() {
-  glGenVertexArrays(2u, vao_s_);
-
-  glBindVertexArray(vao_s_[0]);
-  GLuint vbo1 = pbuffer_->first_array_buffer_id();
+  //one per buffer of the ring.
+  glGenVertexArrays(AppendConsumeBuffer::kNumBuffers, vao_s_);
 
-  glBindBuffer(GL_ARRAY_BUFFER, vbo1); {
-    glVertexAttribPointer(alocation_.simulation.position, 3, GL_FLOAT, GL_FALSE,8 * sizeof(GLfloat) , nullptr);
-    glEnableVertexAttribArray(alocation_.simulation.position);
+  for (unsigned int i = 0u; i < AppendConsumeBuffer::kNumBuffers; ++i) {
+    glBindVertexArray(vao_s_[i]);
+    glBindBuffer(GL_ARRAY_BUFFER, pbuffer_->array_buffer_id(i)); {
+      glVertexAttribPointer(alocation_.simulation.position, 3, GL_FLOAT, GL_FALSE, kParticleStride, nullptr);
+      glEnableVertexAttribArray(alocation_.simulation.position);
 
-    glVertexAttribPointer(alocation_.simulation.velocity, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),(void*)(3 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(alocation_.simulation.velocity);
+      glVertexAttribPointer(alocation_.simulation.velocity, 3, GL_FLOAT, GL_FALSE, kParticleStride, (void*)(3 * sizeof(GLfloat)));
+      glEnableVertexAttribArray(alocation_.simulation.velocity);
 
-    glVertexAttribPointer(alocation_.simulation.age, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (void*)(6 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(alocation_.simulation.age);
-  }
-
-  glBindVertexArray(vao_s_[1]);
-  GLuint vbo2 = pbuffer_->second_array_buffer_id();
+      glVertexAttribPointer(alocation_.simulation.age, 2, GL_FLOAT, GL_FALSE, kParticleStride, (void*)(6 * sizeof(GLfloat)));
+      glEnableVertexAttribArray(alocation_.simulation.age);
 
-  glBindBuffer(GL_ARRAY_BUFFER, vbo2); {
-    glVertexAttribPointer(alocation_.simulation.position, 3, GL_FLOAT, GL_FALSE,8 * sizeof(GLfloat) , nullptr);
-    glEnableVertexAttribArray(alocation_.simulation.position);
+      glVertexAttribIPointer(alocation_.simulation.anchor, 1, GL_UNSIGNED_INT, kParticleStride, (void*)(8 * sizeof(GLfloat)));
+      glEnableVertexAttribArray(alocation_.simulation.anchor);
 
-    glVertexAttribPointer(alocation_.simulation.velocity, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),(void*)(3 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(alocation_.simulation.velocity);
-
-    glVertexAttribPointer(alocation_.simulation.age, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (void*)(6 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(alocation_.simulation.age);
+      glVertexAttribPointer(alocation_.simulation.curl, 3, GL_FLOAT, GL_FALSE, kParticleStride, (void*)(9 * sizeof(GLfloat)));
+      glEnableVertexAttribArray(alocation_.simulation.curl);
+    }
   }
-
-  // #if ENABLE_SCATTERING
-  /*randbuffer_.bind();{
-    std::cout << "randvector: " << alocation_.simulation.randvector << '\n';
-    glVertexAttribPointer(alocation_.simulation.randvector, 3, GL_FLOAT, GL_FALSE,0 , nullptr);
-    glEnableVertexAttribArray(alocation_.simulation.randvector);
-  }*/
-  //randbuffer_.unbind();
+  glBindBuffer(GL_ARRAY_BUFFER, 0u);
   glBindVertexArray(0u);
 
   CHECKGLERROR();
 }
 
 void GPUParticle::_setup_render() {
+  //draw arguments of the visible particles.
+  TDrawElementsArgs const render_args = {0u, 1u, 0u, 0u, 0u};
+  glGenBuffers(1u, &render_args_buffer_);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, render_args_buffer_);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(TDrawElementsArgs), &render_args, GL_DYNAMIC_COPY);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0u);
 
   glGenBuffers(1u, &sorted_indices_);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sorted_indices_);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, FloorParticleCount(kMaxParticleCount) * sizeof(GLushort), nullptr, GL_DYNAMIC_DRAW);
 
-  glGenVertexArrays(2u, vao_);
-
-  glBindVertexArray(vao_[0]);
-
-  GLuint const vboA = pbuffer_->first_array_buffer_id();
-
-  glBindBuffer(GL_ARRAY_BUFFER, vboA); {
-    glVertexAttribPointer(alocation_.render_stretched_sprite.position, 3, GL_FLOAT, GL_FALSE,8 * sizeof(GLfloat) , nullptr);
-    glEnableVertexAttribArray(alocation_.render_stretched_sprite.position);
-
-    glVertexAttribPointer(alocation_.render_stretched_sprite.velocity, 3, GL_FLOAT, GL_FALSE,8 * sizeof(GLfloat),(void*)(3 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(alocation_.render_stretched_sprite.velocity);
-
-    glVertexAttribPointer(alocation_.render_stretched_sprite.age, 2, GL_FLOAT, GL_FALSE,8 * sizeof(GLfloat),(void*)(6 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(alocation_.render_stretched_sprite.age);
-  }
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sorted_indices_);
-
-  glBindVertexArray(vao_[1]);
+  //visible particles, written by the culling pass.
+  glGenBuffers(1u, &culled_vbo_);
+  glBindBuffer(GL_ARRAY_BUFFER, culled_vbo_);
+  glBufferData(GL_ARRAY_BUFFER, FloorParticleCount(kMaxParticleCount) * kCulledStride, nullptr, GL_DYNAMIC_COPY);
 
-  GLuint const vboB = pbuffer_->second_array_buffer_id();
+  glGenVertexArrays(1u, &vao_);
+  glBindVertexArray(vao_);
 
-  glBindBuffer(GL_ARRAY_BUFFER, vboB); {
-    glVertexAttribPointer(alocation_.render_stretched_sprite.position, 3, GL_FLOAT, GL_FALSE,8 * sizeof(GLfloat) , nullptr);
+  glBindBuffer(GL_ARRAY_BUFFER, culled_vbo_); {
+    glVertexAttribPointer(alocation_.render_stretched_sprite.position, 3, GL_FLOAT, GL_FALSE, kCulledStride, nullptr);
     glEnableVertexAttribArray(alocation_.render_stretched_sprite.position);
 
-    glVertexAttribPointer(alocation_.render_stretched_sprite.velocity, 3, GL_FLOAT, GL_FALSE,8 * sizeof(GLfloat),(void*)(3 * sizeof(GLfloat)));
+    glVertexAttribPointer(alocation_.render_stretched_sprite.velocity, 3, GL_FLOAT, GL_FALSE, kCulledStride, (void*)(3 * sizeof(GLfloat)));
     glEnableVertexAttribArray(alocation_.render_stretched_sprite.velocity);
 
-    glVertexAttribPointer(alocation_.render_stretched_sprite.age, 2, GL_FLOAT, GL_FALSE,8 * sizeof(GLfloat),(void*)(6 * sizeof(GLfloat)));
+    glVertexAttribPointer(alocation_.render_stretched_sprite.age, 2, GL_FLOAT, GL_FALSE, kCulledStride, (void*)(6 * sizeof(GLfloat)));
     glEnableVertexAttribArray(alocation_.render_stretched_sprite.age);
   }
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sorted_indices_);
-  //glBindBuffer(GL_ARRAY_BUFFER, 0u);
 
   glBindVertexArray(0u);
+  glBindBuffer(GL_ARRAY_BUFFER, 0u);
 
   CHECKGLERROR();
 }
 
-void GPUParticle::_emission(const unsigned int count){
-  //emit only if a minimum count is reached.
-  if (!count || (count < kBatchEmitCount)) {
+void GPUParticle::_read_dead_slot_counts() {
+  //dead lists of the previous steps, the oldest first. Waits only when
+  //every query of the ring is in flight.
+  bool counted = false;
+  unsigned int alive_count = 0u;
+  while (dead_list_pending_ > 0u) {
+    GLuint const query = dead_list_queries_[dead_list_first_];
+    if (dead_list_pending_ < kDeadListQueryCount) {
+      GLuint available = GL_FALSE;
+      glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available) {
+        break;
+      }
+    }
+    GLuint listed = 0u;
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT, &listed);
+
+    //the slots from the high water mark on are dead, and listed after the
+    //ones below it : the newborns left without a dead slot below it follow
+    //on from it.
+    auto const &list = dead_lists_[dead_list_first_];
+    unsigned int const dead_count = listed - (list.range - list.slot_count);
+    unsigned int const high_water = std::min(slot_high_water_, list.slot_count);
+    unsigned int const dead_below = dead_count - (list.slot_count - high_water);
+    alive_count = list.slot_count - dead_count;
+    if (alive_count == 0u) {
+      slot_high_water_ = list.emit_count;
+    } else {
+      slot_high_water_ = high_water + ((list.emit_count > dead_below) ? list.emit_count - dead_below : 0u);
+    }
+    alive_count += list.emit_count;
+
+    dead_list_first_ = (dead_list_first_ + 1u) % kDeadListQueryCount;
+    --dead_list_pending_;
+    counted = true;
+  }
+  if (!counted) {
     return;
   }
-  GLuint vboA = pbuffer_->first_array_buffer_id();
 
-/*  glBindBuffer(GL_ARRAY_BUFFER, vboA);
-  GLfloat *data4 = (GLfloat*)glMapBuffer(GL_ARRAY_BUFFER, GL_READ_ONLY);
-  std::cout <<'\n' << "vboA before emission: " << '\n';
-  for (size_t i = 0; i < num_alive_particles_; i++) {
+  //bounds of the slots used and of the alive particles, assuming the
+  //newborns of the steps not counted yet take fresh slots.
+  unsigned int emitted = 0u;
+  for (unsigned int i = 0u; i < dead_list_pending_; ++i) {
+    emitted += dead_lists_[(dead_list_first_ + i) % kDeadListQueryCount].emit_count;
+  }
+  slot_count_ = std::min(slot_count_, slot_high_water_ + emitted);
+  num_alive_particles_ = alive_count + emitted;
+}
 
-    std::cout << "position :" ;
-    for (size_t j = 0; j < 3; j++) {
-      std::cout << data4[8u*i+j] << ' ';
-    }
-    std::cout  << '\t';
-    std::cout << "speed :" ;
-    for (size_t j = 0; j < 3; j++) {
-      std::cout << data4[8u*i+3+j] << ' ';
-    }
-    std::cout  << '\t';
-    std::cout << "age :" ;
-    for (size_t j = 0; j < 2; j++) {
-      std::cout << data4[8u*i+6+j] << ' ';
-    }
-    std::cout  << '\n';
+void GPUParticle::_build_dead_list(unsigned int const emit_count) {
+  //the slots used, then fresh ones for the newborns left without a dead slot.
+  fresh_slot_ = slot_count_;
+  unsigned int const range = std::min(slot_count_ + emit_count, pbuffer_->element_count());
+  if (range == 0u) {
+    return;
   }
-  glUnmapBuffer(GL_ARRAY_BUFFER);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);*/
 
-  glBindVertexArray(vao_e_[0]);
+  //counted by a later step, the ring is freed before.
+  unsigned int const index = (dead_list_first_ + dead_list_pending_) % kDeadListQueryCount;
+  GLuint const query = dead_list_queries_[index];
 
-  glUseProgram(pgm_.emission);
+  glBindVertexArray(vao_g_[pbuffer_->first_index()]);
+  glUseProgram(pgm_.dead_list);
+  {
+    glUniform1ui(ulocation_.dead_list.firstFreshSlot, fresh_slot_);
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, dead_slots_buffer_);
+    glBeginQuery(GL_PRIMITIVES_GENERATED, query);
+
+    glBeginTransformFeedback(GL_POINTS);
+      glDrawArrays(GL_POINTS, 0, range);
+    glEndTransformFeedback();
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    glEndQuery(GL_PRIMITIVES_GENERATED);
+  }
+  glUseProgram(0u);
+  glBindVertexArray(0u);
+
+  dead_lists_[index].slot_count = slot_count_;
+  dead_lists_[index].range = range;
+  dead_lists_[index].emit_count = emit_count;
+  ++dead_list_pending_;
+
+  //every newborn finds a slot in the list : the emission keeps the alive
+  //particles, bounded from above, within the buffer.
+  slot_count_ = range;
+
+  CHECKGLERROR();
+}
+
+void GPUParticle::_build_emit_map(unsigned int const count) {
+  GLuint const clear_value[] = {0u, 0u, 0u, 0u};
+
+  glBindFramebuffer(GL_FRAMEBUFFER, emit_map_framebuffer_);
+  glClearBufferuiv(GL_COLOR, 0, clear_value);
+
+  if (count > 0u) {
+    glViewport(0, 0, texture_width_1, texture_height_1);
+
+    glBindVertexArray(vao_e_[0]);
+    glUseProgram(pgm_.emit_map);
+    {
+      glUniform2i(ulocation_.emit_map.emitMapSize, texture_width_1, texture_height_1);
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_BUFFER, dead_slots_texture_id_);
+
+      glDrawArrays(GL_POINTS, 0, count);
+
+      glBindTexture(GL_TEXTURE_BUFFER, 0u);
+    }
+    glUseProgram(0u);
+    glBindVertexArray(0u);
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0u);
+
+  CHECKGLERROR();
+}
+
+void GPUParticle::_build_grid() {
+  if (!enable_interactions_ || (num_stored_particles() == 0u)) {
+    return;
+  }
+
+  if (backend_ == kBackendCompute) {
+    compute_backend_.build_grid(pbuffer_->first_array_buffer_id(), grid_indices_buffer_,
+                                num_stored_particles(), simulation_box_size_);
+    return;
+  }
+
+  unsigned int const count = num_stored_particles();
+  GLfloat const clear_value[] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+/* 1) Count the alive particles of each cell, blended in its texel. */
+  glBindFramebuffer(GL_FRAMEBUFFER, grid_framebuffer_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, grid_sums_texture_ids_[0], 0);
+  glClearBufferfv(GL_COLOR, 0, clear_value);
+  glViewport(0, 0, GRID_TABLE_WIDTH, GRID_CELL_COUNT / GRID_TABLE_WIDTH);
+  glEnable(GL_BLEND);
+  glBlendEquation(GL_FUNC_ADD);
+  glBlendFunc(GL_ONE, GL_ONE);
+
+  glBindVertexArray(vao_g_[pbuffer_->first_index()]);
+  glUseProgram(pgm_.grid_count);
+  {
+    glUniform1f(ulocation_.grid_count.bboxSize, simulation_box_size_);
+    glDrawArrays(GL_POINTS, 0, count);
+  }
+  glDisable(GL_BLEND);
+
+/* 2) Sum the counts by groups of kGridScanGroupWidth, level after level. */
+  unsigned int level_counts[kGridScanLevelCount];
+  level_counts[0] = GRID_CELL_COUNT;
+  for (unsigned int level = 1u; level < kGridScanLevelCount; ++level) {
+    level_counts[level] = level_counts[level - 1u] / kGridScanGroupWidth;
+  }
+
+  glBindVertexArray(vao_f_);
+  glActiveTexture(GL_TEXTURE0);
+  glUseProgram(pgm_.grid_reduce);
+  glUniform1ui(ulocation_.grid_reduce.groupWidth, kGridScanGroupWidth);
+  for (unsigned int level = 1u; level < kGridScanLevelCount; ++level) {
+    GLuint const width = std::min(level_counts[level], static_cast<unsigned int>(GRID_TABLE_WIDTH));
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, grid_sums_texture_ids_[level], 0);
+    glViewport(0, 0, width, level_counts[level] / width);
+    glUniform1ui(ulocation_.grid_reduce.width, width);
+    glBindTexture(GL_TEXTURE_2D, grid_sums_texture_ids_[level - 1u]);
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+  }
+
+/* 3) First slot of each value, down from the last level scanned as a single
+ *    group : the range of each cell at the first level. */
+  glUseProgram(pgm_.grid_scan);
+  for (unsigned int level = kGridScanLevelCount; level-- > 0u;) {
+    bool const top_level = (level + 1u == kGridScanLevelCount);
+    GLuint const width = std::min(level_counts[level], static_cast<unsigned int>(GRID_TABLE_WIDTH));
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, grid_starts_texture_ids_[level], 0);
+    glViewport(0, 0, width, level_counts[level] / width);
+    glUniform1ui(ulocation_.grid_scan.width, width);
+    glUniform1ui(ulocation_.grid_scan.groupWidth, (top_level) ? level_counts[level] : kGridScanGroupWidth);
+    glUniform1i(ulocation_.grid_scan.topLevel, (top_level) ? GL_TRUE : GL_FALSE);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, (top_level) ? 0u : grid_starts_texture_ids_[level + 1u]);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, grid_sums_texture_ids_[level]);
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+  }
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, 0u);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, 0u);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0u);
+
+/* 4) Scatter the particle indices by cell. Without atomics to rank them in
+ *    their cell, the keys are radix sorted on the cell ids, least significant
+ *    digit first : each pass writes the keys of a digit to its own stream,
+ *    the next one drawing the streams in turn. The dead particles are left
+ *    out, each cell list then starting at its scanned first slot. */
+  unsigned int const cell_bits = GetNumTrailingBits(GRID_CELL_COUNT);
+  unsigned int binding = 0u;
+  glEnable(GL_RASTERIZER_DISCARD);
+
+  glBindVertexArray(vao_g_[pbuffer_->first_index()]);
+  glUseProgram(pgm_.grid_keys);
+  {
+    glUniform1f(ulocation_.grid_keys.bboxSize, simulation_box_size_);
+    glUniform1ui(ulocation_.grid_keys.shift, 0u);
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, grid_feedbacks_[binding]);
+    glBeginTransformFeedback(GL_POINTS);
+      glDrawArrays(GL_POINTS, 0, count);
+    glEndTransformFeedback();
+  }
+
+  glUseProgram(pgm_.grid_scatter);
+  for (unsigned int shift = GRID_PARTITION_BITS; shift < cell_bits; shift += GRID_PARTITION_BITS) {
+    glUniform1ui(ulocation_.grid_scatter.shift, shift);
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, grid_feedbacks_[binding ^ 1u]);
+    glBeginTransformFeedback(GL_POINTS);
+    for (unsigned int stream = 0u; stream < kGridPartitionCount; ++stream) {
+      glBindVertexArray(vao_gk_[binding][stream]);
+      glDrawTransformFeedbackStream(GL_POINTS, grid_feedbacks_[binding], stream);
+    }
+    glEndTransformFeedback();
+    binding ^= 1u;
+  }
+  glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0u);
+
+/* 5) List their indices, the streams of the last digit drawn in turn. */
+  glUseProgram(pgm_.grid_gather);
+  {
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, grid_indices_buffer_);
+    glBeginTransformFeedback(GL_POINTS);
+    for (unsigned int stream = 0u; stream < kGridPartitionCount; ++stream) {
+      glBindVertexArray(vao_gk_[binding][stream]);
+      glDrawTransformFeedbackStream(GL_POINTS, grid_feedbacks_[binding], stream);
+    }
+    glEndTransformFeedback();
+  }
+  glDisable(GL_RASTERIZER_DISCARD);
+  glUseProgram(0u);
+  glBindVertexArray(0u);
+
+  CHECKGLERROR();
+}
+
+unsigned int GPUParticle::_update_emitters(float const dt) {
+  //max number of particles able to be spawned.
+  unsigned int const num_dead_particles = pbuffer_->element_count() - num_alive_particles_;
+  unsigned int const nemitters = num_emitters();
+
+  //accumulate the fractional emission of each emitter.
+  unsigned int counts[kMaxEmitterCount];
+  unsigned int total_count = 0u;
+  for (unsigned int i = 0u; i < nemitters; ++i) {
+    float &accumulator = emission_accumulators_[i];
+    accumulator += emitters_[i].rate * dt;
+    counts[i] = static_cast<unsigned int>(accumulator);
+    accumulator -= counts[i];
+    total_count += counts[i];
+  }
+
+  //share the free slots proportionally when there is not enough of them.
+  //the excess is dropped rather than delayed, to avoid bursts once slots free up.
+  if (total_count > num_dead_particles) {
+    float const ratio = num_dead_particles / static_cast<float>(total_count);
+    for (unsigned int i = 0u; i < nemitters; ++i) {
+      counts[i] = static_cast<unsigned int>(ratio * counts[i]);
+    }
+  }
+
+  //pack the emitters of this batch, ordered by their first particle.
+  TEmitterData data[kMaxEmitterCount];
+  unsigned int num_batch_emitters = 0u;
+  unsigned int count = 0u;
+  for (unsigned int i = 0u; i < nemitters; ++i) {
+    if (counts[i] == 0u) {
+      continue;
+    }
+    Emitter const &emitter = emitters_[i];
+    TEmitterData &d = data[num_batch_emitters++];
+    mat4x4_dup(d.transform, emitter.transform);
+    vec4_set(d.velocity, emitter.velocity[0u], emitter.velocity[1u], emitter.velocity[2u], 0.0f);
+    vec4_set(d.params, static_cast<float>(emitter.shape), emitter.min_age, emitter.max_age, 0.0f);
+    d.batch[0u] = count;
+    d.batch[1u] = counts[i];
+    d.batch[2u] = d.batch[3u] = 0u;
+    count += counts[i];
+  }
+
+  num_batch_emitters_ = num_batch_emitters;
+  if (count == 0u) {
+    return 0u;
+  }
+
+  //orphan the previous batch, still possibly read by the GPU.
+  glBindBuffer(GL_UNIFORM_BUFFER, emitters_ubo_);
+    glBufferData(GL_UNIFORM_BUFFER, kMaxEmitterCount * sizeof(TEmitterData), nullptr, GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, num_batch_emitters * sizeof(TEmitterData), data);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0u);
+
+  CHECKGLERROR();
+
+  return count;
+}
+
+void GPUParticle::_emission(unsigned int const count) {
+  if (count == 0u) {
+    return;
+  }
+  GLuint vboA = pbuffer_->first_array_buffer_id();
+
+  glBindVertexArray(vao_e_[0]);
+
+  glUseProgram(pgm_.emission);
   {
 
     glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER,
                       0,
                       vboA,
-                      num_alive_particles_ * 8 * sizeof(GLfloat),
-                      count * 8 * sizeof(GLfloat));
-    glUniform1ui(ulocation_.emission.count, count);
-    glUniform1f(ulocation_.emission.particleMaxAge, params_.max_age);
+                      num_alive_particles_ * kParticleStride,
+                      count * kParticleStride);
+    glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORM_BINDING_EMITTERS, emitters_ubo_);
+    glUniform1ui(ulocation_.emission.numEmitters, num_batch_emitters_);
+    glUniform1ui(ulocation_.emission.emitFirst, num_alive_particles_);
+    glUniform1ui(ulocation_.emission.anchorCount, anchors_.anchor_count());
+    glUniform1ui(ulocation_.emission.frame, frame_index_);
 
     glEnable(GL_RASTERIZER_DISCARD);
     glBeginTransformFeedback(GL_POINTS);
@@ -596,18 +1703,29 @@ void GPUParticle::_emission(const unsigned int count){
   CHECKGLERROR();
 }
 
-void GPUParticle::_simulation(float const dt) {
-  if (num_alive_particles_ == 0u) {
+void GPUParticle::_simulation(float const dt, unsigned int const emit_count) {
+  //particles read, newborns included.
+  unsigned int const count = (stable_slots()) ? slot_count_ : num_alive_particles_ + emit_count;
+  if (count == 0u) {
     simulated_ = false;
     return;
   }
 
+  if (backend_ == kBackendCompute) {
+    //the dead slots are queued from the step enabling the in place update.
+    compute_backend_.update_args(emit_count, pbuffer_->element_count(), slots_in_place(), slots_reset_);
+    if (slots_in_place()) {
+      slots_reset_ = false;
+    }
+  }
+
   //simulation kernel.
   if (enable_vectorfield_) {
     glBindTexture(GL_TEXTURE_3D, vectorfield_.texture_id());
   }
 
-  GLuint vboB = pbuffer_->second_array_buffer_id();
+  //updated in place, or appended to the next buffer of the ring.
+  GLuint vboB = (slots_in_place()) ? pbuffer_->first_array_buffer_id() : pbuffer_->second_array_buffer_id();
 
   /*glBindBuffer(GL_ARRAY_BUFFER, pbuffer_->first_array_buffer_id());
   GLfloat *data4 = (GLfloat*)glMapBuffer(GL_ARRAY_BUFFER, GL_READ_ONLY);
@@ -637,7 +1755,7 @@ void GPUParticle::_simulation(float const dt) {
   GLuint particles_passed = 0u;
   GLuint particles_query = 0u;
 
-  glBindVertexArray(vao_s_[0]);
+  glBindVertexArray(vao_s_[pbuffer_->first_index()]);
   glUseProgram(pgm_.simulation);
   {
     glEnable(GL_RASTERIZER_DISCARD);
@@ -645,26 +1763,117 @@ void GPUParticle::_simulation(float const dt) {
     glUniform1f(ulocation_.simulation.deltaT, dt);
     glUniform1i(ulocation_.simulation.vectorFieldSampler, 0);
     glUniform1f(ulocation_.simulation.bboxSize, simulation_box_size_);
+    glUniform1ui(ulocation_.simulation.frame, frame_index_);
+    //vertices from num_alive_particles_ on are created from the batch.
+    glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORM_BINDING_EMITTERS, emitters_ubo_);
+    glUniform1ui(ulocation_.simulation.numEmitters, num_batch_emitters_);
+    glUniform1ui(ulocation_.simulation.emitFirst, (stable_slots()) ? fresh_slot_ : num_alive_particles_);
+    //or from the emission map, when the slots are stable, the fresh slots
+    //left empty being dead.
+    glUniform1i(ulocation_.simulation.stableSlots, (enable_stable_slots_) ? GL_TRUE : GL_FALSE);
+    glActiveTexture(GL_TEXTURE3 + kGridSamplerCount);
+    glBindTexture(GL_TEXTURE_2D, emit_map_texture_id_);
+
+    //neighbours of the particles read, from the grid built on them.
+    if (enable_interactions_) {
+      if (backend_ == kBackendCompute) {
+        compute_backend_.bind_grid(grid_indices_buffer_);
+      } else {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, grid_starts_texture_ids_[0]);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_BUFFER, grid_indices_texture_id_);
+        glActiveTexture(GL_TEXTURE1 + kGridSamplerCount);
+        glBindTexture(GL_TEXTURE_BUFFER, particles_texture_id_);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, pbuffer_->first_array_buffer_id());
+      }
+    }
+    float const cell_size = simulation_box_size_ / GRID_RESOLUTION;
+    float const radius = (enable_interactions_) ? std::min(interaction_radius_, cell_size) : 0.0f;
+    glUniform1f(ulocation_.simulation.interactionRadius, radius);
+    glUniform1f(ulocation_.simulation.repulsion, repulsion_);
+    glUniform1f(ulocation_.simulation.cohesion, cohesion_);
+
+    //target meshes.
+    glActiveTexture(GL_TEXTURE2 + kGridSamplerCount);
+    glBindTexture(GL_TEXTURE_BUFFER, anchors_.texture_id());
+    glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORM_BINDING_ANCHOR_MODELS, anchors_.models_buffer_id());
+    glUniform1ui(ulocation_.simulation.anchorCount, anchors_.anchor_count());
+    glUniform1f(ulocation_.simulation.targetAttraction, target_attraction_);
+
+    //levels of detail.
+    glUniformMatrix4fv(ulocation_.simulation.view, 1, GL_FALSE, (GLfloat *const)camera_.view);
+    glUniform4fv(ulocation_.simulation.frustumPlanes, 6, camera_.frustum_planes[0]);
+    glUniform1f(ulocation_.simulation.lodDistance, lod_distance_);
+    glUniform1ui(ulocation_.simulation.lodPeriod, lod_period_);
+    glUniform1ui(ulocation_.simulation.curlNoisePeriod, curl_noise_period_);
     glActiveTexture( GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_3D, vectorfield_.texture_id());
-    glGenQueries(1, &particles_query);
-    glBeginQuery(GL_PRIMITIVES_GENERATED, particles_query);
 
-    glBeginTransformFeedback(GL_POINTS);
-      glDrawArrays(GL_POINTS, 0, num_alive_particles_);
-    glEndTransformFeedback();
-    glDisable(GL_RASTERIZER_DISCARD);
+    if (backend_ == kBackendCompute) {
+      glDisable(GL_RASTERIZER_DISCARD);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_PARTICLES_FIRST, pbuffer_->first_array_buffer_id());
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_PARTICLES_SECOND, vboB);
+      compute_backend_.bind_simulation();
+      glUniform1ui(ulocation_.simulation.maxParticleCount, pbuffer_->element_count());
+
+      //the rank of the particles in the last sorted order follows them.
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_SORT_RANKS_FIRST,
+                       compute_sort_.ranks_buffer_id(pbuffer_->first_index()));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_SORT_RANKS_SECOND,
+                       compute_sort_.ranks_buffer_id(pbuffer_->second_index()));
+      glUniform1i(ulocation_.simulation.carryRanks, (incremental_sort()) ? GL_TRUE : GL_FALSE);
+
+      compute_backend_.dispatch();
+
+      //buffer B is next read as vertices, texels and storage, its count as
+      //draw arguments.
+      glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT |
+                      GL_SHADER_STORAGE_BARRIER_BIT | GL_ATOMIC_COUNTER_BARRIER_BIT |
+                      GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+      //no particle died, until the device count is read back.
+      particles_passed = std::min(count, pbuffer_->element_count());
+      emitted_since_readback_ += emit_count;
+    } else {
+      //stable slots are all written : no count to wait for.
+      bool const counted = !stable_slots();
+      if (counted) {
+        glGenQueries(1, &particles_query);
+        glBeginQuery(GL_PRIMITIVES_GENERATED, particles_query);
+      }
 
-    glEndQuery(GL_PRIMITIVES_GENERATED);
-    glGetQueryObjectuiv(particles_query, GL_QUERY_RESULT, &particles_passed);
-    glDeleteQueries(1, &particles_query);
-    //glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+      glBeginTransformFeedback(GL_POINTS);
+      if (sort_order_pending_ && incremental_sort()) {
+        //the alive particles in their last sorted order, then the newborns.
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sort_order_buffer_);
+          glDrawElements(GL_POINTS, sorted_alive_count_, GL_UNSIGNED_INT, nullptr);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0u);
+        if (count > sorted_alive_count_) {
+          glDrawArrays(GL_POINTS, sorted_alive_count_, count - sorted_alive_count_);
+        }
+        sort_order_carried_ = true;
+      } else {
+        glDrawArrays(GL_POINTS, 0, count);
+      }
+      glEndTransformFeedback();
+      glDisable(GL_RASTERIZER_DISCARD);
+      sort_order_pending_ = false;
+
+      if (counted) {
+        glEndQuery(GL_PRIMITIVES_GENERATED);
+        glGetQueryObjectuiv(particles_query, GL_QUERY_RESULT, &particles_passed);
+        glDeleteQueries(1, &particles_query);
+      }
+      //glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    }
   }
   glUseProgram(0u);
   glBindVertexArray(0);
 
   glBindTexture(GL_TEXTURE_3D, 0u);
-  num_alive_particles_ = particles_passed;
+  //stable slots are all written, the dead ones are counted by a later dead list.
+  num_alive_particles_ = (stable_slots()) ? num_alive_particles_ + emit_count : particles_passed;
   /*glBindBuffer(GL_ARRAY_BUFFER, pbuffer_->second_array_buffer_id());
   GLfloat *data5 = (GLfloat*)glMapBuffer(GL_ARRAY_BUFFER, GL_READ_ONLY);
   std::cout <<'\n' << "vboB after simulating: " << '\n';
@@ -695,197 +1904,746 @@ void GPUParticle::_simulation(float const dt) {
   CHECKGLERROR();
 }
 
-void GPUParticle::_sorting(mat4x4 const &view) {
+void GPUParticle::_culling() {
+  glBindVertexArray((backend_ == kBackendCompute) ? 0u : vao_c_[pbuffer_->second_index()]);
+  glUseProgram(pgm_.cull);
+  {
+    glUniformMatrix4fv(ulocation_.cull.view, 1, GL_FALSE, (GLfloat *const)camera_.view);
+    glUniform4fv(ulocation_.cull.frustumPlanes, 6, camera_.frustum_planes[0]);
+    glUniform1f(ulocation_.cull.cullMargin, cull_margin_);
+    glUniform1f(ulocation_.cull.timeStep, (enable_interpolation_) ? simulation_timestep_ : 0.0f);
+    glUniform1f(ulocation_.cull.maxDistance, cull_distance_);
+    glUniform1i(ulocation_.cull.enableCulling, (enable_culling_) ? GL_TRUE : GL_FALSE);
+
+    if (backend_ == kBackendCompute) {
+      //the depth keys are only read by the sorts.
+      glUniform1i(ulocation_.cull.storeDepthKeys, (sorting()) ? GL_TRUE : GL_FALSE);
+
+      //visible particles are appended to the draw count, over the simulation dispatch.
+      GLuint const zero = 0u;
+      glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, render_args_buffer_);
+      glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), &zero);
+      glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0u);
+
+      //the particles written by the simulation.
+      GLuint const particles = (slots_in_place()) ? pbuffer_->first_array_buffer_id()
+                                                  : pbuffer_->second_array_buffer_id();
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_PARTICLES_SECOND, particles);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_COUNTERS, compute_backend_.counters_buffer_id());
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_CULLED_PARTICLES, culled_vbo_);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_DOT_PRODUCTS, vbo_);
+      glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, ATOMIC_COUNTER_BINDING_COUNTERS, render_args_buffer_);
+
+      //storage index of the visible particles, the others losing their rank.
+      glUniform1i(ulocation_.cull.carryRanks, (incremental_sort()) ? GL_TRUE : GL_FALSE);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_CULLED_IDS, culled_ids_buffer_);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_SORT_RANKS_SECOND,
+                       compute_sort_.ranks_buffer_id(pbuffer_->second_index()));
+
+      compute_backend_.dispatch();
+
+      glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT |
+                      GL_ATOMIC_COUNTER_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    } else {
+      //counted by a later update, the ring is freed before.
+      _read_visible_counts();
+      unsigned int const index = (cull_query_first_ + cull_query_pending_) % kCullQueryCount;
+
+      //captured by its own feedback object, to be drawn again from its count.
+      glEnable(GL_RASTERIZER_DISCARD);
+      glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, cull_feedback_);
+      glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, vbo_);
+      glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, culled_vbo_);
+      glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 2, culled_ids_buffer_);
+      glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 3, hidden_ids_buffer_);
+      glBeginQuery(GL_PRIMITIVES_GENERATED, cull_queries_[index]);
+
+      glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, num_stored_particles());
+      glEndTransformFeedback();
+
+      glEndQuery(GL_PRIMITIVES_GENERATED);
+      glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0u);
+      glDisable(GL_RASTERIZER_DISCARD);
+      ++cull_query_pending_;
+      sorted_alive_count_ = num_stored_particles();
+    }
+  }
+  glUseProgram(0u);
+  glBindVertexArray(0u);
+
+  //no query buffer before OpenGL 4.4 : the draw count is written by a draw.
+  if (backend_ == kBackendTransformFeedback) {
+    _count_visible();
+  }
 
-  unsigned int const max_elem_count = GetClosestPowerOfTwo(num_alive_particles_);
-  GLuint ln_size = (GLuint)(std::log2(max_elem_count)/ 2);
-  GLuint texture_width_ = 1 << (GLuint) (ln_size);
-  GLuint texture_height_ = 1 << (GLuint)(std::log2(max_elem_count) - ln_size);
+  CHECKGLERROR();
+}
 
-  //framebuffer.
-  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
-  glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, indices_texture_ids_[0], 0);
-  GLuint clear_value1[] = {0, 0, 0, 0};
-  glClearBufferuiv(GL_COLOR, 0, clear_value1);
-  glViewport(0,0,texture_width_, texture_height_);
-/*
-glBindTexture(GL_TEXTURE_2D, indices_texture_ids_[0]);
-  GLushort *data1 = (GLushort*)malloc(kMaxParticleCount * sizeof(GL_UNSIGNED_SHORT));
-  glReadPixels(0.0f, 0.0f, texture_width_1, texture_height_1, GL_RED_INTEGER, GL_UNSIGNED_SHORT, data1);
-  std::cout <<'\n' << "filled indices: " << '\n';
-  for (size_t i = 0; i < kMaxParticleCount; i += 1) {
-    if (i % (texture_width_1) == 0)
-      std::cout  << '\n';
-    std::cout << data1[i] << " ";
+void GPUParticle::_read_visible_counts() {
+  //visible particles of the previous cullings, the oldest first. Waits only
+  //when every query of the ring is in flight.
+  while (cull_query_pending_ > 0u) {
+    GLuint const query = cull_queries_[cull_query_first_];
+    if (cull_query_pending_ < kCullQueryCount) {
+      GLuint available = GL_FALSE;
+      glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available) {
+        break;
+      }
+    }
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT, &num_visible_particles_);
+
+    cull_query_first_ = (cull_query_first_ + 1u) % kCullQueryCount;
+    --cull_query_pending_;
   }
-  std::cout <<  std::endl;
-  free(data1);*/
+}
 
-/*
-glBindTexture(GL_TEXTURE_2D, indices_texture_ids_[0]);
-GLushort *data = (GLushort*)malloc(kMaxParticleCount * sizeof(GL_UNSIGNED_SHORT));
-glReadPixels(0.0f, 0.0f, texture_width_1, texture_height_1, GL_RED_INTEGER, GL_UNSIGNED_SHORT, data);
-std::cout <<'\n' << "filled indices: " << '\n';
-for (size_t i = 0; i < kMaxParticleCount; i += 1) {
-  if (i % (texture_width_1) == 0)
-    std::cout  << '\n';
-  std::cout << data[i] << " ";
+void GPUParticle::_count_visible() {
+  //every visible particle covers the texel, in drawing order : the last one
+  //leaves their count, zero when none is.
+  GLuint const zero[4u] = {0u, 0u, 0u, 0u};
+  glBindFramebuffer(GL_FRAMEBUFFER, visible_count_framebuffer_);
+  glViewport(0, 0, 1, 1);
+  glClearBufferuiv(GL_COLOR, 0, zero);
+
+  //over the records of the stream drawn, some drivers count its vertices
+  //from the stride of the first vertex buffer.
+  //from the depth keys, first buffer of the visible particles stream.
+  glBindVertexArray(vao_k_);
+  glUseProgram(pgm_.visible_count);
+    glDrawTransformFeedbackStream(GL_POINTS, cull_feedback_, 0u);
+  glUseProgram(0u);
+  glBindVertexArray(0u);
+
+  //copied to the draw arguments on the device.
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, render_args_buffer_);
+    glReadPixels(0, 0, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0u);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  CHECKGLERROR();
 }
-std::cout <<  std::endl;
-free(data);*/
 
-/* 1) Intialize indices and dotproducts buffers. */
-// Fill first part of the indices buffer with continuous indices.
+void GPUParticle::_sorting() {
+  //sized from the culled particles upper bound, the visible count is only
+  //known on the device : the keys past it are packed as padding. A texel at
+  //least, for the last pass to write the sorted indices. The network spans
+  //a power of two of keys, only the rows of the culled ones are drawn : the
+  //padding after them is never moved.
+  unsigned int const count = sorted_alive_count_;
+  unsigned int const max_elem_count = std::max(4u, GetClosestPowerOfTwo(count));
+  GLuint texture_width_ = 0u;
+  GLuint texture_height_ = 0u;
+  GetSortTextureSize(count, &texture_width_, &texture_height_);
+
+  _read_sort_timing();
+  SortSchedule const schedule = _sorting_schedule(max_elem_count);
+  sort_full_ = (schedule == kScheduleFull);
+  sort_skipped_ = (schedule == kScheduleSkip);
+  sort_refine_rounds_ = 0u;
+  sort_pass_count_ = 0u;
+
+  glViewport(0,0,texture_width_, texture_height_);
   glBindVertexArray(vao_f_);
+
+  //particles out of place in the carried order, measured asynchronously
+  //before it is sorted.
+  if (enable_sort_skipping_ && incremental_sort() && sort_order_carried_ && !disorder_query_pending_) {
+    _count_inversions(disorder_query_, kSortDisorderDistance, true, texture_width_);
+    disorder_visible_count_ = num_visible_particles_;
+    disorder_query_pending_ = true;
+  }
+
+  if (sort_skipped_) {
+    glBindVertexArray(0u);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    _sorting_skip();
+    return;
+  }
+
+/* 1) Pack the depth keys of the visible particles with their index, in keys texture 0. */
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuf[1]);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, visible_count_texture_id_);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_BUFFER, dp_texture_id_);
   glUseProgram(pgm_.fill_indices);
   {
     glUniform1ui(ulocation_.fill_indices.width, texture_width_);
-    glUniform1ui(ulocation_.fill_indices.height, texture_height_);
+    glUniform1f(ulocation_.fill_indices.depthScale, camera_.depth_scale);
 
     glDrawArrays(GL_TRIANGLE_FAN,0, 4);
+  }
+  glBindTexture(GL_TEXTURE_BUFFER, 0u);
 
+  CHECKGLERROR();
+
+/* 2) Bitonic sort of the keys, the last pass writes their index to the sorted texture. */
+  glProgramUniform1ui(pgm_.sort_step, ulocation_.sort_step.width, texture_width_);
+  glProgramUniform1ui(pgm_.sort_stages, ulocation_.sort_stages.width, texture_width_);
+  glProgramUniform1ui(pgm_.sort_flip, ulocation_.sort_flip.width, texture_width_);
+  glProgramUniform1ui(pgm_.sort_step, ulocation_.sort_step.count, count);
+  glProgramUniform1ui(pgm_.sort_stages, ulocation_.sort_stages.count, count);
+  glProgramUniform1ui(pgm_.sort_flip, ulocation_.sort_flip.count, count);
+
+  //device time of the passes, one measure at a time.
+  bool const timed = (sort_time_budget_ > 0.0f) && !budget_query_pending_;
+  if (timed) {
+    glQueryCounter(budget_queries_[0], GL_TIMESTAMP);
+  }
+
+  unsigned int binding = 0u;
+  if (sort_full_) {
+    //merge sorted blocks of doubling width.
+    unsigned int const nsteps = GetNumTrailingBits(max_elem_count);
+    for (unsigned int step = 0u; step < nsteps; ++step) {
+      _sorting_stages(2u << step, true, step + 1u == nsteps, binding);
+    }
+    sort_inversion_count_ = 0u;
+    sort_deferred_count_ = 0u;
+    sort_disorder_ = 1.0f;
+  } else {
+    //the keys follow the previous order, newcomers last : sort blocks by
+    //decreasing keys, then merge them with their neighbours, alternately on
+    //each side from one round to the next. A particle moves by a few blocks
+    //at most per update.
+    static_assert(kSortRefineRounds > 0u, "the last refine pass writes the sorted indices");
+    static_assert(kSortRefineRounds <= kSortMaxRefineRounds, "the default refine rounds are bounded");
+    GLuint const refine_width = kSortRefineBlockWidth;
+    unsigned int const nsteps = GetNumTrailingBits(refine_width);
+    for (unsigned int step = 0u; step < nsteps; ++step) {
+      _sorting_stages(2u << step, true, false, binding);
+    }
+    sort_refine_rounds_ = _sorting_affordable_rounds();
+    for (unsigned int round = 0u; round < sort_refine_rounds_; ++round) {
+      glUseProgram(pgm_.sort_flip);
+      glUniform1ui(ulocation_.sort_flip.blockWidth, refine_width);
+      glUniform1ui(ulocation_.sort_flip.offset, (sort_refine_parity_ & 1u) ? refine_width : 0u);
+      glUniform1ui(ulocation_.sort_flip.size, max_elem_count);
+      _sorting_pass(false, binding);
+      ++sort_refine_parity_;
+
+      _sorting_stages(refine_width, false, round + 1u == sort_refine_rounds_, binding);
+    }
+  }
+  glUseProgram(0u);
+
+  if (timed) {
+    glQueryCounter(budget_queries_[1], GL_TIMESTAMP);
+    budget_query_passes_ = sort_pass_count_;
+    budget_query_pending_ = true;
+  }
+
+  //read from the sorted texture, bound by the last pass.
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, sorted_indices_);
+    glReadPixels(0, 0, texture_width_, texture_height_, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0u);
+
+  //inversions left by the refined order, measured asynchronously, one query
+  //at a time.
+  if (!sort_full_ && !inversions_query_pending_) {
+    _count_inversions(inversions_query_, kSortRefineBlockWidth, false, texture_width_);
+    inversions_visible_count_ = num_visible_particles_;
+    inversions_query_pending_ = true;
+  }
+  glBindVertexArray(0u);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+/*
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sorted_indices_);
+  GLushort *data7 = (GLushort*)glMapBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_READ_ONLY);
+  std::cout <<'\n' << "indices after sort in element array buffer: " << '\n';
+  for (size_t i = 0; i < max_elem_count; i++) {
+    std::cout << data7[i] << " ";
+  }
+  std::cout <<  std::endl;
+  glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);*/
+
+  //glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  //the next simulation writes the particles in that order.
+  mat4x4_dup(sorted_view_, camera_.view);
+  if (incremental_sort()) {
+    _gather_sort_order();
+  } else {
+    sort_order_carried_ = false;
   }
-  glUseProgram(0);
-  glBindVertexArray(0);
 
   CHECKGLERROR();
+}
 
-  //clear the dot product buffer.
-  GLfloat const clear_value[] = {-FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX} ;
+GPUParticle::SortSchedule GPUParticle::_sorting_schedule(unsigned int const max_elem_count) {
+  //inversions left by a previous refined order. The compute backend reads
+  //them back with its counts.
+  if (inversions_query_pending_ && (backend_ == kBackendTransformFeedback)) {
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(inversions_query_, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) {
+      glGetQueryObjectuiv(inversions_query_, GL_QUERY_RESULT, &sort_inversion_count_);
+      inversions_query_pending_ = false;
+    }
+  }
 
-  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer1_);
-  glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dp_texture_id_, 0);
-  glClearBufferfv(GL_COLOR, 0, clear_value);
+  //particles out of place in a previous carried order, read back with the
+  //counts too.
+  if (disorder_query_pending_ && (backend_ == kBackendTransformFeedback)) {
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(disorder_query_, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) {
+      GLuint count = 0u;
+      glGetQueryObjectuiv(disorder_query_, GL_QUERY_RESULT, &count);
+      sort_disorder_ = count / static_cast<float>(std::max(1u, disorder_visible_count_));
+      disorder_query_pending_ = false;
+    }
+  }
+
+  if (!incremental_sort() || !sort_order_carried_) {
+    return kScheduleFull;
+  }
+
+  if (_sorting_can_skip()) {
+    return kScheduleSkip;
+  }
+
+  //refining merges pairs of blocks.
+  if (max_elem_count <= 2u * kSortRefineBlockWidth) {
+    return kScheduleFull;
+  }
+
+  //camera jump since the last sort.
+  float cosine = 0.0f;
+  float distance = 0.0f;
+  GetViewDelta(camera_.view, sorted_view_, &cosine, &distance);
+  float const depth_range = 65535.0f / camera_.depth_scale;
+  if ((cosine < kSortJumpCosine) || (distance > kSortJumpDistance * depth_range)) {
+    return kScheduleFull;
+  }
+
+  //a refined order too far from sorted : the particles change faster than
+  //refining follows, retry after a few full sorts.
+  float const max_inversions = sort_inversion_threshold_ * inversions_visible_count_;
+  bool const diverged = (sort_inversion_count_ > kSortInversionCeiling * max_inversions);
+  if (sort_inversion_count_ > max_inversions) {
+    sort_inversion_count_ = 0u;
+    sort_full_backoff_ = kSortFullBackoff;
+  }
+  if (sort_full_backoff_ > 0u) {
+    --sort_full_backoff_;
+    //a full sort over the time budget is spread over the next updates, as
+    //more refine rounds of the carried order. The newcomers move by a few
+    //blocks per round : it is forced after a few updates, or when the order
+    //is far off.
+    bool const over_budget = (sort_time_budget_ > 0.0f) &&
+                             (sort_pass_time_ * _sorting_passes(max_elem_count) > sort_time_budget_);
+    if (over_budget && !diverged && (sort_deferred_count_ < kSortMaxDeferredSorts)) {
+      ++sort_deferred_count_;
+      return kScheduleRefine;
+    }
+    return kScheduleFull;
+  }
+  return kScheduleRefine;
+}
+
+bool GPUParticle::_sorting_can_skip() const {
+  if (!enable_sort_skipping_ || (sort_skip_count_ >= kSortMaxSkips)) {
+    return false;
+  }
+
+  //particles appended to the carried order : the newborns, and the ones
+  //coming into view.
+  unsigned int const incoming = (num_visible_particles_ > sorted_visible_count_) ?
+                                num_visible_particles_ - sorted_visible_count_ : 0u;
+  float const max_count = sort_skip_threshold_ * num_visible_particles_;
+  if ((emitted_since_sort_ + incoming > max_count) || (sort_disorder_ > sort_skip_threshold_)) {
+    return false;
+  }
+
+  //camera still since the last sort.
+  float cosine = 0.0f;
+  float distance = 0.0f;
+  GetViewDelta(camera_.view, sorted_view_, &cosine, &distance);
+  float const depth_range = 65535.0f / camera_.depth_scale;
+  return (cosine >= kSortSkipCosine) && (distance <= kSortSkipDistance * depth_range);
+}
+
+unsigned int GPUParticle::_sorting_stage_passes(unsigned int const nstages) const {
+  //a pass per stage on the compute backend.
+  if (backend_ == kBackendCompute) {
+    return nstages;
+  }
+  //a pass per stage between texels, the ones within them by passes of
+  //sort_stages_per_pass_.
+  unsigned int const texel_stages = std::min(nstages, 2u);
+  return (nstages - texel_stages) +
+         (texel_stages + sort_stages_per_pass_ - 1u) / sort_stages_per_pass_;
+}
+
+unsigned int GPUParticle::_sorting_passes(unsigned int const block_width) const {
+  //the stages of each step.
+  unsigned int passes = 0u;
+  unsigned int const nsteps = GetNumTrailingBits(block_width);
+  for (unsigned int step = 0u; step < nsteps; ++step) {
+    passes += _sorting_stage_passes(step + 1u);
+  }
+  return passes;
+}
+
+unsigned int GPUParticle::_sorting_refine_passes(unsigned int const rounds) const {
+  //blocks sort, then a flip and the stages of a block per round.
+  unsigned int const nstages = GetNumTrailingBits(kSortRefineBlockWidth);
+  unsigned int const round_passes = 1u + _sorting_stage_passes(nstages);
+  return _sorting_passes(kSortRefineBlockWidth) + rounds * round_passes;
+}
+
+unsigned int GPUParticle::_sorting_affordable_rounds() const {
+  if ((sort_time_budget_ <= 0.0f) || (sort_pass_time_ <= 0.0f)) {
+    return kSortRefineRounds;
+  }
+  //one round at least, for the last pass to write the sorted indices.
+  float const max_passes = sort_time_budget_ / sort_pass_time_;
+  unsigned int rounds = 1u;
+  while ((rounds < kSortMaxRefineRounds) && (_sorting_refine_passes(rounds + 1u) <= max_passes)) {
+    ++rounds;
+  }
+  return rounds;
+}
+
+void GPUParticle::_sorting_skip() {
+  //the culling wrote the visible particles in the carried order, their
+  //count bounded by the culled ones.
+  if (sorted_alive_count_ > 0u) {
+    glBindBuffer(GL_COPY_READ_BUFFER, identity_indices_);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, sorted_indices_);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                          0, 0, sorted_alive_count_ * sizeof(GLushort));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0u);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0u);
+  }
+  ++sort_skip_count_;
+
+  //the last sort camera is kept, the skips are bounded by its motion.
+  _gather_sort_order();
+
+  CHECKGLERROR();
+}
+
+void GPUParticle::_read_sort_timing() {
+  if (!budget_query_pending_) {
+    return;
+  }
+  GLuint available = GL_FALSE;
+  glGetQueryObjectuiv(budget_queries_[1], GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available) {
+    return;
+  }
+  GLuint64 start = 0u;
+  GLuint64 end = 0u;
+  glGetQueryObjectui64v(budget_queries_[0], GL_QUERY_RESULT, &start);
+  glGetQueryObjectui64v(budget_queries_[1], GL_QUERY_RESULT, &end);
+  budget_query_pending_ = false;
+
+  if (budget_query_passes_ > 0u) {
+    float const pass_time = static_cast<float>(end - start) * 1.0e-6f / budget_query_passes_;
+    sort_pass_time_ = (sort_pass_time_ > 0.0f) ?
+                      sort_pass_time_ + kSortPassTimeWeight * (pass_time - sort_pass_time_) : pass_time;
+  }
+}
+
+void GPUParticle::_sorting_stages(GLuint const block_width, bool const flip, bool const last, unsigned int &binding) {
+  //from the pair distance of the block width down to 1, the first one
+  //flipped when merging sorted halves of the blocks. A pass per stage
+  //between texels of four keys, then the stages of pair distances 2 and 1
+  //within them by passes of sort_stages_per_pass_.
+  unsigned int const nstages = GetNumTrailingBits(block_width);
+  unsigned int const texel_stages = std::min(nstages, 2u);
+
+  glUseProgram(pgm_.sort_step);
+  unsigned int stage = 0u;
+  for (; stage < nstages - texel_stages; ++stage) {
+    glUniform1ui(ulocation_.sort_step.blockWidth, block_width >> stage);
+    glUniform1i(ulocation_.sort_step.flip, (flip && (stage == 0u)) ? GL_TRUE : GL_FALSE);
+    _sorting_pass(false, binding);
+  }
 
-  //compute dot products of particles toward the camera.
-  glUseProgram(pgm_.calculate_dp);
+  glUseProgram(pgm_.sort_stages);
+  while (stage < nstages) {
+    GLuint const stage_count = std::min(sort_stages_per_pass_, nstages - stage);
+    bool const last_pass = last && (stage + stage_count == nstages);
+    glUniform1ui(ulocation_.sort_stages.blockWidth, block_width >> stage);
+    glUniform1ui(ulocation_.sort_stages.stageCount, stage_count);
+    glUniform1i(ulocation_.sort_stages.flip, (flip && (stage == 0u)) ? GL_TRUE : GL_FALSE);
+    glUniform1i(ulocation_.sort_stages.unpackIndices, (last_pass) ? GL_TRUE : GL_FALSE);
+    _sorting_pass(last_pass, binding);
+    stage += stage_count;
+  }
+}
+
+void GPUParticle::_sorting_pass(bool const last, unsigned int &binding) {
+  //ping-pong between the keys textures, the last pass writes the sorted one.
+  glBindFramebuffer(GL_FRAMEBUFFER, (last) ? framebuffer1_ : framebuf[binding]);
+  glBindTexture(GL_TEXTURE_2D, indices_texture_ids_[binding]);
+  binding ^= 1u;
+
+  glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+  ++sort_pass_count_;
+
+  CHECKGLERROR();
+}
+
+void GPUParticle::_count_inversions(GLuint const query, GLuint const distance, bool const carried,
+                                    unsigned int const width) {
+  //fragments of the particles nearer than the one a distance after them
+  //pass, nothing is written.
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuf[0]);
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, sorted_texture_id_);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_BUFFER, dp_texture_id_);
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, visible_count_texture_id_);
+
+  glUseProgram(pgm_.sort_inversions);
   {
+    glUniform1ui(ulocation_.sort_inversions.width, width);
+    glUniform1ui(ulocation_.sort_inversions.distance, distance);
+    glUniform1i(ulocation_.sort_inversions.carried, (carried) ? GL_TRUE : GL_FALSE);
+    glUniform1f(ulocation_.sort_inversions.depthScale, camera_.depth_scale);
+
+    //a pass per component of the texels, a fragment per particle.
+    glBeginQuery(GL_SAMPLES_PASSED, query);
+    for (GLuint component = 0u; component < 4u; ++component) {
+      glUniform1ui(ulocation_.sort_inversions.component, component);
+      glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    }
+    glEndQuery(GL_SAMPLES_PASSED);
+  }
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+  glBindTexture(GL_TEXTURE_2D, 0u);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_BUFFER, 0u);
+  glActiveTexture(GL_TEXTURE0);
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+  CHECKGLERROR();
+}
 
-    /// @note No kernel boundaries check performed.
-    glUniformMatrix4fv(ulocation_.calculate_dp.view, 1, GL_FALSE, (GLfloat *const)view);
+void GPUParticle::_gather_sort_order() {
+  //storage index of the visible particles in sorted order, followed by the
+  //culled out ones, both drawn from their count on the device.
+  glUseProgram(pgm_.gather_ids);
+  {
     glEnable(GL_RASTERIZER_DISCARD);
-    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, vbo_);
-    glBindVertexArray(vao_c_[0]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, sort_order_buffer_);
+
     glBeginTransformFeedback(GL_POINTS);
-      glDrawArrays(GL_POINTS, 0, max_elem_count);
+      glBindVertexArray(vao_o_);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, render_args_buffer_);
+        glDrawElementsIndirect(GL_POINTS, GL_UNSIGNED_SHORT, nullptr);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0u);
+      glBindVertexArray(vao_h_);
+      glDrawTransformFeedbackStream(GL_POINTS, cull_feedback_, 1u);
     glEndTransformFeedback();
     glDisable(GL_RASTERIZER_DISCARD);
+  }
+  glUseProgram(0u);
+  glBindVertexArray(0u);
+  sort_order_pending_ = true;
 
-    glBindTexture(GL_TEXTURE_2D, dp_texture_id_);
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, vbo_);
-      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texture_width_, texture_height_, GL_RED, GL_FLOAT, 0);
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-/*
-      glBindTexture(GL_TEXTURE_2D, dp_texture_id_);
-
-      GLfloat *data2 = (GLfloat*)malloc(kMaxParticleCount * sizeof(GL_FLOAT));
-      glReadPixels(0.0f, 0.0f, texture_width_1, texture_height_1, GL_RED, GL_FLOAT, data2);
-      std::cout <<'\n' << "dot products: " << '\n';
-      for (size_t i = 0; i < kMaxParticleCount; i += 1) {
-        if (i % (texture_width_1) == 0)
-          std::cout  << '\n';
-        std::cout << data2[i] << " ";
-      }
-      std::cout <<  std::endl;
-      free(data2);*/
+  CHECKGLERROR();
+}
 
+void GPUParticle::_sorting_kernel() {
+  //sized from the alive particles upper bound, the visible count is only
+  //known on the device. A pair at least, for the last stage to write the
+  //sorted indices. The network spans a power of two of keys, only the pairs
+  //with a key counted are dispatched.
+  unsigned int const elem_count = std::max(2u, num_alive_particles_);
+  unsigned int const max_elem_count = GetClosestPowerOfTwo(elem_count);
+
+  _read_sort_timing();
+  SortSchedule const schedule = _sorting_schedule(max_elem_count);
+  sort_full_ = (schedule == kScheduleFull);
+  sort_skipped_ = (schedule == kScheduleSkip);
+  sort_refine_rounds_ = 0u;
+  sort_pass_count_ = 0u;
+
+  //a refined or skipped sort starts from the carried order, the ranks
+  //compacted. So does a full one when the disorder of that order is measured.
+  bool const measure_disorder = enable_sort_skipping_ && incremental_sort() && sort_order_carried_ &&
+                                !disorder_query_pending_;
+  bool const carried = !sort_full_ || measure_disorder;
+  compute_sort_.pack(vbo_, render_args_buffer_, culled_ids_buffer_, pbuffer_->second_index(), sorted_indices_,
+                     num_alive_particles_, camera_.depth_scale, carried);
+
+  //particles out of place in the carried order, read back with the counts
+  //before it is sorted.
+  if (measure_disorder) {
+    compute_sort_.count_inversions(kSortDisorderDistance, true, camera_.depth_scale);
+    disorder_visible_count_ = num_visible_particles_;
+    disorder_query_pending_ = true;
   }
-  glUseProgram(0u);
-  glBindVertexArray(0);
+
+  //the last pass writes the rank of the keys for the next sort to carry.
+  bool const write_ranks = incremental_sort();
+  if (sort_skipped_) {
+    //the carried keys are packed as sorted by a single pass over their
+    //pairs. The last sort camera is kept, the skips are bounded by its
+    //motion.
+    compute_sort_.copy(write_ranks);
+    sort_pass_count_ = compute_sort_.pass_count();
+    ++sort_skip_count_;
+
+    CHECKGLERROR();
+    return;
+  }
+
+  //device time of the passes, one measure at a time.
+  bool const timed = (sort_time_budget_ > 0.0f) && !budget_query_pending_;
+  if (timed) {
+    glQueryCounter(budget_queries_[0], GL_TIMESTAMP);
+  }
+
+  if (sort_full_) {
+    compute_sort_.sort(write_ranks);
+    sort_inversion_count_ = 0u;
+    sort_deferred_count_ = 0u;
+    sort_disorder_ = 1.0f;
+  } else {
+    //as the transform feedback refine, alternately on each side from one
+    //round to the next.
+    sort_refine_rounds_ = _sorting_affordable_rounds();
+    compute_sort_.refine(kSortRefineBlockWidth, sort_refine_rounds_, sort_refine_parity_, write_ranks);
+  }
+  sort_pass_count_ = compute_sort_.pass_count();
+
+  if (timed) {
+    glQueryCounter(budget_queries_[1], GL_TIMESTAMP);
+    budget_query_passes_ = sort_pass_count_;
+    budget_query_pending_ = true;
+  }
+
+  //inversions left by the refined order, read back with the counts, one
+  //measure at a time.
+  if (!sort_full_ && !inversions_query_pending_) {
+    compute_sort_.count_inversions(kSortRefineBlockWidth, false, camera_.depth_scale);
+    inversions_visible_count_ = num_visible_particles_;
+    inversions_query_pending_ = true;
+  }
+
+  //the next simulation carries the ranks written.
+  mat4x4_dup(sorted_view_, camera_.view);
+  sort_order_carried_ = incremental_sort();
+
   CHECKGLERROR();
+}
 
-  glBindFramebuffer(GL_FRAMEBUFFER, framebuf[0]);
-  glBindTexture(GL_TEXTURE_2D, indices_texture_ids_[1]);
-  glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, indices_texture_ids_[1], 0);
-  glClearBufferuiv(GL_COLOR, 0, clear_value1);
-  glBindFramebuffer(GL_FRAMEBUFFER, framebuf[1]);
-  glBindTexture(GL_TEXTURE_2D, indices_texture_ids_[0]);
-  glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, indices_texture_ids_[0], 0);
+void GPUParticle::_sorting_buckets() {
+  //sized from the culled particles bounding them, the keys past them are
+  //padding : the visible count is only known on the device.
+  bucket_sort_.sort(vbo_, visible_count_texture_id_, sorted_alive_count_, camera_.depth_scale,
+                    sort_bucket_count_, sorted_indices_);
+  sort_pass_count_ = bucket_sort_.pass_count();
+
+  //the culling follows the carried order, which then orders each bucket.
+  sort_full_ = true;
+  mat4x4_dup(sorted_view_, camera_.view);
+  if (incremental_sort()) {
+    _gather_sort_order();
+  } else {
+    sort_order_carried_ = false;
+  }
 
-  glActiveTexture( GL_TEXTURE0 );
-  glBindTexture(GL_TEXTURE_2D, dp_texture_id_);
+  CHECKGLERROR();
+}
 
-  unsigned int const nsteps = GetNumTrailingBits(max_elem_count);
-  uint dp_texture_location = glGetUniformLocation(pgm_.sort_step, "dp");
-  uint indices_texture_location = glGetUniformLocation(pgm_.sort_step, "indices");
-  glUseProgram(pgm_.sort_step);
-  glUniform1i(dp_texture_location, 0);
-  glUniform1i(indices_texture_location, 1);
-  glUniform1ui(ulocation_.sort_step.width, texture_width_);
-  glUniform1ui(ulocation_.sort_step.height, texture_height_);
-  glUniform1ui(ulocation_.sort_step.texWidth, texture_width_1);
-  glUniform1ui(ulocation_.sort_step.texHeight, texture_height_1);
+void GPUParticle::_sorting_tiles_kernel() {
+  //sized from the alive particles upper bound, the visible count is only
+  //known on the device.
+  float const time_step = (enable_interpolation_) ? simulation_timestep_ : 0.0f;
+  tile_sort_.sort(vbo_, culled_vbo_, render_args_buffer_, num_alive_particles_, camera_.view, camera_.view_proj,
+                  camera_.depth_scale, time_step, sort_tile_grid_);
+  sort_pass_count_ = tile_sort_.pass_count();
+  sort_tiled_ = true;
 
-  glBindVertexArray(vao_f_);
-  unsigned int binding = 0u;
-  for (size_t step = 0; step < nsteps; step++) {
-    for (size_t stage = 0; stage < step + 1u; stage++) {
+  //no rank written for the next sort to carry.
+  sort_order_carried_ = false;
 
-      //compute kernel parameters.
-      GLuint const block_width = 2u << (step - stage);
-      GLuint const max_block_width = 2u << step;
-      glUniform1ui(ulocation_.sort_step.blockWidth, block_width);
-      glUniform1ui(ulocation_.sort_step.maxBlockWidth, max_block_width);
+  CHECKGLERROR();
+}
 
-      glBindFramebuffer(GL_FRAMEBUFFER, framebuf[binding]);
-      glActiveTexture( GL_TEXTURE0 + 1u );
-      glBindTexture(GL_TEXTURE_2D, indices_texture_ids_[binding]);
-      binding ^= 1u;
+void GPUParticle::_sorting_buckets_kernel() {
+  //sized from the alive particles upper bound, the visible count is only
+  //known on the device.
+  bucket_sort_.sort_kernel(vbo_, render_args_buffer_, num_alive_particles_, camera_.depth_scale,
+                           sort_bucket_count_, sorted_indices_);
+  sort_pass_count_ = bucket_sort_.pass_count();
+  sort_order_carried_ = false;
 
-      glDrawArrays(GL_TRIANGLE_FAN,0, 4);
+  CHECKGLERROR();
+}
 
-/*
-      glBindTexture(GL_TEXTURE_2D, indices_texture_ids_[binding]);
-      GLushort *data5 = (GLushort*)malloc(kMaxParticleCount * sizeof(GL_UNSIGNED_SHORT));
-      glReadPixels(0.0f, 0.0f, texture_width_1, texture_height_1, GL_RED_INTEGER, GL_UNSIGNED_SHORT, data5);
-      std::cout <<'\n' << "stage: " << stage << '\n';
-      for (size_t i = 0; i < kMaxParticleCount; i += 1) {
-        if (i % (texture_width_1) == 0)
-          std::cout  << '\n';
-        std::cout << data5[i] << " ";
-      }
-      std::cout <<  std::endl;
-      free(data5);
-*/
-CHECKGLERROR();
-    }
+void GPUParticle::_sorting_host() {
+  //the visible count is only known on the device, the alive one bounds it.
+  unsigned int const max_count = (backend_ == kBackendCompute) ? num_alive_particles_ : sorted_alive_count_;
+  if (backend_ == kBackendCompute) {
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
   }
-  glUseProgram(0u);
-  glBindVertexArray(0u);
 
-  glBindTexture(GL_TEXTURE_2D, indices_texture_ids_[binding]);
-  glBindBuffer(GL_PIXEL_PACK_BUFFER, sorted_indices_);
-    glReadPixels(0, 0, texture_width_, texture_height_, GL_RED_INTEGER, GL_UNSIGNED_SHORT, 0);
-  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0u);
+  //the culled particles are replaced by the last ones sorted, with their count.
+  host_sort_.sort(vbo_, culled_vbo_, render_args_buffer_, max_count, sorted_indices_);
+  sort_time_ = host_sort_.sort_time();
+  sort_pass_count_ = host_sort_.pass_count();
+  sort_full_ = true;
 
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-/*
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sorted_indices_);
-  GLushort *data7 = (GLushort*)glMapBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_READ_ONLY);
-  std::cout <<'\n' << "indices after sort in element array buffer: " << '\n';
-  for (size_t i = 0; i < max_elem_count; i++) {
-    std::cout << data7[i] << " ";
+  //a drawn order of previous particles is not carried by the simulation.
+  sort_order_carried_ = false;
+
+  CHECKGLERROR();
+}
+
+void GPUParticle::_readback_counts() {
+  //counts copied by a previous update, the particles emitted since are
+  //assumed alive.
+  GLuint counts[ComputeBackend::kNumCounts];
+  if (compute_backend_.read_counts(counts)) {
+    num_alive_particles_ = std::min(counts[0u] + emitted_since_readback_, pbuffer_->element_count());
+    num_visible_particles_ = counts[1u];
+
+    //inversions of a refined order, and of a carried one, when measured
+    //before the copy.
+    if (readback_inversions_) {
+      sort_inversion_count_ = counts[2u];
+      inversions_query_pending_ = false;
+    }
+    if (readback_disorder_) {
+      sort_disorder_ = counts[3u] / static_cast<float>(std::max(1u, disorder_visible_count_));
+      disorder_query_pending_ = false;
+    }
   }
-  std::cout <<  std::endl;
-  glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);*/
 
-  //glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  //copy the current counts, without waiting for them.
+  if (!compute_backend_.readback_pending()) {
+    readback_inversions_ = inversions_query_pending_;
+    readback_disorder_ = disorder_query_pending_;
+    compute_backend_.copy_counts(render_args_buffer_, compute_sort_.carry_buffer_id(),
+                                 compute_sort_.inversions_offset(), readback_inversions_, readback_disorder_);
+    emitted_since_readback_ = 0u;
+  }
 
-  glBindTexture(GL_TEXTURE_2D, 0);
   CHECKGLERROR();
 }
 
 void GPUParticle::_postprocess() {
   if (1 || simulated_) {
 
-    //copy non sorted alive particles back to the first buffer.
-    if (1) {
+    //the buffer written is consumed next, the VAOs follow the ring, unless
+    //updated in place.
+    if (!slots_in_place()) {
       pbuffer_->swap_storage();
-      std::swap(vao_s_[0], vao_s_[1]);
-      std::swap(vao_[0], vao_[1]);
-      std::swap(vao_c_[0], vao_c_[1]);
     }
   }
 
@@ -4,35 +4,204 @@
 #include "opengl.h"
 #include "linmath.h"
 
-#include "api/random_buffer.h"
+#include "api/anchor_buffer.h"
+#include "api/append_consume_buffer.h"
+#include "api/bucket_depth_sort.h"
+#include "api/compute_backend.h"
+#include "api/compute_depth_sort.h"
+#include "api/host_depth_sort.h"
+#include "api/tile_depth_sort.h"
 #include "api/vector_field.h"
+#include <algorithm>
+#include <cfloat>
 #include <iostream>
 #include <utility>
-
-class AppendConsumeBuffer;
+#include <vector>
 
 class GPUParticle {
 public:
+  static unsigned int const kMaxEmitterCount = 64u;
+
+  //simulation and sorting backends.
+  enum Backend {
+    kBackendTransformFeedback = 0,    //< vertex and geometry stages, fragment sort (OpenGL 4.1).
+    kBackendCompute                   //< compute kernels over storage buffers (OpenGL 4.3).
+  };
+
+  //back-to-front order of the visible particles.
+  enum SortMode {
+    kSortExact = 0,                   //< bitonic sort of the depth keys.
+    kSortBuckets,                     //< depth buckets, in a linear number of passes, unordered within a bucket.
+    kSortHost,                        //< radix sort of the depths read back, drawn a frame or more behind.
+    kSortTiles                        //< per screen tile lists of the sprites overlapping it, drawn tile by tile.
+  };
+
+  //blending of the sprites, set by render. Additive and multiplicative
+  //blending do not depend on the drawing order.
+  enum BlendMode {
+    kBlendAlpha = 0,                  //< over, colors multiplied by their alpha.
+    kBlendPremultiplied,              //< over, colors premultiplied by the shaders.
+    kBlendAdditive,                   //< sum, order independent.
+    kBlendMultiply,                   //< product with the background, order independent.
+    kBlendWeighted,                   //< weighted blended order independent over, composited after the sprites.
+    kNumBlendModes
+  };
+
+  enum EmitterShape {
+    kEmitterPoint = 0,
+    kEmitterSphere,                   //< unit ball.
+    kEmitterDisk,                     //< unit disk in the XZ plane.
+    kEmitterBox                       //< [-1, 1] cube.
+  };
+
+  struct Emitter {
+    Emitter():
+      shape(kEmitterPoint),
+      rate(0.0f),
+      min_age(0.2f),
+      max_age(1.0f),
+      velocity{0.0f, 0.0f, 0.0f} {
+      mat4x4_identity(transform);
+    }
+
+    EmitterShape shape;
+    float rate;                       //< particles emitted per second.
+    float min_age;                    //< lifetime range of the emitted particles.
+    float max_age;
+    vec3 velocity;                    //< emitter space velocity, scaled by a random factor.
+    mat4x4 transform;                 //< emitter space to world space.
+  };
+
   GPUParticle():
     num_alive_particles_(0u),
+    num_visible_particles_(0u),
+    slot_count_(0u),
+    fresh_slot_(0u),
+    slot_high_water_(0u),
+    dead_list_first_(0u),
+    dead_list_pending_(0u),
     pbuffer_(nullptr),
+    backend_(kBackendCompute),
+    num_batch_emitters_(0u),
     dp_texture_id_(0u),
+    sorted_texture_id_(0u),
     sorted_indices_(0u),
+    render_args_buffer_(0u),
+    cull_feedback_(0u),
+    cull_queries_{},
+    cull_query_first_(0u),
+    cull_query_pending_(0u),
+    visible_count_texture_id_(0u),
+    visible_count_framebuffer_(0u),
+    vao_k_(0u),
     vao_e_{0u},
-    vao_s_{0u, 0u},
-    vao_{0u, 0u},
+    emitters_ubo_(0u),
+    vao_s_{},
+    vao_(0u),
+    vao_g_{},
+    vao_gk_{},
     query_time_(0u),
+    sort_queries_{0u, 0u},
+    frame_index_(0u),
+    random_seed_(0u),
+    simulation_timestep_(1.0f / kDefaultSimulationRate),
+    time_accumulator_(0.0f),
+    max_substeps_(kDefaultMaxSubsteps),
+    oit_framebuffer_(0u),
+    oit_texture_ids_{0u, 0u},
+    oit_width_(0),
+    oit_height_(0),
+    grid_sums_texture_ids_{0u, 0u, 0u},
+    grid_starts_texture_ids_{0u, 0u, 0u},
+    grid_framebuffer_(0u),
+    grid_indices_buffer_(0u),
+    grid_indices_texture_id_(0u),
+    grid_keys_buffers_{},
+    grid_feedbacks_{0u, 0u},
+    emitted_since_readback_(0u),
+    readback_inversions_(false),
+    readback_disorder_(false),
     simulation_box_size_(kDefaultSimulationBoxSize),
+    interaction_radius_(2.0f),
+    repulsion_(20.0f),
+    cohesion_(2.0f),
+    target_attraction_(50.0f),
+    cull_margin_(1.0f),
+    cull_distance_(FLT_MAX),
+    lod_distance_(kDefaultLodDistance),
+    lod_period_(kDefaultLodPeriod),
+    curl_noise_period_(0u),
+    sort_stages_per_pass_(kDefaultSortStagesPerPass),
+    blend_mode_(kBlendAlpha),
+    sort_mode_(kSortExact),
+    sort_bucket_count_(kDefaultSortBucketCount),
+    sort_tile_grid_(kDefaultSortTileGrid),
+    sort_pass_count_(0u),
+    sort_time_(0.0f),
+    culled_ids_buffer_(0u),
+    hidden_ids_buffer_(0u),
+    sort_order_buffer_(0u),
+    vao_o_(0u),
+    vao_h_(0u),
+    inversions_query_(0u),
+    sorted_alive_count_(0u),
+    inversions_visible_count_(0u),
+    sort_inversion_count_(0u),
+    sort_full_backoff_(0u),
+    sort_deferred_count_(0u),
+    sort_inversion_threshold_(kDefaultSortInversionThreshold),
+    sort_order_pending_(false),
+    sort_order_carried_(false),
+    inversions_query_pending_(false),
+    sort_full_(true),
+    identity_indices_(0u),
+    disorder_query_(0u),
+    budget_queries_{0u, 0u},
+    disorder_visible_count_(0u),
+    emitted_since_sort_(0u),
+    sorted_visible_count_(0u),
+    sort_skip_count_(0u),
+    sort_refine_parity_(0u),
+    sort_refine_rounds_(0u),
+    budget_query_passes_(0u),
+    sort_skip_threshold_(kDefaultSortSkipThreshold),
+    sort_disorder_(1.0f),
+    sort_time_budget_(0.0f),
+    sort_pass_time_(0.0f),
+    disorder_query_pending_(false),
+    budget_query_pending_(false),
+    sort_skipped_(false),
     simulated_(false),
+    slots_reset_(true),
+    sorted_(false),
+    sort_tiled_(false),
     enable_sorting_(true),
-    enable_vectorfield_(true) {enable_sorting_ = true;}
+    enable_vectorfield_(true),
+    enable_interpolation_(true),
+    enable_fused_emission_(true),
+    enable_interactions_(true),
+    enable_culling_(true),
+    enable_stable_slots_(false),
+    enable_sort_timing_(false),
+    enable_incremental_sort_(false),
+    enable_sort_skipping_(false) {enable_sorting_ = true;}
 
   void init();
   void deinit();
 
-  void update(float const dt, mat4x4 const &view);
+  //advance the simulation by fixed steps covering dt, the remainder is
+  //carried to the next update and used to interpolate the rendering.
+  void update(float const dt, mat4x4 const &view, mat4x4 const &viewProj);
+  //draw the visible particles with the blending of the blend mode, left
+  //enabled. The weighted blended mode accumulates them offscreen over the
+  //viewport, then composites them over the bound framebuffer.
   void render(mat4x4 const &view, mat4x4 const &viewProj);
 
+  //set before init, the transform feedback backend is used when compute
+  //shaders are not supported by the context.
+  inline void backend(Backend backend) { backend_ = backend; }
+  inline Backend backend() const { return backend_; }
+
   inline const glm::uvec3& vectorfield_dimensions() const {
     return vectorfield_.dimensions();
   }
@@ -40,15 +209,198 @@ public:
   inline float simulation_box_size() const { return simulation_box_size_; }
   inline void simulation_box_size(float size) { simulation_box_size_ = size; }
 
+  //emitters are serviced in a single pass, up to kMaxEmitterCount.
+  bool add_emitter(Emitter const& emitter);
+  void clear_emitters();
+
+  inline unsigned int num_emitters() const { return static_cast<unsigned int>(emitters_.size()); }
+  inline Emitter& emitter(unsigned int index) { return emitters_[index]; }
+
+  //number of simulation steps per second.
+  inline float simulation_rate() const { return 1.0f / simulation_timestep_; }
+  inline void simulation_rate(float rate) { simulation_timestep_ = 1.0f / rate; }
+
+  //steps run by a single update at most, the time left behind is dropped.
+  inline unsigned int max_substeps() const { return max_substeps_; }
+  inline void max_substeps(unsigned int count) { max_substeps_ = count; }
+
+  //order independent blend modes are drawn in culling order : the depth
+  //keys are not sorted, whatever the sort settings.
+  inline void blend_mode(BlendMode mode) { blend_mode_ = mode; }
+  inline BlendMode blend_mode() const { return blend_mode_; }
+  bool order_independent() const;
+
+  //back-to-front sort of the visible particles, for the over blend modes.
+  //Disabled, they are drawn in culling order.
   inline void enable_sorting(bool status) { enable_sorting_ = status; }
+  inline bool sorting() const { return enable_sorting_ && !order_independent(); }
+
+  //bitonic stages within the texels of four keys run by one pass of the
+  //fragment sort, 1 (a pass per stage) or kMaxSortStagesPerPass, the default :
+  //each fragment owns the keys of its texel, the stages between texels run a
+  //pass each.
+  static unsigned int const kMaxSortStagesPerPass = 2u;
+  inline void sort_stages_per_pass(unsigned int count) {
+    sort_stages_per_pass_ = std::max(1u, std::min(count, kMaxSortStagesPerPass));
+  }
+
+  //the buckets sort quantises the depth range, with a power of two count of
+  //buckets up to kMaxSortBucketCount. Transform feedback passes partition
+  //the particles on each bit of their bucket, keeping the culling order
+  //within a bucket. Compute kernels count them per bucket, sum the counts
+  //and scatter them in any order within a bucket.
+  static unsigned int const kMaxSortBucketCount = 1024u;
+  inline void sort_mode(SortMode mode) {
+    if (mode != sort_mode_) {
+      host_sort_.reset();
+    }
+    sort_mode_ = mode;
+  }
+  inline SortMode sort_mode() const { return sort_mode_; }
+  inline void sort_bucket_count(unsigned int count) {
+    sort_bucket_count_ = std::max(2u, std::min(count, kMaxSortBucketCount));
+  }
+
+  //the tiles sort splits the viewport in a grid of tiles, up to
+  //kMaxSortTileGrid per side, and lists each visible sprite in every tile
+  //its bounds overlap. A kernel group per tile sorts its list on its own,
+  //the largest sort following the density of a tile instead of the visible
+  //count, and render draws the lists scissored to their tile : the view and
+  //projection of render must be the ones of the update. The lists hold four
+  //entries per particle at most, on average : past it, the frame falls back to
+  //a single list sorted by one group, drawn in every tile. Compute backend,
+  //the exact sort otherwise.
+  static unsigned int const kMaxSortTileGrid = 16u;
+  inline void sort_tile_grid(unsigned int tiles) {
+    sort_tile_grid_ = std::max(1u, std::min(tiles, kMaxSortTileGrid));
+  }
+
+  //passes of the last sort, and its device time in milliseconds when timed.
+  //Timing waits for the sort to complete. The host sort reports its own
+  //time, from the readback of the depths to the upload of the indices.
+  inline unsigned int sort_pass_count() const { return sort_pass_count_; }
+  inline float sort_time() const { return sort_time_; }
+  inline void enable_sort_timing(bool status) { enable_sort_timing_ = status; }
+
+  //simulate the visible particles in their last sorted order, so that the
+  //next sort only refines it with block local passes. A full sort runs when
+  //the camera jumps or when too many particles of the last refined order
+  //were nearer than the one a block after them. Without stable slots. The
+  //compute backend carries the rank of each particle instead of its storage
+  //order.
+  inline void enable_incremental_sort(bool status) { enable_incremental_sort_ = status; }
+  //ratio of the visible particles.
+  inline void sort_inversion_threshold(float ratio) { sort_inversion_threshold_ = ratio; }
+  //inversions of the last sorted order, measured a sort later when refined.
+  inline unsigned int sort_inversion_count() const { return sort_inversion_count_; }
+  //true if the last sort was a full one.
+  inline bool sort_full() const { return sort_full_; }
+
+  //keep the carried order instead of sorting while the camera barely moved
+  //since the last sort, few particles came in view and few particles of the
+  //carried order are nearer than the one a few slots after them, as measured
+  //a frame later. At most kSortMaxSkips updates in a row. Incremental sort only.
+  //The newborns count as appended : while the emitters run, a skip needs
+  //their rate per update under the threshold, 0.2% of the visible particles
+  //by default.
+  inline void enable_sort_skipping(bool status) { enable_sort_skipping_ = status; }
+  //ratio of the visible particles, for the ones out of place and the ones
+  //appended.
+  inline void sort_skip_threshold(float ratio) { sort_skip_threshold_ = ratio; }
+  //true if the last update kept the carried order.
+  inline bool sort_skipped() const { return sort_skipped_; }
+  //ratio of the visible particles out of place in the last carried order
+  //measured, 1 until measured.
+  inline float sort_disorder() const { return sort_disorder_; }
+
+  //device time allowed to the sort of an update, in milliseconds, 0 for
+  //none. The refine rounds fit the time of a pass measured asynchronously,
+  //and a full sort due to the inversions is left to more rounds over the
+  //next updates when it does not fit. Incremental sort only.
+  inline void sort_time_budget(float ms) { sort_time_budget_ = std::max(0.0f, ms); }
+  //refine rounds of the last sort.
+  inline unsigned int sort_refine_rounds() const { return sort_refine_rounds_; }
   inline void enable_vectorfield(bool status) { enable_vectorfield_ = status; }
+  inline void enable_interpolation(bool status) { enable_interpolation_ = status; }
+  //create the emitted particles in the simulation pass instead of a pass of their own.
+  inline void enable_fused_emission(bool status) { enable_fused_emission_ = status; }
+
+  //repulsion and cohesion between particles closer than the radius, the
+  //radius being limited to the neighbours grid cell size. Every particle of
+  //the adjacent cells is visited, from lists sorted by cell on both backends.
+  inline void interaction_radius(float radius) { interaction_radius_ = radius; }
+  inline void repulsion(float strength) { repulsion_ = strength; }
+  inline void cohesion(float strength) { cohesion_ = strength; }
+  inline void enable_interactions(bool status) { enable_interactions_ = status; }
+
+  //anchors on target meshes, assigned to the particles when emitted.
+  inline AnchorBuffer& anchors() { return anchors_; }
+  inline void target_attraction(float strength) { target_attraction_ = strength; }
+
+  //particles out of the view frustum, or farther than the distance, are
+  //neither sorted nor rendered. The margin bounds the size of a sprite.
+  inline void cull_margin(float margin) { cull_margin_ = margin; }
+  inline void cull_distance(float distance) { cull_distance_ = distance; }
+  inline void enable_culling(bool status) { enable_culling_ = status; }
+
+  //with the compute backend, the count of a previous update : rendering
+  //reads it on the device.
+  inline unsigned int num_visible_particles() const { return num_visible_particles_; }
+
+  //particles farther than the distance, or out of view, skip the neighbours
+  //interactions and update their forces and flow every 'period' steps only,
+  //drifting in between. A period of 1 simulates every particle fully.
+  inline void lod_distance(float distance) { lod_distance_ = distance; }
+  inline void lod_period(unsigned int period) { lod_period_ = std::max(1u, period); }
+
+  //adds the curl noise to the flow, each particle evaluating it every
+  //'period' steps only and reusing it in between. 0 disables it.
+  inline void curl_noise_period(unsigned int period) { curl_noise_period_ = period; }
+
+  //keep particles in fixed slots, newborns filling the dead slots, instead of
+  //compacting the alive ones every step. The compute backend updates them in
+  //place, the dead slots queued on the device. The transform feedback one
+  //still writes every slot to the other buffer : only the identity of the
+  //particles, their slot, is kept.
+  inline void enable_stable_slots(bool status) {
+    //the slots used so far hold every alive particle, a compacting step drops
+    //the dead ones. The dead slots counted so far are dropped.
+    unsigned int const count = (stable_slots()) ? slot_count_ : num_alive_particles_;
+    slot_count_ = slot_high_water_ = num_alive_particles_ = count;
+    fresh_slot_ = count;
+    dead_list_pending_ = 0u;
+    slots_reset_ = true;
+    enable_stable_slots_ = status;
+  }
 
 private:
   static unsigned int const kThreadsGroupWidth;
 
   static unsigned int const kMaxParticleCount = (1u << 16u);
-  static unsigned int const kBatchEmitCount = (1u << 11u);
   static float constexpr kDefaultSimulationBoxSize = 256.0f;
+  static float constexpr kDefaultSimulationRate = 60.0f;
+  static unsigned int const kDefaultMaxSubsteps = 4u;
+  static unsigned int const kGridSamplerCount = 2u;
+  static unsigned int const kGridScanLevelCount = 3u;
+  static unsigned int const kGridScanGroupWidth = 32u;
+  static unsigned int const kGridPartitionCount = 4u;
+  static unsigned int const kDeadListQueryCount = 4u;
+  static unsigned int const kCullQueryCount = 4u;
+  static float constexpr kDefaultLodDistance = 256.0f;
+  static unsigned int const kDefaultLodPeriod = 4u;
+  static unsigned int const kSortRefineBlockWidth = 256u;
+  static unsigned int const kSortRefineRounds = 2u;
+  static unsigned int const kSortMaxRefineRounds = 8u;
+  static unsigned int const kSortMaxSkips = 8u;
+  static float constexpr kDefaultSortSkipThreshold = 0.002f;
+  static float constexpr kDefaultSortInversionThreshold = 0.01f;
+  static unsigned int const kDefaultSortStagesPerPass = 2u;
+  static unsigned int const kDefaultSortBucketCount = 256u;
+  static unsigned int const kDefaultSortTileGrid = 8u;
+  static unsigned int const kSortTileCapacity = 4u * kMaxParticleCount;
+  static unsigned int const kSortFullBackoff = 16u;
+  static unsigned int const kSortMaxDeferredSorts = 4u;
+  static float constexpr kSortInversionCeiling = 4.0f;
 
   static
   unsigned int GetThreadsGroupCount(unsigned int const nthreads) {
@@ -60,88 +412,248 @@ private:
     return kThreadsGroupWidth * (nparticles / kThreadsGroupWidth);
   }
 
+  //stable slots listed on the host, the transform feedback simulation
+  //rewriting each one.
+  inline bool stable_slots() const {
+    return enable_stable_slots_ && (backend_ == kBackendTransformFeedback);
+  }
+
+  //stable slots updated in place by the compute simulation, the buffers not
+  //swapped.
+  inline bool slots_in_place() const {
+    return enable_stable_slots_ && (backend_ == kBackendCompute);
+  }
+
+  //the compute simulation appends its particles in any order, carrying their
+  //rank instead.
+  inline bool incremental_sort() const {
+    return enable_incremental_sort_ && !enable_stable_slots_;
+  }
+
+  //particles stored in the buffers, alive or not.
+  inline unsigned int num_stored_particles() const {
+    return (stable_slots()) ? slot_count_ : num_alive_particles_;
+  }
+
   void _setup_render();
   void _setup_emission();
   void _setup_simulation();
   void _setup_fill_indices();
-  void _setup_calculate_dp();
+  void _setup_culling();
+  void _setup_grid();
+  void _setup_stable_slots();
+  void _setup_incremental_sort();
+  void _setup_weighted_oit();
 
+  void _read_dead_slot_counts();
+  void _build_dead_list(unsigned int const emit_count);
+  void _build_emit_map(unsigned int const count);
+  void _build_grid();
+  unsigned int _update_emitters(float const dt);
   void _emission(unsigned int const count);
-  void _simulation(float const dt);
+  void _simulation(float const dt, unsigned int const emit_count);
   void _postprocess();
-  void _sorting(mat4x4 const &view);
+  void _culling();
+  void _read_visible_counts();
+  void _count_visible();
+  enum SortSchedule {
+    kScheduleFull,
+    kScheduleRefine,
+    kScheduleSkip
+  };
 
-  struct {
-    float max_age = 1.0f;
-  } params_;
+  void _sorting();
+  SortSchedule _sorting_schedule(unsigned int const max_elem_count);
+  bool _sorting_can_skip() const;
+  unsigned int _sorting_stage_passes(unsigned int const nstages) const;
+  unsigned int _sorting_passes(unsigned int const block_width) const;
+  unsigned int _sorting_refine_passes(unsigned int const rounds) const;
+  unsigned int _sorting_affordable_rounds() const;
+  void _sorting_skip();
+  void _read_sort_timing();
+  void _sorting_stages(GLuint const block_width, bool const flip, bool const last, unsigned int &binding);
+  void _sorting_pass(bool const last, unsigned int &binding);
+  void _count_inversions(GLuint const query, GLuint const distance, bool const carried,
+                         unsigned int const width);
+  void _gather_sort_order();
+  void _sorting_kernel();
+  void _sorting_buckets();
+  void _sorting_buckets_kernel();
+  void _sorting_tiles_kernel();
+  void _sorting_host();
+  void _begin_weighted_oit(GLsizei const width, GLsizei const height);
+  void _composite_weighted_oit(GLuint const framebuffer, GLint const viewport[4]);
+  void _readback_counts();
 
-  unsigned int num_alive_particles_;  //< number of particle written and rendered on last frame.
+  unsigned int num_alive_particles_;  //< number of particle written on last frame, an upper bound with the compute backend or stable slots.
+  unsigned int num_visible_particles_;  //< number of particle culled in and rendered, read back a few frames late.
+  unsigned int slot_count_;           //< stable storage : slots used so far, alive or dead, an upper bound.
+  unsigned int fresh_slot_;           //< stable storage : first slot of the step past the ones used.
+  unsigned int slot_high_water_;      //< stable storage : slots used, as of the last dead list counted.
+  unsigned int dead_list_first_;      //< stable storage : oldest dead list not counted yet.
+  unsigned int dead_list_pending_;    //< stable storage : dead lists not counted yet.
   AppendConsumeBuffer *pbuffer_;      //< Append / Consume buffer for particles.
+  Backend backend_;                   //< Simulation and sorting backend.
 
-  RandomBuffer randbuffer_;           //< StorageBuffer to hold random values.
   VectorField vectorfield_;           //< Vector field handler.
+  AnchorBuffer anchors_;              //< Target meshes anchors.
+  ComputeBackend compute_backend_;    //< Compute backend : counters, dispatch arguments and cells lists.
+
+  std::vector<Emitter> emitters_;
+  std::vector<float> emission_accumulators_;  //< fractional particles left to emit, per emitter.
+  unsigned int num_batch_emitters_;           //< emitters of the current batch, in emitters_ubo_.
 
   struct {
     GLuint emission;
-    GLuint update_args;
     GLuint simulation;
     GLuint fill_indices;
-    GLuint calculate_dp;
+    GLuint cull;
+    GLuint visible_count;
+    GLuint grid_count;
+    GLuint grid_reduce;
+    GLuint grid_scan;
+    GLuint grid_keys;
+    GLuint grid_scatter;
+    GLuint grid_gather;
+    GLuint dead_list;
+    GLuint emit_map;
     GLuint sort_step;
+    GLuint sort_stages;
+    GLuint sort_flip;
+    GLuint sort_inversions;
+    GLuint gather_ids;
     GLuint sort_final;
     GLuint render_point_sprite;
     GLuint render_stretched_sprite;
+    GLuint oit_composite;
   } pgm_;               //< Pipeline's shaders.
 
   struct {
     struct {
-      GLint count;
-      GLint particleMaxAge;
+      GLint numEmitters;
+      GLint emitFirst;
+      GLint anchorCount;
+      GLint frame;
     } emission;
     struct {
       GLint deltaT;
       GLint vectorFieldSampler;
       GLint bboxSize;
+      GLint numEmitters;
+      GLint emitFirst;
+      GLint frame;
+      GLint interactionRadius;
+      GLint repulsion;
+      GLint cohesion;
+      GLint anchorCount;
+      GLint targetAttraction;
+      GLint view;
+      GLint frustumPlanes;
+      GLint lodDistance;
+      GLint lodPeriod;
+      GLint curlNoisePeriod;
+      GLint stableSlots;
+      GLint maxParticleCount;
+      GLint carryRanks;
     } simulation;
+    struct {
+      GLint firstFreshSlot;
+    } dead_list;
+    struct {
+      GLint emitMapSize;
+    } emit_map;
+    struct {
+      GLint bboxSize;
+    } grid_count;
+    struct {
+      GLint width;
+      GLint groupWidth;
+    } grid_reduce;
+    struct {
+      GLint width;
+      GLint groupWidth;
+      GLint topLevel;
+    } grid_scan;
+    struct {
+      GLint bboxSize;
+      GLint shift;
+    } grid_keys;
+    struct {
+      GLint shift;
+    } grid_scatter;
     struct {
       GLint view;
-    } calculate_dp;
+      GLint frustumPlanes;
+      GLint cullMargin;
+      GLint timeStep;
+      GLint maxDistance;
+      GLint enableCulling;
+      GLint storeDepthKeys;
+      GLint carryRanks;
+    } cull;
     struct {
       GLint width;
-      GLint height;
+      GLint depthScale;
     } fill_indices;
     struct {
       GLint blockWidth;
-      GLint maxBlockWidth;
+      GLint flip;
+      GLint count;
       GLint width;
-      GLint height;
-      GLint texWidth;
-      GLint texHeight;
     } sort_step;
+    struct {
+      GLint blockWidth;
+      GLint stageCount;
+      GLint flip;
+      GLint count;
+      GLint width;
+      GLint unpackIndices;
+    } sort_stages;
+    struct {
+      GLint blockWidth;
+      GLint offset;
+      GLint size;
+      GLint count;
+      GLint width;
+    } sort_flip;
+    struct {
+      GLint width;
+      GLint component;
+      GLint distance;
+      GLint carried;
+      GLint depthScale;
+    } sort_inversions;
     struct {
       GLint mvp;
     } render_point_sprite;
     struct {
       GLint view;
       GLint mvp;
+      GLint timeLag;
+      GLint weighted;
     } render_stretched_sprite;
+    struct {
+      GLint offset;
+    } oit_composite;
   } ulocation_;             //< Programs uniform location.
 
   struct  {
-    struct {
-      GLuint randvector;
-    } emission;
     struct {
       GLuint position;
       GLuint velocity;
       GLuint age;
-      GLuint randvector;
+      GLuint anchor;
+      GLuint curl;
     } simulation;
     struct {
       GLuint position;
       GLuint velocity;
       GLuint age;
-    } calculate_dp;
+    } cull;
+    struct {
+      GLuint position;
+      GLuint age;
+    } grid_count;
     struct {
       GLuint position;
       GLuint velocity;
@@ -154,34 +666,158 @@ private:
   /// all storage ids and share them between subclasses.
   ///
   //GLuint gl_indirect_buffer_id_;                //< Indirect Dispatch / Draw buffer.
-  GLuint dp_texture_id_;                          //< DotProduct float texture.
-  GLuint indices_texture_ids_[2];                     //< indices unsigned int texture (for sorting).
+  GLuint dp_texture_id_;                          //< Buffer texture over the depth keys of the culling.
+  GLuint indices_texture_ids_[2];                     //< Sort keys, depth and index packed (for sorting).
+  GLuint sorted_texture_id_;                          //< Indices unpacked by the last sort pass.
 
   GLuint texture_width_1;
   GLuint texture_height_1;
-  GLuint framebuffer_;
 
   GLuint sorted_indices_;                             //sorted indices buffer.
+  GLuint render_args_buffer_;                   //< Indirect draw of the visible particles.
+  GLuint cull_feedback_;                        //< Transform feedback backend : culling captured, drawn again from its count.
+  GLuint cull_queries_[kCullQueryCount];        //< Transform feedback backend : visible particles per culling, a ring.
+  unsigned int cull_query_first_;               //< Oldest culling not counted yet.
+  unsigned int cull_query_pending_;             //< Cullings not counted yet.
+  GLuint visible_count_texture_id_;             //< Transform feedback backend : visible particles, counted on the device.
+  GLuint visible_count_framebuffer_;
+  GLuint vao_k_;                                //< Transform feedback backend : depth keys of the culled particles, counted.
 
   GLuint vao_e_[1];//VAO for emission
-  GLuint vao_s_[2];//VAO for simulation
-  GLuint vao_c_[2];//VAO for calculating dp
-  GLuint vao_[2];                                  //< VAOs rendering.
+  GLuint emitters_ubo_;                             //< emitters of the current batch.
+  GLuint vao_s_[AppendConsumeBuffer::kNumBuffers];//VAO for simulation, per buffer of the ring
+  GLuint vao_c_[AppendConsumeBuffer::kNumBuffers];//VAO for culling
+  GLuint vao_;                                     //< VAO rendering the culled particles.
   GLuint vao_f_;
+  GLuint vao_g_[AppendConsumeBuffer::kNumBuffers]; //< VAOs building the grid and listing dead slots.
+  GLuint vao_gk_[2][kGridPartitionCount];          //< Neighbours grid : keys partitioned, per stream, ping-pong.
   GLuint query_time_;                           //< QueryObject for benchmarking.
+  GLuint sort_queries_[2];                      //< Timestamps before and after the sort.
 
-  GLuint vbo_;
+  unsigned int frame_index_;                    //< Simulation frame, keys the shaders random numbers.
+  unsigned int random_seed_;                    //< Seed of the shaders random numbers.
+
+  struct {
+    mat4x4 view;
+    mat4x4 view_proj;
+    vec4 frustum_planes[6];                     //< World space, normals pointing inside.
+    float depth_scale;                          //< Maps the visible depths to the 16 bits of the sort keys.
+  } camera_;                                    //< Camera of the last update.
+  mat4x4 sorted_view_;                          //< Camera of the last sort.
+
+  float simulation_timestep_;                   //< Fixed duration of a simulation step.
+  float time_accumulator_;                      //< Elapsed time not simulated yet, less than a step.
+  unsigned int max_substeps_;                   //< Max simulation steps per update.
+
+  GLuint vbo_;                                  //< Depth keys of the culled particles.
+  GLuint culled_vbo_;                           //< Visible particles, in culling order.
   GLuint vbo_f_;
 
-  GLuint framebuf[2];
-  GLuint framebuffer1_;
+  GLuint framebuf[2];                           //< Sort passes, writing keys texture 1 then 0.
+  GLuint framebuffer1_;                         //< Last sort pass, writing the sorted texture.
+
+  GLuint oit_framebuffer_;                      //< Weighted blended : sprites accumulated over the viewport.
+  GLuint oit_texture_ids_[2];                   //< Weighted blended : accumulation, then revealage.
+  GLsizei oit_width_;
+  GLsizei oit_height_;
+
+  GLuint grid_sums_texture_ids_[kGridScanLevelCount];   //< Count per cell, then sums of the groups of each level.
+  GLuint grid_starts_texture_ids_[kGridScanLevelCount]; //< Range per cell, then first slot of the groups of each level.
+  GLuint grid_framebuffer_;
+  GLuint particles_texture_id_;                 //< Buffer texture over the particles read by the simulation.
+  GLuint grid_indices_buffer_;                  //< Particle indices sorted by cell.
+  GLuint grid_indices_texture_id_;              //< Transform feedback backend : buffer texture over the indices.
+  GLuint grid_keys_buffers_[2][kGridPartitionCount]; //< Transform feedback backend : keys partitioned per stream.
+  GLuint grid_feedbacks_[2];                    //< Transform feedback backend : partitions, drawn again per stream.
+
+  GLuint dead_slots_buffer_;                    //< Stable storage : dead slots, by increasing index.
+  GLuint dead_slots_texture_id_;                //< Buffer texture over the dead slots.
+  GLuint emit_map_texture_id_;                  //< Stable storage : batch index plus one of the newborn of each slot.
+  GLuint emit_map_framebuffer_;
+  GLuint dead_list_queries_[kDeadListQueryCount];  //< Stable storage : slots listed per step, a ring.
+  struct {
+    unsigned int slot_count;                    //< Slots used before the step.
+    unsigned int range;                         //< Slots listed, fresh ones included.
+    unsigned int emit_count;
+  } dead_lists_[kDeadListQueryCount];
+
+  unsigned int emitted_since_readback_;         //< Particles emitted after the counts copy.
+  bool readback_inversions_;                    //< True if the counts copied hold the inversions measured.
+  bool readback_disorder_;                      //< True if the counts copied hold the disorder measured.
 
   float simulation_box_size_;                   //< Boundary used by the simulation, if any.
+  float interaction_radius_;                    //< Distance of the particles interactions.
+  float repulsion_;
+  float cohesion_;
+  float target_attraction_;                     //< Pull toward the anchors.
+  float cull_margin_;                           //< Bounding radius of a rendered particle.
+  float cull_distance_;                         //< Max distance to the camera of a rendered particle.
+  float lod_distance_;                          //< Distance from which particles are simulated at low detail.
+  unsigned int lod_period_;                     //< Steps between two updates of a low detail particle.
+  unsigned int curl_noise_period_;              //< Steps between two curl noise evaluations of a particle, 0 without.
+  unsigned int sort_stages_per_pass_;           //< Bitonic stages fused in a fragment pass.
+  BlendMode blend_mode_;
+  SortMode sort_mode_;
+  unsigned int sort_bucket_count_;              //< Depth buckets of the approximate sort.
+  unsigned int sort_tile_grid_;                 //< Screen tiles per side of the tiles sort.
+  unsigned int sort_pass_count_;                //< Passes of the last sort.
+  float sort_time_;                             //< Device time of the last sort, in ms.
+
+  GLuint culled_ids_buffer_;                    //< Storage index of the visible particles, in culling order.
+  GLuint hidden_ids_buffer_;                    //< Storage index of the culled out particles.
+  GLuint sort_order_buffer_;                    //< Storage index of the alive particles, in sorted order.
+  GLuint vao_o_;                                //< VAO gathering the storage index of the sorted particles.
+  GLuint vao_h_;                                //< VAO gathering the storage index of the culled out particles.
+  GLuint inversions_query_;                     //< Inversions of the last refined order.
+  unsigned int sorted_alive_count_;             //< Alive particles when last sorted.
+  unsigned int inversions_visible_count_;       //< Visible particles of the order measured by the query.
+  unsigned int sort_inversion_count_;
+  unsigned int sort_full_backoff_;              //< Full sorts left before refining again.
+  unsigned int sort_deferred_count_;            //< Full sorts over budget refined instead, in a row.
+  float sort_inversion_threshold_;              //< Ratio of inversions triggering a full sort.
+  bool sort_order_pending_;                     //< True if the next simulation writes in sorted order.
+  bool sort_order_carried_;                     //< True if the particles are stored in a previous sorted order.
+  bool inversions_query_pending_;
+  bool sort_full_;
+
+  GLuint identity_indices_;                     //< Indices of the carried order, kept by a skipped sort.
+  GLuint disorder_query_;                       //< Particles out of place in the carried order.
+  GLuint budget_queries_[2];                    //< Timestamps around the passes of a budgeted sort.
+  unsigned int disorder_visible_count_;         //< Visible particles of the order measured by the query.
+  unsigned int emitted_since_sort_;             //< Particles emitted after the last sort, appended to the carried order.
+  unsigned int sorted_visible_count_;           //< Visible particles when last sorted.
+  unsigned int sort_skip_count_;                //< Sorts skipped in a row.
+  unsigned int sort_refine_parity_;             //< Side of the next refine merge.
+  unsigned int sort_refine_rounds_;
+  unsigned int budget_query_passes_;            //< Passes between the budget timestamps.
+  float sort_skip_threshold_;                   //< Ratio of particles out of place allowing a skip.
+  float sort_disorder_;                         //< Ratio of particles out of place in the last measured carried order.
+  float sort_time_budget_;                      //< Device time of a sort in ms, 0 for none.
+  float sort_pass_time_;                        //< Average device time of a sort pass in ms, 0 until measured.
+  bool disorder_query_pending_;
+  bool budget_query_pending_;
+  bool sort_skipped_;
+
+  BucketDepthSort bucket_sort_;
+  TileDepthSort tile_sort_;
+  ComputeDepthSort compute_sort_;
+  HostDepthSort host_sort_;
 
   bool simulated_;
+  bool slots_reset_;                            //< True if the queue of dead slots is emptied next step.
+  bool sorted_;                                 //< True if the last culled particles were sorted.
+  bool sort_tiled_;                             //< True if they were sorted per screen tile.
 
   bool enable_sorting_;                         //< True if back-to-front sort is enabled.
   bool enable_vectorfield_;                     //< True if the vector field is used.
+  bool enable_interpolation_;                   //< True if rendered positions are interpolated between steps.
+  bool enable_fused_emission_;                  //< True if newborns are created by the simulation pass.
+  bool enable_interactions_;                    //< True if particles repulse and attract their neighbours.
+  bool enable_culling_;                         //< True if particles out of view are discarded before sorting.
+  bool enable_stable_slots_;                    //< True if particles stay in their slot, dead ones included.
+  bool enable_sort_timing_;                     //< True if the sort is timed.
+  bool enable_incremental_sort_;                //< True if the sort refines the previous order.
+  bool enable_sort_skipping_;                   //< True if the carried order is kept while it barely changes.
 };
 
 #endif //API_GPU_PARTICLE_H
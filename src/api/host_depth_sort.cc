@@ -0,0 +1,312 @@
+#include "api/host_depth_sort.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+unsigned int const HostDepthSort::kNumBuffers;
+
+namespace {
+  //digits of the radix passes, least significant first.
+  unsigned int const kRadixBits = 8u;
+  unsigned int const kRadixSize = 1u << kRadixBits;
+  uint32_t const kRadixMask = kRadixSize - 1u;
+
+  //below this count, threads cost more than they save.
+  unsigned int const kMinKeysPerThread = 1u << 13u;
+
+  //the count precedes the keys in the readback buffers.
+  GLintptr const kKeysOffset = sizeof(GLuint);
+
+  //float bits as an unsigned integer decreasing with the depth : increasing
+  //keys sort the farthest particle first.
+  uint32_t GetSortKey(float const depth) {
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    uint32_t const mask = (bits & 0x80000000u) ? 0xffffffffu : 0x80000000u;
+    return ~(bits ^ mask);
+  }
+
+  //threads of a sort meeting between its phases.
+  class Barrier {
+  public:
+    explicit Barrier(unsigned int const count):
+        count_(count),
+        waiting_(0u),
+        generation_(0u)
+        {}
+
+    void wait() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      unsigned int const generation = generation_;
+      if (++waiting_ == count_) {
+        waiting_ = 0u;
+        ++generation_;
+        condition_.notify_all();
+      } else {
+        condition_.wait(lock, [&] { return generation != generation_; });
+      }
+    }
+
+  private:
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    unsigned int const count_;
+    unsigned int waiting_;
+    unsigned int generation_;
+  };
+
+  //LSD radix sort shared by its threads, each one owning a chunk of keys.
+  struct TRadixSort {
+    TRadixSort(unsigned int const nthreads):
+        barrier(nthreads),
+        histograms(nthreads * kRadixSize),
+        skip_pass(false),
+        result(0u),
+        pass_count(0u)
+        {}
+
+    float const *depths;
+    unsigned int count;
+    unsigned int chunk_size;
+    uint32_t *keys[2u];
+    uint16_t *indices[2u];
+
+    Barrier barrier;
+    std::vector<unsigned int> histograms;   //< per thread, then first slots of its digits.
+    bool skip_pass;                         //< every key has the same digit.
+    unsigned int result;                    //< buffers holding the sorted keys.
+    unsigned int pass_count;
+  };
+
+  void RadixSortChunk(TRadixSort &sort, unsigned int const thread, unsigned int const nthreads) {
+    unsigned int const first = std::min(thread * sort.chunk_size, sort.count);
+    unsigned int const last = std::min(first + sort.chunk_size, sort.count);
+    unsigned int *histogram = &sort.histograms[thread * kRadixSize];
+
+    for (unsigned int i = first; i < last; ++i) {
+      sort.keys[0u][i] = GetSortKey(sort.depths[i]);
+      sort.indices[0u][i] = static_cast<uint16_t>(i);
+    }
+
+    unsigned int src = 0u;
+    for (unsigned int shift = 0u; shift < 32u; shift += kRadixBits) {
+      std::fill(histogram, histogram + kRadixSize, 0u);
+      for (unsigned int i = first; i < last; ++i) {
+        ++histogram[(sort.keys[src][i] >> shift) & kRadixMask];
+      }
+      sort.barrier.wait();
+
+      //first slot of each digit of each chunk, chunks in order keep the
+      //sort stable.
+      if (thread == 0u) {
+        unsigned int sum = 0u;
+        sort.skip_pass = false;
+        for (unsigned int digit = 0u; digit < kRadixSize; ++digit) {
+          unsigned int const digit_first = sum;
+          for (unsigned int t = 0u; t < nthreads; ++t) {
+            unsigned int const count = sort.histograms[t * kRadixSize + digit];
+            sort.histograms[t * kRadixSize + digit] = sum;
+            sum += count;
+          }
+          sort.skip_pass |= (sum - digit_first == sort.count);
+        }
+      }
+      sort.barrier.wait();
+
+      if (sort.skip_pass) {
+        continue;
+      }
+      for (unsigned int i = first; i < last; ++i) {
+        uint32_t const key = sort.keys[src][i];
+        unsigned int const slot = histogram[(key >> shift) & kRadixMask]++;
+        sort.keys[src ^ 1u][slot] = key;
+        sort.indices[src ^ 1u][slot] = sort.indices[src][i];
+      }
+      src ^= 1u;
+      if (thread == 0u) {
+        ++sort.pass_count;
+      }
+      //the next pass reads keys scattered by every thread.
+      sort.barrier.wait();
+    }
+
+    if (thread == 0u) {
+      sort.result = src;
+    }
+  }
+} //namespace
+
+void HostDepthSort::initialize(unsigned int const max_count, GLsizeiptr const attribs_stride) {
+  max_count_ = max_count;
+  attribs_stride_ = attribs_stride;
+
+  glGenBuffers(kNumBuffers, keys_buffer_ids_);
+  glGenBuffers(kNumBuffers, attribs_buffer_ids_);
+  for (unsigned int i = 0u; i < kNumBuffers; ++i) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, keys_buffer_ids_[i]);
+      glBufferData(GL_COPY_WRITE_BUFFER, kKeysOffset + max_count_ * sizeof(GLfloat), nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, attribs_buffer_ids_[i]);
+      glBufferData(GL_COPY_WRITE_BUFFER, max_count_ * attribs_stride_, nullptr, GL_DYNAMIC_COPY);
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0u);
+
+  for (unsigned int i = 0u; i < 2u; ++i) {
+    keys_[i].resize(max_count_);
+    indices_[i].resize(max_count_);
+  }
+
+  CHECKGLERROR();
+}
+
+void HostDepthSort::deinitialize() {
+  reset();
+  glDeleteBuffers(kNumBuffers, keys_buffer_ids_);
+  glDeleteBuffers(kNumBuffers, attribs_buffer_ids_);
+}
+
+void HostDepthSort::reset() {
+  for (unsigned int i = 0u; i < kNumBuffers; ++i) {
+    if (fences_[i]) {
+      glDeleteSync(fences_[i]);
+      fences_[i] = nullptr;
+    }
+  }
+  next_ = 0u;
+  pending_count_ = 0u;
+  displayed_ = kNumBuffers;
+  displayed_count_ = 0u;
+}
+
+void HostDepthSort::sort(GLuint const keys_buffer, GLuint const attribs_buffer,
+                         GLuint const count_buffer, unsigned int const max_count,
+                         GLuint const indices_buffer) {
+  //the device is a full ring behind : skip this culling rather than wait.
+  unsigned int const used = pending_count_ + ((displayed_ < kNumBuffers) ? 1u : 0u);
+  if (used < kNumBuffers) {
+    _capture(keys_buffer, attribs_buffer, count_buffer, max_count);
+  }
+
+  //last capture copied, the fences signal in order.
+  unsigned int ready = 0u;
+  while (ready < pending_count_) {
+    GLsync const fence = fences_[(next_ + ready) % kNumBuffers];
+    GLbitfield const flags = (ready == 0u) ? GL_SYNC_FLUSH_COMMANDS_BIT : 0u;
+    if (GL_TIMEOUT_EXPIRED == glClientWaitSync(fence, flags, 0u)) {
+      break;
+    }
+    ++ready;
+  }
+
+  //nothing to draw yet.
+  if ((ready == 0u) && (displayed_ == kNumBuffers) && (pending_count_ > 0u)) {
+    GLsync const fence = fences_[(next_ + pending_count_ - 1u) % kNumBuffers];
+    while (GL_TIMEOUT_EXPIRED == glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000u)) {}
+    ready = pending_count_;
+  }
+
+  if (ready > 0u) {
+    //older captures are dropped.
+    for (unsigned int i = 0u; i < ready; ++i) {
+      unsigned int const slot = (next_ + i) % kNumBuffers;
+      glDeleteSync(fences_[slot]);
+      fences_[slot] = nullptr;
+    }
+    unsigned int const slot = (next_ + ready - 1u) % kNumBuffers;
+    next_ = (next_ + ready) % kNumBuffers;
+    pending_count_ -= ready;
+
+    _sort_capture(slot, indices_buffer);
+    displayed_ = slot;
+  }
+
+  //particles of the sorted capture, over the last culling.
+  if (displayed_ < kNumBuffers) {
+    glBindBuffer(GL_COPY_READ_BUFFER, attribs_buffer_ids_[displayed_]);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, attribs_buffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, displayed_count_ * attribs_stride_);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0u);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, count_buffer);
+      glBufferSubData(GL_COPY_WRITE_BUFFER, 0, sizeof(GLuint), &displayed_count_);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0u);
+  }
+
+  CHECKGLERROR();
+}
+
+void HostDepthSort::_capture(GLuint const keys_buffer, GLuint const attribs_buffer,
+                             GLuint const count_buffer, unsigned int const max_count) {
+  unsigned int const slot = (next_ + pending_count_) % kNumBuffers;
+  unsigned int const count = std::min(max_count, max_count_);
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, keys_buffer_ids_[slot]);
+  glBindBuffer(GL_COPY_READ_BUFFER, count_buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint));
+  if (count > 0u) {
+    glBindBuffer(GL_COPY_READ_BUFFER, keys_buffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, kKeysOffset, count * sizeof(GLfloat));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, attribs_buffer_ids_[slot]);
+    glBindBuffer(GL_COPY_READ_BUFFER, attribs_buffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, count * attribs_stride_);
+  }
+  glBindBuffer(GL_COPY_READ_BUFFER, 0u);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0u);
+
+  fences_[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  capture_counts_[slot] = count;
+  ++pending_count_;
+
+  CHECKGLERROR();
+}
+
+void HostDepthSort::_sort_capture(unsigned int const slot, GLuint const indices_buffer) {
+  auto const start = std::chrono::steady_clock::now();
+
+  glBindBuffer(GL_COPY_READ_BUFFER, keys_buffer_ids_[slot]);
+  GLsizeiptr const size = kKeysOffset + capture_counts_[slot] * sizeof(GLfloat);
+  GLubyte const *data = (GLubyte const*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, GL_MAP_READ_BIT);
+
+  GLuint count = 0u;
+  std::memcpy(&count, data, sizeof(count));
+  count = std::min(count, capture_counts_[slot]);
+
+  //split the keys in chunks, one per thread.
+  unsigned int const max_threads = std::max(1u, std::thread::hardware_concurrency());
+  unsigned int const nthreads = std::max(1u, std::min(max_threads, count / kMinKeysPerThread));
+
+  TRadixSort radix_sort(nthreads);
+  radix_sort.depths = reinterpret_cast<float const*>(data + kKeysOffset);
+  radix_sort.count = count;
+  radix_sort.chunk_size = (count + nthreads - 1u) / nthreads;
+  for (unsigned int i = 0u; i < 2u; ++i) {
+    radix_sort.keys[i] = keys_[i].data();
+    radix_sort.indices[i] = indices_[i].data();
+  }
+
+  std::vector<std::thread> workers;
+  workers.reserve(nthreads - 1u);
+  for (unsigned int t = 1u; t < nthreads; ++t) {
+    workers.emplace_back(RadixSortChunk, std::ref(radix_sort), t, nthreads);
+  }
+  RadixSortChunk(radix_sort, 0u, nthreads);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  glUnmapBuffer(GL_COPY_READ_BUFFER);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0u);
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, indices_buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, count * sizeof(GLushort), indices_[radix_sort.result].data());
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0u);
+
+  displayed_count_ = count;
+  pass_count_ = radix_sort.pass_count;
+  sort_time_ = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  CHECKGLERROR();
+}
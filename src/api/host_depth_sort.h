@@ -0,0 +1,78 @@
+#ifndef API_HOST_DEPTH_SORT_H_
+#define API_HOST_DEPTH_SORT_H_
+
+#include <vector>
+#include "opengl.h"
+
+///
+/// Back-to-front sort of the visible particles on the host.
+///
+/// The depth keys, the count and the attributes of the visible particles
+/// written by a culling are copied on the device to the next buffer of a
+/// fenced ring. Once the copy is signaled, the keys are read back and sorted
+/// by a parallel LSD radix sort on their bits, and the indices uploaded.
+///
+/// The copied attributes are restored along with them : the order drawn is
+/// exact, for particles one frame or more behind the simulation.
+///
+class HostDepthSort {
+public:
+  static unsigned int const kNumBuffers = 3u;
+
+  HostDepthSort():
+      max_count_(0u),
+      attribs_stride_(0),
+      keys_buffer_ids_{0u, 0u, 0u},
+      attribs_buffer_ids_{0u, 0u, 0u},
+      fences_{nullptr, nullptr, nullptr},
+      capture_counts_{0u, 0u, 0u},
+      next_(0u),
+      pending_count_(0u),
+      displayed_(kNumBuffers),
+      displayed_count_(0u),
+      sort_time_(0.0f),
+      pass_count_(0u)
+      {}
+
+  void initialize(unsigned int const max_count, GLsizeiptr const attribs_stride);
+  void deinitialize();
+
+  //copy the keys of the last culling and its particles, count_buffer starting
+  //with their count, bounded by max_count. Then sort the last signaled copy,
+  //waiting for one when none is drawn yet : write its indices as GLushort
+  //and restore its particles and count, to be drawn.
+  void sort(GLuint const keys_buffer, GLuint const attribs_buffer,
+            GLuint const count_buffer, unsigned int const max_count,
+            GLuint const indices_buffer);
+
+  //drop the pending captures and the displayed one.
+  void reset();
+
+  //host time of the last sort in milliseconds, from the readback to the
+  //upload, and its radix passes.
+  float sort_time() const { return sort_time_; }
+  unsigned int pass_count() const { return pass_count_; }
+
+private:
+  void _capture(GLuint const keys_buffer, GLuint const attribs_buffer,
+                GLuint const count_buffer, unsigned int const max_count);
+  void _sort_capture(unsigned int const slot, GLuint const indices_buffer);
+
+  unsigned int max_count_;
+  GLsizeiptr attribs_stride_;
+  GLuint keys_buffer_ids_[kNumBuffers];       //< count, then the keys.
+  GLuint attribs_buffer_ids_[kNumBuffers];
+  GLsync fences_[kNumBuffers];                //< end of the copies of a pending capture.
+  unsigned int capture_counts_[kNumBuffers];  //< keys copied, an upper bound of the count.
+  unsigned int next_;                         //< oldest pending capture.
+  unsigned int pending_count_;
+  unsigned int displayed_;                    //< capture drawn, kNumBuffers if none.
+  unsigned int displayed_count_;              //< particles of the capture drawn.
+
+  std::vector<unsigned int> keys_[2u];        //< ping-pong of the radix passes.
+  std::vector<unsigned short> indices_[2u];
+  float sort_time_;
+  unsigned int pass_count_;
+};
+
+#endif // API_HOST_DEPTH_SORT_H_
@@ -0,0 +1,176 @@
+#include "api/tile_depth_sort.h"
+
+#include "shaders/sparkle/interop.h"
+
+#include <algorithm>
+
+namespace {
+  GLuint GetThreadsGroupCount(unsigned int const nthreads) {
+    return (nthreads + PARTICLES_KERNEL_GROUP_WIDTH - 1u) / PARTICLES_KERNEL_GROUP_WIDTH;
+  }
+
+  //first pixel of a screen tile along a side of the viewport : pixels belong
+  //to the tile holding their center, as binned by the kernels.
+  GLint GetTileEdge(GLint const size, GLuint const tile, GLuint const grid) {
+    return static_cast<GLint>((2u * size * tile + grid - 1u) / (2u * grid));
+  }
+} //namespace
+
+void TileDepthSort::initialize(unsigned int const capacity, unsigned int const max_grid) {
+  capacity_ = capacity;
+
+  char *src_buffer = new char[MAX_SHADER_BUFFERSIZE]();
+  pgm_.histogram = CompileComputeProgram(SHADERS_DIR "/sparkle/cs_tile_histogram.glsl", src_buffer);
+  LinkProgram(pgm_.histogram, SHADERS_DIR "/sparkle/cs_tile_histogram.glsl");
+
+  //the tile counts are scanned as buckets.
+  pgm_.scan = CompileComputeProgram(SHADERS_DIR "/sparkle/cs_bucket_scan.glsl", src_buffer);
+  LinkProgram(pgm_.scan, SHADERS_DIR "/sparkle/cs_bucket_scan.glsl");
+
+  pgm_.scatter = CompileComputeProgram(SHADERS_DIR "/sparkle/cs_tile_scatter.glsl", src_buffer);
+  LinkProgram(pgm_.scatter, SHADERS_DIR "/sparkle/cs_tile_scatter.glsl");
+
+  pgm_.sort = CompileComputeProgram(SHADERS_DIR "/sparkle/cs_tile_sort.glsl", src_buffer);
+  LinkProgram(pgm_.sort, SHADERS_DIR "/sparkle/cs_tile_sort.glsl");
+  delete[] src_buffer;
+
+  ulocation_.histogram.view = GetUniformLocation(pgm_.histogram, "uView");
+  ulocation_.histogram.viewProj = GetUniformLocation(pgm_.histogram, "uViewProj");
+  ulocation_.histogram.tileGrid = GetUniformLocation(pgm_.histogram, "uTileGrid");
+  ulocation_.histogram.timeStep = GetUniformLocation(pgm_.histogram, "uTimeStep");
+  ulocation_.scan.bucketCount = GetUniformLocation(pgm_.scan, "uBucketCount");
+  ulocation_.scatter.view = GetUniformLocation(pgm_.scatter, "uView");
+  ulocation_.scatter.viewProj = GetUniformLocation(pgm_.scatter, "uViewProj");
+  ulocation_.scatter.tileGrid = GetUniformLocation(pgm_.scatter, "uTileGrid");
+  ulocation_.scatter.timeStep = GetUniformLocation(pgm_.scatter, "uTimeStep");
+  ulocation_.scatter.depthScale = GetUniformLocation(pgm_.scatter, "uDepthScale");
+  ulocation_.scatter.capacity = GetUniformLocation(pgm_.scatter, "uCapacity");
+  ulocation_.sort.capacity = GetUniformLocation(pgm_.sort, "uCapacity");
+
+  //count, then first slot, of each tile list.
+  glGenBuffers(1u, &counts_buffer_id_);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, counts_buffer_id_);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_SORT_BUCKET_COUNT * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+
+  //lists of the tiles, back to back : a sprite is listed once per tile it
+  //overlaps, up to the capacity.
+  glGenBuffers(1u, &tiles_buffer_id_);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, tiles_buffer_id_);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, capacity_ * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+
+  //draw arguments of each tile list, its first element and count.
+  glGenBuffers(1u, &args_buffer_id_);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, args_buffer_id_);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, max_grid * max_grid * sizeof(TDrawElementsArgs),
+               nullptr, GL_DYNAMIC_COPY);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0u);
+
+  CHECKGLERROR();
+}
+
+void TileDepthSort::deinitialize() {
+  glDeleteProgram(pgm_.histogram);
+  glDeleteProgram(pgm_.scan);
+  glDeleteProgram(pgm_.scatter);
+  glDeleteProgram(pgm_.sort);
+  glDeleteBuffers(1u, &counts_buffer_id_);
+  glDeleteBuffers(1u, &tiles_buffer_id_);
+  glDeleteBuffers(1u, &args_buffer_id_);
+}
+
+void TileDepthSort::sort(GLuint const keys_buffer, GLuint const culled_buffer, GLuint const draw_args_buffer,
+                         unsigned int const max_count, mat4x4 const &view, mat4x4 const &view_proj,
+                         float const depth_scale, float const time_step, unsigned int const grid) {
+  GLuint const tile_count = grid * grid;
+  GLuint const zero = 0u;
+
+  //tile counts are accumulated.
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, counts_buffer_id_);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0u);
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_DOT_PRODUCTS, keys_buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_CULLED_PARTICLES, culled_buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_SORT_BUCKETS, counts_buffer_id_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_SORT_TILES, tiles_buffer_id_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_TILE_DRAW_ARGS, args_buffer_id_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_DRAW_ARGS, draw_args_buffer);
+
+  //sized from the upper bound, the visible count is only known on the device.
+  GLuint const ngroups = GetThreadsGroupCount(std::max(1u, max_count));
+
+  glUseProgram(pgm_.histogram);
+  {
+    glUniformMatrix4fv(ulocation_.histogram.view, 1, GL_FALSE, (GLfloat const*) view);
+    glUniformMatrix4fv(ulocation_.histogram.viewProj, 1, GL_FALSE, (GLfloat const*) view_proj);
+    glUniform1ui(ulocation_.histogram.tileGrid, grid);
+    glUniform1f(ulocation_.histogram.timeStep, time_step);
+    glDispatchCompute(ngroups, 1u, 1u);
+  }
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  glUseProgram(pgm_.scan);
+  {
+    glUniform1ui(ulocation_.scan.bucketCount, tile_count);
+    glDispatchCompute(1u, 1u, 1u);
+  }
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  glUseProgram(pgm_.scatter);
+  {
+    glUniformMatrix4fv(ulocation_.scatter.view, 1, GL_FALSE, (GLfloat const*) view);
+    glUniformMatrix4fv(ulocation_.scatter.viewProj, 1, GL_FALSE, (GLfloat const*) view_proj);
+    glUniform1ui(ulocation_.scatter.tileGrid, grid);
+    glUniform1f(ulocation_.scatter.timeStep, time_step);
+    glUniform1f(ulocation_.scatter.depthScale, depth_scale);
+    glUniform1ui(ulocation_.scatter.capacity, capacity_);
+    glDispatchCompute(ngroups, 1u, 1u);
+  }
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  //a group per tile, each one sorting its list.
+  glUseProgram(pgm_.sort);
+  {
+    glUniform1ui(ulocation_.sort.capacity, capacity_);
+    glDispatchCompute(tile_count, 1u, 1u);
+  }
+  glUseProgram(0u);
+  grid_ = grid;
+
+  //tile lists are next read as elements, with their draw arguments.
+  glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+  CHECKGLERROR();
+}
+
+void TileDepthSort::draw() const {
+  GLint viewport[4] = {0, 0, 0, 0};
+  GLint scissor_box[4] = {0, 0, 0, 0};
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  glGetIntegerv(GL_SCISSOR_BOX, scissor_box);
+  GLboolean const scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+
+  //the tile lists index the culled particles with 32 bits elements.
+  glEnable(GL_SCISSOR_TEST);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, tiles_buffer_id_);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, args_buffer_id_);
+  for (GLuint y = 0u; y < grid_; ++y) {
+    GLint const y0 = GetTileEdge(viewport[3], y, grid_);
+    GLint const y1 = GetTileEdge(viewport[3], y + 1u, grid_);
+    for (GLuint x = 0u; x < grid_; ++x) {
+      GLint const x0 = GetTileEdge(viewport[2], x, grid_);
+      GLint const x1 = GetTileEdge(viewport[2], x + 1u, grid_);
+      glScissor(viewport[0] + x0, viewport[1] + y0, x1 - x0, y1 - y0);
+
+      GLintptr const offset = (y * grid_ + x) * sizeof(TDrawElementsArgs);
+      glDrawElementsIndirect(GL_POINTS, GL_UNSIGNED_INT, reinterpret_cast<void*>(offset));
+    }
+  }
+
+  glScissor(scissor_box[0], scissor_box[1], scissor_box[2], scissor_box[3]);
+  if (!scissor_test) {
+    glDisable(GL_SCISSOR_TEST);
+  }
+
+  CHECKGLERROR();
+}
@@ -0,0 +1,92 @@
+#ifndef API_TILE_DEPTH_SORT_H_
+#define API_TILE_DEPTH_SORT_H_
+
+#include "opengl.h"
+#include "linmath.h"
+
+///
+/// Back-to-front sort of the visible particles per screen tile, by compute
+/// kernels.
+///
+/// The viewport is split in a grid of tiles, each visible sprite being listed
+/// in every tile its bounds overlap : the lists are counted, scanned, then
+/// filled with the depth keys of their sprites. A kernel group per tile sorts
+/// its list on its own, the largest sort following the density of a tile
+/// instead of the visible count. Past the capacity of the lists, the frame
+/// falls back to a single list sorted by one group, drawn in every tile.
+///
+/// The lists are drawn scissored to their tile, with the view and projection
+/// of the sort.
+///
+class TileDepthSort {
+public:
+  TileDepthSort():
+      capacity_(0u),
+      pgm_{0u, 0u, 0u, 0u},
+      ulocation_{},
+      counts_buffer_id_(0u),
+      tiles_buffer_id_(0u),
+      args_buffer_id_(0u),
+      grid_(0u)
+      {}
+
+  //lists of capacity entries in all, over a grid of max_grid tiles per side.
+  void initialize(unsigned int const capacity, unsigned int const max_grid);
+  void deinitialize();
+
+  //list the culled particles of the culled and keys buffers in the tiles of
+  //a grid, then sort each list. Their count is read from the draw arguments
+  //on the device, bounded by max_count. The sprites are projected as drawn, a
+  //time step ahead along their velocity.
+  void sort(GLuint const keys_buffer, GLuint const culled_buffer, GLuint const draw_args_buffer,
+            unsigned int const max_count, mat4x4 const &view, mat4x4 const &view_proj,
+            float const depth_scale, float const time_step, unsigned int const grid);
+
+  //draw each list of the last sort over the pixels of its tile, from the
+  //bound vertex array : its element buffer is left to the lists.
+  void draw() const;
+
+  //tiles per side of the last sort, and its kernels.
+  unsigned int grid() const { return grid_; }
+  unsigned int pass_count() const { return 4u; }
+
+private:
+  unsigned int capacity_;
+
+  struct {
+    GLuint histogram;
+    GLuint scan;
+    GLuint scatter;
+    GLuint sort;
+  } pgm_;
+
+  struct {
+    struct {
+      GLint view;
+      GLint viewProj;
+      GLint tileGrid;
+      GLint timeStep;
+    } histogram;
+    struct {
+      GLint bucketCount;
+    } scan;
+    struct {
+      GLint view;
+      GLint viewProj;
+      GLint tileGrid;
+      GLint timeStep;
+      GLint depthScale;
+      GLint capacity;
+    } scatter;
+    struct {
+      GLint capacity;
+    } sort;
+  } ulocation_;
+
+  GLuint counts_buffer_id_;                   //< count then first slot of the tile lists, their total after them.
+  GLuint tiles_buffer_id_;                    //< lists of keys, then of indices, back to back.
+  GLuint args_buffer_id_;                     //< draw arguments of each tile list.
+  unsigned int grid_;
+};
+
+#endif // API_TILE_DEPTH_SORT_H_
@@ -99,7 +99,7 @@ void App::_frame() {
   _update_camera();
 
   //update scene (eg. particles simulation).
-  scene_.update(matrix_.view, deltatime_);
+  scene_.update(matrix_.view, matrix_.viewProj, deltatime_);
 
   // Compute window resolution from the main monitor's.
   float const scale = 2.0f / 3.0f;
@@ -88,8 +88,9 @@ void ReadShaderFile(char const *filename, unsigned int const maxsize, char out[]
   char include_path[256u] = {0};
   int include_len = 0u;
 
-  //prevent long recursive includes.
+  //prevent long recursive includes, the overflow being kept for the first call.
   if (*level <= 0) {
+    *level = -1;
     return;
   }
   --(*level);
@@ -109,7 +110,7 @@ void ReadShaderFile(char const *filename, unsigned int const maxsize, char out[]
     first += len;
     last  = strchr(first, '"');
     if (!last) {
-      return;
+      break;
     }
 
     //copy the include file name.
@@ -129,14 +130,18 @@ void ReadShaderFile(char const *filename, unsigned int const maxsize, char out[]
 
     //prevent first level recursivity.
     if (strcmp(include_path, filename) == 0) {
-      return;
+      break;
     }
 
     //create memory to hold the include file.
     char *include_file = (char*) calloc(maxsize, sizeof(char));
 
-    //retrieve the include file.
+    //retrieve the include file, the limit applies to the include depth.
     ReadShaderFile(include_path, maxsize, include_file, level);
+    if (*level < 0) {
+      free(include_file);
+      return;
+    }
 
     //add the line directive to the included file.
     sprintf(include_file, "%s\n#line %u", include_file, newline_count + 1u); //[incorrect]
@@ -151,21 +156,16 @@ void ReadShaderFile(char const *filename, unsigned int const maxsize, char out[]
     //free include file data.
     free(include_file);
   }
+
+  //back to the depth of the includer.
+  ++(*level);
 }
 
+//OpenGL 4.3 context, exposing the compute pipeline.
+static bool s_compute_supported = false;
+
 extern
 void InitGL() {
-  /*char const* s_extensions[] = {
-    "GL_ARB_compute_shader",
-    "GL_ARB_separate_shader_objects",
-    "GL_ARB_shader_image_load_store",
-    "GL_ARB_shader_storage_buffer_objects",
-    nullptr
-  };
-
-  //check if specific extensions exists.
-  //checkExtensions(s_extensions);*/
-
   #ifdef USE_GLEW
   //load glew
   glewExperimental = GL_TRUE;
@@ -180,6 +180,18 @@ void InitGL() {
   //load function pointers
   LoadExtensionFuncPtrs();
   #endif
+
+  //compute shaders, storage buffers and atomic counters are core since 4.3.
+  GLint major = 0;
+  GLint minor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  s_compute_supported = (major > 4) || ((major == 4) && (minor >= 3));
+}
+
+extern
+bool HasComputeShaderSupport() {
+  return s_compute_supported;
 }
 
 extern
@@ -230,6 +242,26 @@ GLuint CompileProgram(char const *vsfile, char const *gsfile, char const *fsfile
   return pgm;
 }
 
+extern
+GLuint CompileComputeProgram(char const *csfile, char *src_buffer) {
+  GLuint pgm = 0u;
+  GLuint cshader = 0u;
+
+  assert(csfile);
+  assert(src_buffer);
+
+  cshader = glCreateShader(GL_COMPUTE_SHADER);
+  ReadShaderFile(csfile, MAX_SHADER_BUFFERSIZE, src_buffer);
+  glShaderSource(cshader, 1, &src_buffer, nullptr);
+  glCompileShader(cshader);
+  CheckShaderStatus(cshader, csfile);
+
+  pgm = glCreateProgram();
+  glAttachShader(pgm, cshader); glDeleteShader(cshader);
+
+  return pgm;
+}
+
 extern
 void LinkProgram(GLuint pgm, char const* fsfile) {
 
@@ -26,12 +26,14 @@
 #define SHADERS_DIR   "../shaders"
 #endif
 
-//maximum size per shader file (with include). 64Ko.
-#define MAX_SHADER_BUFFERSIZE (64u * 1024u)
+//maximum size per shader file (with include). 128Ko.
+#define MAX_SHADER_BUFFERSIZE (128u * 1024u)
 
 void InitGL();
+bool HasComputeShaderSupport();
 GLuint CompileProgram(char const* vsfile, const char *gsfile, char const *fsfile, char *src_buffer);
 GLuint CompileProgram(char const *vsfile, char const *fsfile, char *src_buffer);
+GLuint CompileComputeProgram(char const *csfile, char *src_buffer);
 void LinkProgram(GLuint pgm, char const *fsfile);
 void CheckShaderStatus(GLuint shader, char const *name);
 bool CheckProgramStatus(GLuint program, char const *name);
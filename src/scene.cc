@@ -12,6 +12,19 @@ void Scene::init() {
   //init particles.
   gpu_particle_ = new GPUParticle();
   gpu_particle_->init();
+
+  //a plate of particles.
+  GPUParticle::Emitter plate;
+  plate.shape = GPUParticle::kEmitterDisk;
+  plate.rate = 32768.0f;
+  plate.velocity[0u] = 1.0f;
+  plate.velocity[2u] = 1.0f;
+  mat4x4 identity;
+  mat4x4_identity(identity);
+  mat4x4_scale_aniso(plate.transform, identity, 60.0f, 1.0f, 60.0f);
+  gpu_particle_->add_emitter(plate);
+  //alpha blended sprites, sorted back-to-front. Additive ones skip the sort.
+  gpu_particle_->blend_mode(GPUParticle::kBlendAlpha);
   //init geometry.
   setup_grid_geometry();
 
@@ -41,8 +54,8 @@ void Scene::deinit() {
   glDeleteBuffers(1u, &geo_.sphere.vbo);
 }
 
-void Scene::update(mat4x4 const &view, float const dt) {
-  gpu_particle_->update(dt, view);
+void Scene::update(mat4x4 const &view, mat4x4 const &viewProj, float const dt) {
+  gpu_particle_->update(dt, view, viewProj);
 }
 
 void Scene::render(mat4x4 const &view, mat4x4 const &viewProj) {
@@ -54,12 +67,8 @@ void Scene::render(mat4x4 const &view, mat4x4 const &viewProj) {
   glDisable(GL_BLEND);
   //draw_grid(viewProj);
 
-  //particle simulation.
+  //particle simulation, blended as set by its blend mode.
   glDisable(GL_DEPTH_TEST);
-  glEnable(GL_BLEND);
-  //glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  //gpu_particle_->enable_sorting(true);//sorting phase occur during update.so before here.
   gpu_particle_->render(view, viewProj);
 
   //bounding and test volumes.
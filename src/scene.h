@@ -16,7 +16,7 @@ public:
   void init();
   void deinit();
 
-  void update(mat4x4 const& view, float const dt);
+  void update(mat4x4 const& view, mat4x4 const& viewProj, float const dt);
   void render(mat4x4 const& view, mat4x4 const& viewProj);
 
 private:
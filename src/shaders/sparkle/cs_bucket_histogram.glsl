@@ -0,0 +1,35 @@
+#version 430 core
+
+// Depth buckets sort, compute backend : count the visible particles of each
+// depth bucket.
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_sort_key.glsl"
+
+layout(std430, binding = STORAGE_BINDING_DOT_PRODUCTS)
+readonly buffer DotProducts {
+  float dp[];
+};
+
+layout(std430, binding = STORAGE_BINDING_SORT_BUCKETS)
+buffer Buckets {
+  uint buckets[];
+};
+
+//number of visible particles, written by the culling.
+layout(std430, binding = STORAGE_BINDING_DRAW_ARGS)
+readonly buffer DrawArgs {
+  TDrawElementsArgs draw_args;
+};
+
+uniform uint uBucketBits;
+
+layout(local_size_x = PARTICLES_KERNEL_GROUP_WIDTH) in;
+void main() {
+  uint tid = gl_GlobalInvocationID.x;
+
+  if (tid < draw_args.count) {
+    uint bucket = GetSortBucket(PackSortKey(dp[tid], tid), uBucketBits);
+    atomicAdd(buckets[bucket], 1u);
+  }
+}
@@ -0,0 +1,36 @@
+#version 430 core
+
+// Depth buckets sort, compute backend : exclusive prefix sum of the buckets
+// counts, giving the first sorted slot of each bucket. A single group.
+
+#include "sparkle/interop.h"
+
+layout(std430, binding = STORAGE_BINDING_SORT_BUCKETS)
+buffer Buckets {
+  uint buckets[];
+};
+
+uniform uint uBucketCount;
+
+shared uint sums[MAX_SORT_BUCKET_COUNT];
+
+layout(local_size_x = MAX_SORT_BUCKET_COUNT) in;
+void main() {
+  uint tid = gl_LocalInvocationID.x;
+
+  uint count = (tid < uBucketCount) ? buckets[tid] : 0u;
+  sums[tid] = count;
+  barrier();
+
+  //inclusive sums, doubling the distance each step.
+  for (uint offset = 1u; offset < MAX_SORT_BUCKET_COUNT; offset <<= 1u) {
+    uint value = (tid >= offset) ? sums[tid - offset] : 0u;
+    barrier();
+    sums[tid] += value;
+    barrier();
+  }
+
+  if (tid < uBucketCount) {
+    buckets[tid] = sums[tid] - count;
+  }
+}
@@ -0,0 +1,43 @@
+#version 430 core
+
+// Depth buckets sort, compute backend : write the index of each visible
+// particle in the next slot of its bucket, the order within a bucket being
+// arbitrary. The slots are packed by pairs into the 16 bits element buffer
+// used by the rendering, cleared beforehand.
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_sort_key.glsl"
+
+layout(std430, binding = STORAGE_BINDING_DOT_PRODUCTS)
+readonly buffer DotProducts {
+  float dp[];
+};
+
+//first free slot of each bucket.
+layout(std430, binding = STORAGE_BINDING_SORT_BUCKETS)
+buffer Buckets {
+  uint buckets[];
+};
+
+layout(std430, binding = STORAGE_BINDING_SORTED_INDICES)
+buffer SortedIndices {
+  uint sorted_indices[];
+};
+
+layout(std430, binding = STORAGE_BINDING_DRAW_ARGS)
+readonly buffer DrawArgs {
+  TDrawElementsArgs draw_args;
+};
+
+uniform uint uBucketBits;
+
+layout(local_size_x = PARTICLES_KERNEL_GROUP_WIDTH) in;
+void main() {
+  uint tid = gl_GlobalInvocationID.x;
+
+  if (tid < draw_args.count) {
+    uint bucket = GetSortBucket(PackSortKey(dp[tid], tid), uBucketBits);
+    uint slot = atomicAdd(buckets[bucket], 1u);
+    atomicOr(sorted_indices[slot / 2u], tid << (16u * (slot & 1u)));
+  }
+}
@@ -0,0 +1,25 @@
+#version 430 core
+
+// Incremental sort, compute backend : mark the ranks of the visible particles
+// in the last sorted order, to be compacted by blocks.
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_sort_carry.glsl"
+
+//number of visible particles, written by the culling.
+layout(std430, binding = STORAGE_BINDING_DRAW_ARGS)
+readonly buffer DrawArgs {
+  TDrawElementsArgs draw_args;
+};
+
+layout(local_size_x = PARTICLES_KERNEL_GROUP_WIDTH) in;
+void main() {
+  uint tid = gl_GlobalInvocationID.x;
+
+  if (tid < draw_args.count) {
+    uint rank = GetCarriedRank(tid);
+    if (rank != SORT_RANK_NONE) {
+      rank_offsets[rank] = 1u;
+    }
+  }
+}
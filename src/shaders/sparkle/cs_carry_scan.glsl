@@ -0,0 +1,33 @@
+#version 430 core
+
+// Incremental sort, compute backend : exclusive prefix sum of the marked ranks
+// within each block of SORT_RANK_BLOCK_WIDTH ranks, one group per block. The
+// blocks totals are scanned next as sort buckets.
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_sort_carry.glsl"
+
+shared uint sums[SORT_RANK_BLOCK_WIDTH];
+
+layout(local_size_x = SORT_RANK_BLOCK_WIDTH) in;
+void main() {
+  uint tid = gl_LocalInvocationID.x;
+  uint rank = gl_GlobalInvocationID.x;
+
+  uint mark = rank_offsets[rank];
+  sums[tid] = mark;
+  barrier();
+
+  //inclusive sums, doubling the distance each step.
+  for (uint offset = 1u; offset < SORT_RANK_BLOCK_WIDTH; offset <<= 1u) {
+    uint value = (tid >= offset) ? sums[tid - offset] : 0u;
+    barrier();
+    sums[tid] += value;
+    barrier();
+  }
+
+  rank_offsets[rank] = sums[tid] - mark;
+  if (tid == SORT_RANK_BLOCK_WIDTH - 1u) {
+    rank_block_starts[gl_WorkGroupID.x] = sums[tid];
+  }
+}
@@ -0,0 +1,79 @@
+#version 430 core
+
+// ============================================================================
+
+/* Compute backend of the culling stage :
+ * - filter particles out of the view frustum or too far
+ * - append the visible ones and their depth keys, the count being the one
+ *   of the indirect draw. The keys are not stored when not sorted.
+ * - for the incremental sort, list the storage index of the visible ones,
+ *   the others losing their rank.
+ */
+
+// ============================================================================
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_culling.glsl"
+#include "sparkle/inc_sort_carry.glsl"
+
+layout(std430, binding = STORAGE_BINDING_PARTICLES_SECOND)
+readonly buffer Particles {
+  vec4 particles[];
+};
+
+//draw arguments of the particles written by the simulation.
+layout(std430, binding = STORAGE_BINDING_COUNTERS)
+readonly buffer Counters {
+  TDrawArraysArgs particles_args;
+};
+
+//CULLED_ATTRIB_BUFFER_COUNT vec4 per particle.
+layout(std430, binding = STORAGE_BINDING_CULLED_PARTICLES)
+writeonly buffer CulledParticles {
+  vec4 culled_particles[];
+};
+
+layout(std430, binding = STORAGE_BINDING_DOT_PRODUCTS)
+writeonly buffer DotProducts {
+  float dp[];
+};
+
+layout(binding = ATOMIC_COUNTER_BINDING_COUNTERS, offset = 0)
+uniform atomic_uint visible_count;
+
+uniform bool uStoreDepthKeys;
+uniform bool uCarryRanks;
+
+layout(local_size_x = PARTICLES_KERNEL_GROUP_WIDTH) in;
+void main() {
+  uint gid = gl_GlobalInvocationID.x;
+
+  if (gid >= particles_args.count) {
+    return;
+  }
+
+  uint first = PARTICLE_ATTRIB_BUFFER_COUNT * gid;
+  vec4 a = particles[first + 0u];
+  vec4 b = particles[first + 1u];
+  vec3 position = a.xyz;
+  vec3 velocity = vec3(a.w, b.xy);
+  vec2 age = b.zw;
+
+  float key = GetDepthKey(position);
+  if (CullParticle(position, velocity, age, key)) {
+    if (uCarryRanks) {
+      sort_ranks[gid] = SORT_RANK_NONE;
+    }
+    return;
+  }
+
+  uint id = atomicCounterIncrement(visible_count);
+  culled_particles[CULLED_ATTRIB_BUFFER_COUNT * id + 0u] = a;
+  culled_particles[CULLED_ATTRIB_BUFFER_COUNT * id + 1u] = b;
+  if (uStoreDepthKeys) {
+    dp[id] = key;
+  }
+  if (uCarryRanks) {
+    culled_ids[id] = gid;
+  }
+}
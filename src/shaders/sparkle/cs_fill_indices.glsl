@@ -0,0 +1,55 @@
+#version 430 core
+
+// fill the keys buffer with the depth key of each visible particle packed with
+// its index, used by the compute sort.
+//
+// Carried, the keys follow the last sorted order : each one is written to the
+// slot of its rank compacted, the particles without a rank after them.
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_sort_key.glsl"
+#include "sparkle/inc_sort_carry.glsl"
+
+layout(std430, binding = STORAGE_BINDING_DOT_PRODUCTS)
+readonly buffer DotProducts {
+  float dp[];
+};
+
+layout(std430, binding = STORAGE_BINDING_INDICES_FIRST)
+writeonly buffer Keys {
+  uint keys[];
+};
+
+//number of visible particles, written by the culling.
+layout(std430, binding = STORAGE_BINDING_DRAW_ARGS)
+readonly buffer DrawArgs {
+  TDrawElementsArgs draw_args;
+};
+
+uniform uint uCount;
+uniform bool uCarried;
+
+uint GetCarriedSlot(in uint tid) {
+  uint rank = GetCarriedRank(tid);
+  if (rank == SORT_RANK_NONE) {
+    uint last_block = (uRankCount + SORT_RANK_BLOCK_WIDTH - 1u) / SORT_RANK_BLOCK_WIDTH;
+    return rank_block_starts[last_block] + atomicAdd(unranked_count, 1u);
+  }
+  return rank_block_starts[rank / SORT_RANK_BLOCK_WIDTH] + rank_offsets[rank];
+}
+
+layout(local_size_x = PARTICLES_KERNEL_GROUP_WIDTH) in;
+void main() {
+  uint tid = gl_GlobalInvocationID.x;
+
+  if (tid >= uCount) {
+    return;
+  }
+
+  if (tid < draw_args.count) {
+    uint slot = (uCarried) ? GetCarriedSlot(tid) : tid;
+    keys[slot] = PackSortKey(dp[tid], tid);
+  } else {
+    keys[tid] = SORT_KEY_PADDING;
+  }
+}
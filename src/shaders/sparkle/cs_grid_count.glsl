@@ -0,0 +1,34 @@
+#version 430 core
+
+// Neighbours grid, compute backend : count the alive particles of each cell.
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_grid_cells.glsl"
+
+//particles read by the next simulation, PARTICLE_ATTRIB_BUFFER_COUNT vec4 each.
+layout(std430, binding = STORAGE_BINDING_PARTICLES_FIRST)
+readonly buffer Particles {
+  vec4 particles[];
+};
+
+//number of particles, appended by the last simulation.
+layout(std430, binding = STORAGE_BINDING_COUNTERS)
+readonly buffer Counters {
+  TDrawArraysArgs particles_args;
+};
+
+uniform float uBBoxSize;
+
+layout(local_size_x = PARTICLES_KERNEL_GROUP_WIDTH) in;
+void main() {
+  uint tid = gl_GlobalInvocationID.x;
+
+  if (tid < particles_args.count) {
+    uint first = PARTICLE_ATTRIB_BUFFER_COUNT * tid;
+    vec3 position = particles[first].xyz;
+    float age = particles[first + 1u].w;
+    if (age > 0.0f) {
+      atomicAdd(cell_counts[GetCellId(GetCell(position, uBBoxSize))], 1u);
+    }
+  }
+}
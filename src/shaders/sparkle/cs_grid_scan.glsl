@@ -0,0 +1,33 @@
+#version 430 core
+
+// Neighbours grid, compute backend : exclusive prefix sum of the cells counts
+// within each block of GRID_SCAN_BLOCK_WIDTH cells, one group per block. The
+// blocks totals are scanned next as sort buckets.
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_grid_cells.glsl"
+
+shared uint sums[GRID_SCAN_BLOCK_WIDTH];
+
+layout(local_size_x = GRID_SCAN_BLOCK_WIDTH) in;
+void main() {
+  uint tid = gl_LocalInvocationID.x;
+  uint cell_id = gl_GlobalInvocationID.x;
+
+  uint count = cell_counts[cell_id];
+  sums[tid] = count;
+  barrier();
+
+  //inclusive sums, doubling the distance each step.
+  for (uint offset = 1u; offset < GRID_SCAN_BLOCK_WIDTH; offset <<= 1u) {
+    uint value = (tid >= offset) ? sums[tid - offset] : 0u;
+    barrier();
+    sums[tid] += value;
+    barrier();
+  }
+
+  cell_ends[cell_id] = sums[tid] - count;
+  if (tid == GRID_SCAN_BLOCK_WIDTH - 1u) {
+    block_starts[gl_WorkGroupID.x] = sums[tid];
+  }
+}
@@ -0,0 +1,38 @@
+#version 430 core
+
+// Neighbours grid, compute backend : write the index and position of each
+// alive particle in the next slot of its cell, the order within a cell being
+// arbitrary.
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_grid_cells.glsl"
+
+//particles read by the next simulation, PARTICLE_ATTRIB_BUFFER_COUNT vec4 each.
+layout(std430, binding = STORAGE_BINDING_PARTICLES_FIRST)
+readonly buffer Particles {
+  vec4 particles[];
+};
+
+layout(std430, binding = STORAGE_BINDING_COUNTERS)
+readonly buffer Counters {
+  TDrawArraysArgs particles_args;
+};
+
+uniform float uBBoxSize;
+
+layout(local_size_x = PARTICLES_KERNEL_GROUP_WIDTH) in;
+void main() {
+  uint tid = gl_GlobalInvocationID.x;
+
+  if (tid < particles_args.count) {
+    uint first = PARTICLE_ATTRIB_BUFFER_COUNT * tid;
+    vec3 position = particles[first].xyz;
+    float age = particles[first + 1u].w;
+    if (age > 0.0f) {
+      uint cell_id = GetCellId(GetCell(position, uBBoxSize));
+      uint slot = block_starts[cell_id / GRID_SCAN_BLOCK_WIDTH] + atomicAdd(cell_ends[cell_id], 1u);
+      grid_indices[slot] = tid;
+      grid_positions[slot] = vec4(position, 0.0f);
+    }
+  }
+}
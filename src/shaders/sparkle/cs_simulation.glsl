@@ -3,7 +3,10 @@
 // ============================================================================
 
 /* Second Stage of the particle system :
+ * - Create the particles emitted this step, when fused with emission,
+ * - Select the level of detail of the particle from the camera,
  * - Update particle position and velocity,
+ * - Apply neighbours repulsion and cohesion, from the grid cells tables,
  * - Apply curl noise,
  * - Apply vector field,
  * - Performs time integration,
@@ -12,28 +15,26 @@
 
 // ============================================================================
 
-#include "sparkle/interop.h"
-#include "sparkle/inc_curlnoise.glsl"
+#include "sparkle/inc_grid_tables.glsl"
+#include "sparkle/inc_simulation.glsl"
 
-#define ENABLE_SCATTERING         0
-#define ENABLE_VECTORFIELD        0
-#define ENABLE_CURLNOISE          1
+//stable slots storage : particles stay in their slot, newborns take the slots
+//marked in the emission map with their batch index plus one. The fresh slots,
+//from uEmitFirst on, are dead until then.
+uniform bool uStableSlots = false;
+uniform usampler2D uEmitMapSampler;
 
-//time integration step.
-uniform float uDeltaT;
-//vector field sampler.
-uniform sampler3D uVectorFieldSampler;
-//simulation box dimension.
-uniform float uBBoxSize;
-
-in vec3 randvec;
 in vec3 position;
 in vec3 velocity;
 in vec2 age;
+in uint anchor;
+in vec3 curl;
 
 out vec3 vsPosition;
 out vec3 vsVelocity;
 out vec2 vsAge;
+flat out uint vsAnchor;
+out vec3 vsCurl;
 
 TParticle PopParticle() {
 
@@ -45,7 +46,8 @@ TParticle PopParticle() {
 
   p.start_age = attribs.x;
   p.age = attribs.y;
-  //p.id = floatBitsToUint(attribs.w);
+  p.anchor_id = anchor;
+  p.curl = curl;
 
   return p;
 }
@@ -55,205 +57,27 @@ void PushParticle(in TParticle p) {
   vsPosition = p.position;
   vsVelocity = p.velocity;
   vsAge = vec2(p.start_age, p.age);
-
-}
-
-void UpdateParticle(inout TParticle p, in vec3 pos, in vec3 vel, in float age) {
-  p.position.xyz = pos;
-  p.velocity.xyz = vel;
-  p.age = age;
-}
-
-float UpdateAge(in TParticle p) {
-  float decay = 0.01*uDeltaT;
-  float age = clamp(p.age - decay, 0.0f, p.start_age);
-  return age;
-}
-
-vec3 ApplyForces() {
-  vec3 force = vec3(0.0f);
-
-#if ENABLE_SCATTERING
-  //add a random force to each particles.
-  const float scattering = 0.45f;
-  vec3 randforce  = 2.0f * vec3(randvec.x, randvec.y, randvec.z) - 1.0f;
-  force += scattering * randforce;
-#endif
-
-  return force;
-}
-
-vec3 ApplyRepulsion(in TParticle p) {
-  vec3 push = vec3(0.0f);
-/*
-  //IDEA
-  const vec3 vel = p.velocity.xyz;
-  const vec3 pos = p.position.xyz;
-  const float MAX_INFLUENCE_DISTANCE = 8.0f;
-
-  vec3 n;
-  float d = compute_gradient(pos, n);
-  float coeff = smoothstep(0.0f, MAX_INFLUENCE_DISTANCE, abs(d));
-  push = coeff * (n);
-  //vec3 side = cross(cross(n, normalize(vel + vec3(1e-5))), n);
-  //push = mix(push, side, coeff * coeff);
-*/
-  return push;
-}
-
-vec3 ApplyTargetMesh(in TParticle p) {
-  vec3 pull = vec3(0.0f);
-
-  /*
-  //IDEA
-  vec3 anchor = anchors_buffer[p.anchor_id];
-  mat4x4 anchorModel = anchor_models_buffer[p.anchor_id];
-  vec3 target = anchorModel * vec4(anchor, 1.0f);
-  vec3 pull = target - p.position;
-  float length_pull = length(pull);
-  pull *= inversesqrt(length_pull);
-  float factor = MAX_PULL_FACTOR * smoothstep(0.0f, MAX_PULL_FACTOR, length_pull);
-  pull *= factor;
-*/
-  return pull;
-}
-
-vec3 ApplyVectorField(in TParticle p) {
-  vec3 vfield = vec3(0.0f);
-
-#if 1 //ENABLE_VECTORFIELD
-  vec3 pt = p.position.xyz;
-
-  ivec3 texsize = textureSize(uVectorFieldSampler, 0).xyz;
-  vec3 extent = 0.5f * vec3(texsize.x, texsize.y, texsize.z);
-  vec3 texcoord = (pt + extent) / (2.0f * extent);
-
-  vfield = texture(uVectorFieldSampler, texcoord).xyz;
-
-  //custom GL_CLAMP_TO_BORDER
-  vec3 clamp_to_border = step(-extent, pt) * step(pt, +extent);
-  bool b = any(lessThan(clamp_to_border, vec3(1.0f)));
-  vfield = mix(vfield, vec3(0.0f), float(b));
-#endif
-
-  return vfield;
-}
-
-vec3 GetCurlNoise(in TParticle p) {
-  vec3 curl = vec3(0.0f);
-
-#if ENABLE_CURLNOISE
-  const float effect = 2.0f;
-  const float scale = 1.0f / 256.0f;
-  curl  = effect * compute_curl(p.position.xyz * scale);
-#endif
-
-  return curl;
-}
-
-
-// ----------------------------------------------------------------------------
-
-void CollideSphere(float r, in vec3 center, inout vec3 pos, inout vec3 vel) {
-  vec3 p = pos - center;
-
-  float dp = dot(p, p);
-  float r2 = r*r;
-
-  if (dp > r2) {
-    vec3 n = -p * inversesqrt(dp);
-    vel = reflect(vel, n);
-
-    pos = center - r*n;
-  }
-}
-
-void CollideBox(in vec3 corner, in vec3 center, inout vec3 pos, inout vec3 vel) {
-  vec3 p = pos - center;
-
-  if (p.x < -corner.x) {
-    p.x = -corner.x;
-    vel = reflect(vel, vec3(1.0f,0.0f,0.0f));
-  }
-
-  if (p.x > corner.x) {
-    p.x = corner.x;
-    vel = reflect(vel, vec3(-1.0f,0.0f,0.0f));
-  }
-
-  if (p.y < -corner.y) {
-    p.y = -corner.y;
-    vel = reflect(vel, vec3(0.0f,1.0f,0.0f));
-  }
-
-  if (p.y > corner.y) {
-    p.y = corner.y;
-    vel = reflect(vel, vec3(0.0f,-1.0f,0.0f));
-  }
-
-  if (p.z < -corner.z) {
-    p.z = -corner.z;
-    vel = reflect(vel, vec3(0.0f,0.0f,1.0f));
-  }
-
-  if (p.z > corner.z) {
-    p.z = corner.z;
-    vel = reflect(vel, vec3(0.0f,0.0f,-1.0f));
-  }
-
-  pos = p + center;
-}
-
-void CollisionHandling(inout vec3 pos, inout vec3 vel) {
-  float r = 0.5f * uBBoxSize;
-
-  CollideSphere(r, vec3(0.0f), pos, vel);
-  CollideBox(vec3(r), vec3(0.0f), pos, vel);
+  vsAnchor = p.anchor_id;
+  vsCurl = p.curl;
 
 }
 
 void main() {
-  vec3 dt = vec3(uDeltaT);
-
-  //local copy of the particle.
-  TParticle p = PopParticle();
-
-  //update age.
-  /// [ dead particles still have a positive age, but are not push in render buffer.
-  ///   Still set their age to zero ? ]
-  float age = UpdateAge(p);
-
-  if (age > 0.0f) {
-    //apply external forces.
-    vec3 force = ApplyForces();
-
-    //apply repulsion on simple objects.
-    //force += ApplyRepulsion(p);
-
-    //apply mesh targeting.
-    //force += ApplyTargetMesh(p);
-
-    //apply vector field.
-    //force += ApplyVectorField(p);
-
-    //integrate velocity.
-    vec3 vel = fma(force, dt, p.velocity.xyz);
-
-    //get curling noise.
-    vec3 noise_vel =  ApplyVectorField(p);
-
-    vel += noise_vel;
-    noise_vel *= 0.0f;
-    vel = 10*normalize(vel);
-
-    //integrate position.
-    vec3 pos = fma(vel  + noise_vel, dt, p.position.xyz);
-
-    //handle collision.
-    CollisionHandling(pos, vel);
-
-    //update particle.
-    UpdateParticle(p, pos, vel, age);
-    PushParticle(p);
+  //local copy of the particle, vertices past the alive ones are newborns.
+  uint gid = gl_VertexID;
+  TParticle p;
+  if (uStableSlots) {
+    int width = textureSize(uEmitMapSampler, 0).x;
+    uint batch_index = texelFetch(uEmitMapSampler, ivec2(int(gid) % width, int(gid) / width), 0).r;
+    p = (batch_index > 0u) ? EmitParticle(batch_index - 1u, gid, uFrame, uSeed) : PopParticle();
+    if ((batch_index == 0u) && (gid >= uEmitFirst)) {
+      p.age = 0.0f;
+    }
+  } else {
+    p = (gid < uEmitFirst) ? PopParticle() : CreateParticle(gid, uFrame, uSeed);
   }
+
+  //dead particles are written too, the geometry stage filters them.
+  SimulateParticle(p, gid);
+  PushParticle(p);
 }
@@ -0,0 +1,145 @@
+#version 430 core
+
+// ============================================================================
+
+/* Compute backend of the simulation stage :
+ * - Consume the particles of the first buffer, and create the emitted ones,
+ * - Simulate them as the transform feedback stage does, their neighbours
+ *   being searched in the grid cells lists,
+ * - Append the alive ones to the second buffer, with their rank in the last
+ *   sorted order for the incremental sort.
+ *
+ * With stable slots, both buffers are the same one : each particle is updated
+ * in its slot. A dead slot is queued by keeping its position in the queue in
+ * place of its anchor, the queue being only counted. The newborns take the
+ * oldest queued slots, each one the slot whose position matches its batch
+ * index, then fresh slots past the ones read.
+ */
+
+// ============================================================================
+
+#include "sparkle/inc_grid_cells.glsl"
+#include "sparkle/inc_simulation.glsl"
+
+//particles, PARTICLE_ATTRIB_BUFFER_COUNT vec4 each, as in the vertex buffers.
+layout(std430, binding = STORAGE_BINDING_PARTICLES_FIRST)
+readonly buffer ReadParticles {
+  vec4 read_particles[];
+};
+
+layout(std430, binding = STORAGE_BINDING_PARTICLES_SECOND)
+writeonly buffer WriteParticles {
+  vec4 write_particles[];
+};
+
+//rank of the particles in the last sorted order, SORT_RANK_NONE for the
+//newborns.
+layout(std430, binding = STORAGE_BINDING_SORT_RANKS_FIRST)
+readonly buffer ReadRanks {
+  uint read_ranks[];
+};
+
+layout(std430, binding = STORAGE_BINDING_SORT_RANKS_SECOND)
+writeonly buffer WriteRanks {
+  uint write_ranks[];
+};
+
+layout(std430, binding = STORAGE_BINDING_INDIRECT_ARGS)
+readonly buffer IndirectArgs {
+  TIndirectArgs args;
+};
+
+layout(binding = ATOMIC_COUNTER_BINDING_COUNTERS, offset = 0)
+uniform atomic_uint write_count;
+
+layout(std430, binding = STORAGE_BINDING_DEAD_SLOTS)
+buffer DeadSlots {
+  TDeadSlots dead;
+};
+
+uniform bool uCarryRanks;
+uniform bool uStableSlots;
+uniform uint uMaxParticleCount;
+
+TParticle PopParticle(in uint id) {
+  uint first = PARTICLE_ATTRIB_BUFFER_COUNT * id;
+  vec4 a = read_particles[first + 0u];
+  vec4 b = read_particles[first + 1u];
+  vec4 c = read_particles[first + 2u];
+
+  TParticle p;
+  p.position = a.xyz;
+  p.velocity = vec3(a.w, b.xy);
+  p.start_age = b.z;
+  p.age = b.w;
+  p.anchor_id = floatBitsToUint(c.x);
+  p.curl = c.yzw;
+
+  return p;
+}
+
+void StoreParticle(in TParticle p, in uint id) {
+  uint first = PARTICLE_ATTRIB_BUFFER_COUNT * id;
+
+  write_particles[first + 0u] = vec4(p.position, p.velocity.x);
+  write_particles[first + 1u] = vec4(p.velocity.yz, p.start_age, p.age);
+  write_particles[first + 2u] = vec4(uintBitsToFloat(p.anchor_id), p.curl);
+}
+
+void PushParticle(in TParticle p, in uint rank) {
+  uint id = atomicCounterIncrement(write_count);
+  StoreParticle(p, id);
+  if (uCarryRanks) {
+    write_ranks[id] = rank;
+  }
+}
+
+//stable slots : the particle of the slot gid updated in place.
+void UpdateSlot(in uint gid) {
+  TParticle p;
+  if (gid >= args.read_count) {
+    //fresh slot, after the newborns taking queued ones.
+    p = EmitParticle(dead.popped + gid - args.read_count, gid, uFrame, uSeed);
+  } else {
+    p = PopParticle(gid);
+    if (p.age <= 0.0f) {
+      //dead and queued : taken by the newborn of its queue position, if any.
+      uint newborn_id = (p.anchor_id + uMaxParticleCount - dead.head) % uMaxParticleCount;
+      if (newborn_id >= dead.popped) {
+        return;
+      }
+      p = EmitParticle(newborn_id, gid, uFrame, uSeed);
+    }
+  }
+
+  if (!SimulateParticle(p, gid)) {
+    //queued after the slots of the previous steps.
+    p.anchor_id = (dead.head + dead.count + atomicAdd(dead.pushed, 1u)) % uMaxParticleCount;
+  }
+  StoreParticle(p, gid);
+}
+
+layout(local_size_x = PARTICLES_KERNEL_GROUP_WIDTH) in;
+void main() {
+  uint gid = gl_GlobalInvocationID.x;
+
+  if (uStableSlots) {
+    if (gid < args.read_count + args.emit_count - dead.popped) {
+      UpdateSlot(gid);
+    }
+    return;
+  }
+
+  if (gid >= args.read_count + args.emit_count) {
+    return;
+  }
+
+  //threads past the consumed particles create the newborns.
+  TParticle p = (gid < args.read_count) ? PopParticle(gid)
+                                        : EmitParticle(gid - args.read_count, gid, uFrame, uSeed);
+
+  if (SimulateParticle(p, gid)) {
+    uint rank = (uCarryRanks && (gid < args.read_count)) ? read_ranks[gid] : SORT_RANK_NONE;
+    PushParticle(p, rank);
+  }
+}
@@ -0,0 +1,58 @@
+#version 430 core
+
+/* Incremental sort, compute backend : count the sorted particles nearer than
+ * the one a distance after them. Depths are compared quantised, as sorted.
+ *
+ * A refined order is sorted by blocks : its errors are particles left blocks
+ * away from their place, missed by adjacent comparisons.
+ *
+ * Carried, the keys packed in the carried order are measured before they are
+ * sorted, counted apart.
+ */
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_sort_key.glsl"
+#include "sparkle/inc_sort_carry.glsl"
+
+layout(std430, binding = STORAGE_BINDING_DOT_PRODUCTS)
+readonly buffer DotProducts {
+  float dp[];
+};
+
+//indices packed by pairs, written by the last sort pass.
+layout(std430, binding = STORAGE_BINDING_SORTED_INDICES)
+readonly buffer SortedIndices {
+  uint sorted_indices[];
+};
+
+//keys in the carried order, written by the fill.
+layout(std430, binding = STORAGE_BINDING_INDICES_FIRST)
+readonly buffer Keys {
+  uint keys[];
+};
+
+//number of visible particles, written by the culling.
+layout(std430, binding = STORAGE_BINDING_DRAW_ARGS)
+readonly buffer DrawArgs {
+  TDrawElementsArgs draw_args;
+};
+
+uniform uint uDistance;           // between the compared particles.
+uniform bool uCarried;            // keys order instead of the sorted one.
+
+uint GetQuantizedDepth(in uint i) {
+  if (uCarried) {
+    return keys[i] >> 16u;
+  }
+  uint index = (sorted_indices[i / 2u] >> (16u * (i & 1u))) & 0xffffu;
+  return PackSortKey(dp[index], 0u) >> 16u;
+}
+
+layout(local_size_x = PARTICLES_KERNEL_GROUP_WIDTH) in;
+void main() {
+  uint i = gl_GlobalInvocationID.x;
+
+  if ((i + uDistance < draw_args.count) && (GetQuantizedDepth(i) < GetQuantizedDepth(i + uDistance))) {
+    atomicAdd(inversion_counts[(uCarried) ? 1 : 0], 1u);
+  }
+}
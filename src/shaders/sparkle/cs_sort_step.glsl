@@ -1,35 +1,52 @@
-#version 410 core
+#version 430 core
 
-/* Sorting step of the bitonic-sort algorithm.
- * This kernel sort indices by comparing dot products together.
+/* Sorting step of the bitonic-sort algorithm, compute backend.
+ * This kernel sort keys packing the depth with the particle index, farthest
+ * first. The last step packs the sorted indices by pairs into the 16 bits
+ * element buffer used by the rendering.
+ *
+ * Every block is sorted by decreasing order, the first stage of a merge
+ * comparing each key with its mirror in the block : the padding stays after
+ * the keys counted, only their pairs are dispatched.
+ *
+ * The incremental sort merges blocks from an offset, alternately, and records
+ * the rank of the particles sorted for the next one to carry their order.
 */
 
 #include "sparkle/interop.h"
-
-layout(std430, binding = STORAGE_BINDING_DOT_PRODUCTS)
-readonly coherent buffer DotProducts {
-  float dp[];
-};
+#include "sparkle/inc_sort_key.glsl"
+#include "sparkle/inc_sort_carry.glsl"
 
 layout(std430, binding = STORAGE_BINDING_INDICES_FIRST)
-readonly buffer ReadIndices {
-  uint read_indices[];
+readonly buffer ReadKeys {
+  uint read_keys[];
 };
 
 layout(std430, binding = STORAGE_BINDING_INDICES_SECOND)
-writeonly buffer WriteIndices {
-  uint write_indices[];
+writeonly buffer WriteKeys {
+  uint write_keys[];
 };
 
-uniform uint uBlockWidth;
-uniform uint uMaxBlockWidth;
+layout(std430, binding = STORAGE_BINDING_SORTED_INDICES)
+writeonly buffer SortedIndices {
+  uint sorted_indices[];
+};
 
-bool cmp(float a, float b) {
-  return a > b;
-}
+//number of visible particles, written by the culling.
+layout(std430, binding = STORAGE_BINDING_DRAW_ARGS)
+readonly buffer DrawArgs {
+  TDrawElementsArgs draw_args;
+};
 
-void CompareAndSwap(in uint order, inout uint left, inout uint right) {
-  if (bool(order) == cmp(dp[left], dp[right])) {
+uniform uint uBlockWidth;
+uniform uint uOffset;         // of the first block, the keys before it left in place.
+uniform uint uCount;          // keys sorted, any count, followed by the padding.
+uniform bool uFlip;           // first stage of a merge.
+uniform bool uPackOutput;
+uniform bool uWriteRanks;     // with the output, for the next sort to carry it.
+
+void CompareAndSwap(inout uint left, inout uint right) {
+  if (left < right) {
     left ^= right;
     right ^= left;
     left ^= right;
@@ -40,21 +57,41 @@ layout(local_size_x = PARTICLES_KERNEL_GROUP_WIDTH) in;
 void main() {
   uint tid = gl_GlobalInvocationID.x;
 
-  const uint max_block_width = uMaxBlockWidth;
   const uint block_width = uBlockWidth;
   const uint pair_distance = block_width / 2u;
 
-  const uint block_offset = (tid / pair_distance) * block_width;
+  const uint block_offset = uOffset + (tid / pair_distance) * block_width;
   const uint left_id = block_offset + (tid % pair_distance);
-  const uint right_id = left_id + pair_distance;
+  const uint right_id = (uFlip) ? block_offset + block_width - 1u - (tid % pair_distance)
+                                : left_id + pair_distance;
+
+  if (left_id >= uCount) {
+    return;
+  }
+
+  //data to sort, the keys past the count are padding.
+  uint left_data = read_keys[left_id];
+  uint right_data = (right_id < uCount) ? read_keys[right_id] : SORT_KEY_PADDING;
 
-  //data to sort.
-  uint left_data = read_indices[left_id];
-  uint right_data = read_indices[right_id];
+  CompareAndSwap(left_data, right_data);
 
-  const uint order = (left_id / max_block_width) & 1;
-  CompareAndSwap(order, left_data, right_data);
+  //last stage : pairs are contiguous, left_id being even.
+  if (uPackOutput) {
+    sorted_indices[left_id / 2u] = UnpackSortIndex(left_data) | (UnpackSortIndex(right_data) << 16u);
 
-  write_indices[left_id] = left_data;
-  write_indices[right_id] = right_data;
+    if (uWriteRanks) {
+      uint count = draw_args.count;
+      if (left_id < count) {
+        sort_ranks[culled_ids[UnpackSortIndex(left_data)]] = left_id;
+      }
+      if (right_id < count) {
+        sort_ranks[culled_ids[UnpackSortIndex(right_data)]] = right_id;
+      }
+    }
+  } else {
+    write_keys[left_id] = left_data;
+    if (right_id < uCount) {
+      write_keys[right_id] = right_data;
+    }
+  }
 }
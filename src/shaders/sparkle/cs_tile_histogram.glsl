@@ -0,0 +1,47 @@
+#version 430 core
+
+// Screen tiles sort, compute backend : count the visible particles listed in
+// each screen tile, a particle being listed in every tile it overlaps, and
+// the entries of all the lists after the tiles counts.
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_sort_tiles.glsl"
+
+//CULLED_ATTRIB_BUFFER_COUNT vec4 per particle.
+layout(std430, binding = STORAGE_BINDING_CULLED_PARTICLES)
+readonly buffer CulledParticles {
+  vec4 culled_particles[];
+};
+
+layout(std430, binding = STORAGE_BINDING_SORT_BUCKETS)
+buffer Tiles {
+  uint tiles[];
+};
+
+//number of visible particles, written by the culling.
+layout(std430, binding = STORAGE_BINDING_DRAW_ARGS)
+readonly buffer DrawArgs {
+  TDrawElementsArgs draw_args;
+};
+
+layout(local_size_x = PARTICLES_KERNEL_GROUP_WIDTH) in;
+void main() {
+  uint tid = gl_GlobalInvocationID.x;
+
+  if (tid >= draw_args.count) {
+    return;
+  }
+
+  vec4 a = culled_particles[CULLED_ATTRIB_BUFFER_COUNT * tid + 0u];
+  vec4 b = culled_particles[CULLED_ATTRIB_BUFFER_COUNT * tid + 1u];
+
+  uvec4 range;
+  if (GetSpriteTiles(a.xyz, vec3(a.w, b.xy), range)) {
+    atomicAdd(tiles[uTileGrid * uTileGrid], (range.z - range.x + 1u) * (range.w - range.y + 1u));
+    for (uint y = range.y; y <= range.w; ++y) {
+      for (uint x = range.x; x <= range.z; ++x) {
+        atomicAdd(tiles[y * uTileGrid + x], 1u);
+      }
+    }
+  }
+}
@@ -0,0 +1,69 @@
+#version 430 core
+
+// Screen tiles sort, compute backend : write the depth key of each visible
+// particle in the next slot of every tile it overlaps, the order within a
+// tile being arbitrary. When the lists exceed the capacity, each particle is
+// listed once instead, in culling order, as a single whole screen list.
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_sort_key.glsl"
+#include "sparkle/inc_sort_tiles.glsl"
+
+layout(std430, binding = STORAGE_BINDING_DOT_PRODUCTS)
+readonly buffer DotProducts {
+  float dp[];
+};
+
+//CULLED_ATTRIB_BUFFER_COUNT vec4 per particle.
+layout(std430, binding = STORAGE_BINDING_CULLED_PARTICLES)
+readonly buffer CulledParticles {
+  vec4 culled_particles[];
+};
+
+//first free slot of each tile.
+layout(std430, binding = STORAGE_BINDING_SORT_BUCKETS)
+buffer Tiles {
+  uint tiles[];
+};
+
+layout(std430, binding = STORAGE_BINDING_SORT_TILES)
+writeonly buffer TileKeys {
+  uint tile_keys[];
+};
+
+layout(std430, binding = STORAGE_BINDING_DRAW_ARGS)
+readonly buffer DrawArgs {
+  TDrawElementsArgs draw_args;
+};
+
+uniform uint uCapacity;           // slots of the tile lists.
+
+layout(local_size_x = PARTICLES_KERNEL_GROUP_WIDTH) in;
+void main() {
+  uint tid = gl_GlobalInvocationID.x;
+
+  if (tid >= draw_args.count) {
+    return;
+  }
+
+  uint key = PackSortKey(dp[tid], tid);
+  if (tiles[uTileGrid * uTileGrid] > uCapacity) {
+    tile_keys[tid] = key;
+    return;
+  }
+
+  vec4 a = culled_particles[CULLED_ATTRIB_BUFFER_COUNT * tid + 0u];
+  vec4 b = culled_particles[CULLED_ATTRIB_BUFFER_COUNT * tid + 1u];
+
+  uvec4 range;
+  if (GetSpriteTiles(a.xyz, vec3(a.w, b.xy), range)) {
+    for (uint y = range.y; y <= range.w; ++y) {
+      for (uint x = range.x; x <= range.z; ++x) {
+        uint slot = atomicAdd(tiles[y * uTileGrid + x], 1u);
+        if (slot < uCapacity) {
+          tile_keys[slot] = key;
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,121 @@
+#version 430 core
+
+// Screen tiles sort, compute backend : a group per tile sorts its list by
+// decreasing keys, then writes their particle index in place, drawn as 32 bits
+// elements with the draw arguments of the tile.
+//
+// The bitonic merges compare each key with its mirror in the merged blocks,
+// then run the half-cleaner stages : blocks are all sorted by decreasing keys
+// and a list of any length is sorted, the missing keys of its last block being
+// the least ones. Lists fitting in shared memory are sorted there, longer ones
+// in the storage buffer.
+//
+// When the lists exceed the capacity, the first group sorts the whole screen
+// list instead, and every tile draws it : an exact sort for the frame, slower.
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_sort_key.glsl"
+
+//end slot of each tile list, once scattered, then the entries of all lists.
+layout(std430, binding = STORAGE_BINDING_SORT_BUCKETS)
+readonly buffer Tiles {
+  uint tiles[];
+};
+
+layout(std430, binding = STORAGE_BINDING_SORT_TILES)
+coherent buffer TileKeys {
+  uint tile_keys[];
+};
+
+layout(std430, binding = STORAGE_BINDING_TILE_DRAW_ARGS)
+writeonly buffer TileDrawArgs {
+  TDrawElementsArgs tile_args[];
+};
+
+//number of visible particles, written by the culling.
+layout(std430, binding = STORAGE_BINDING_DRAW_ARGS)
+readonly buffer DrawArgs {
+  TDrawElementsArgs draw_args;
+};
+
+uniform uint uCapacity;           // slots of the tile lists.
+
+shared uint shared_keys[SORT_TILE_SHARED_KEYS];
+
+uint first;
+bool in_shared;
+
+uint LoadKey(in uint i) {
+  return (in_shared) ? shared_keys[i] : tile_keys[first + i];
+}
+
+void StoreKey(in uint i, in uint key) {
+  if (in_shared) {
+    shared_keys[i] = key;
+  } else {
+    tile_keys[first + i] = key;
+  }
+}
+
+layout(local_size_x = PARTICLES_KERNEL_GROUP_WIDTH) in;
+void main() {
+  uint tile = gl_WorkGroupID.x;
+  uint lid = gl_LocalInvocationID.x;
+
+  uint count = 0u;
+  if (tiles[gl_NumWorkGroups.x] > uCapacity) {
+    if (tile > 0u) {
+      if (lid == 0u) {
+        tile_args[tile] = TDrawElementsArgs(draw_args.count, 1u, 0u, 0u, 0u);
+      }
+      return;
+    }
+    first = 0u;
+    count = draw_args.count;
+  } else {
+    first = (tile > 0u) ? tiles[tile - 1u] : 0u;
+    count = tiles[tile] - first;
+  }
+  in_shared = (count <= SORT_TILE_SHARED_KEYS);
+
+  if (in_shared) {
+    for (uint i = lid; i < count; i += PARTICLES_KERNEL_GROUP_WIDTH) {
+      shared_keys[i] = tile_keys[first + i];
+    }
+  }
+  groupMemoryBarrier();
+  barrier();
+
+  for (uint block = 2u; block < 2u * count; block <<= 1u) {
+    for (uint width = block; width >= 2u; width >>= 1u) {
+      //pairs whose lower key is listed.
+      uint half_width = width / 2u;
+      uint npairs = (count / width) * half_width + min(count % width, half_width);
+
+      for (uint p = lid; p < npairs; p += PARTICLES_KERNEL_GROUP_WIDTH) {
+        uint offset = (p / half_width) * width;
+        uint left = offset + (p % half_width);
+        uint right = (width == block) ? offset + width - 1u - (p % half_width) : left + half_width;
+
+        if (right < count) {
+          uint left_key = LoadKey(left);
+          uint right_key = LoadKey(right);
+          if (left_key < right_key) {
+            StoreKey(left, right_key);
+            StoreKey(right, left_key);
+          }
+        }
+      }
+      groupMemoryBarrier();
+      barrier();
+    }
+  }
+
+  for (uint i = lid; i < count; i += PARTICLES_KERNEL_GROUP_WIDTH) {
+    tile_keys[first + i] = UnpackSortIndex(LoadKey(i));
+  }
+
+  if (lid == 0u) {
+    tile_args[tile] = TDrawElementsArgs(count, 1u, first, 0u, 0u);
+  }
+}
@@ -0,0 +1,72 @@
+#version 430 core
+
+// ============================================================================
+
+/* Compute backend, first stage of a simulation step :
+ * - take the particles appended by the last step as the ones to consume,
+ * - clamp the emission to the free storage,
+ * - write the indirect dispatch arguments of the simulation,
+ * - reset the append counter.
+ *
+ * With stable slots, the particles are updated in place : the slots died last
+ * step are queued, the newborns take the oldest queued slots then fresh ones,
+ * and the count is the one of the slots used.
+ */
+
+// ============================================================================
+
+#include "sparkle/interop.h"
+
+//draw arguments of the particles written last step, its count being the
+//append counter of the simulation.
+layout(std430, binding = STORAGE_BINDING_COUNTERS)
+coherent buffer Counters {
+  TDrawArraysArgs particles_args;
+};
+
+layout(std430, binding = STORAGE_BINDING_INDIRECT_ARGS)
+writeonly buffer IndirectArgs {
+  TIndirectArgs args;
+};
+
+layout(std430, binding = STORAGE_BINDING_DEAD_SLOTS)
+coherent buffer DeadSlots {
+  TDeadSlots dead;
+};
+
+uniform uint uEmitCount;
+uniform uint uMaxParticleCount;
+uniform bool uStableSlots;
+uniform bool uResetSlots;     // queue emptied, the particles appended last being compacted.
+
+layout(local_size_x = 1) in;
+void main() {
+  uint read_count = particles_args.count;
+  uint emit_count = min(uEmitCount, uMaxParticleCount - read_count);
+  uint nthreads = read_count + emit_count;
+
+  if (uStableSlots) {
+    if (uResetSlots) {
+      dead.head = 0u;
+      dead.count = 0u;
+      dead.pushed = 0u;
+      dead.popped = 0u;
+    }
+    dead.head = (dead.head + dead.popped) % uMaxParticleCount;
+    dead.count += dead.pushed - dead.popped;
+    dead.pushed = 0u;
+
+    emit_count = min(uEmitCount, dead.count + uMaxParticleCount - read_count);
+    dead.popped = min(emit_count, dead.count);
+    nthreads = read_count + emit_count - dead.popped;
+  }
+
+  args.dispatch_x = (nthreads + PARTICLES_KERNEL_GROUP_WIDTH - 1u) / PARTICLES_KERNEL_GROUP_WIDTH;
+  args.dispatch_y = 1u;
+  args.dispatch_z = 1u;
+  args.read_count = read_count;
+  args.emit_count = emit_count;
+
+  //the slots used, as of this step, or the append counter.
+  particles_args.count = (uStableSlots) ? nthreads : 0u;
+}
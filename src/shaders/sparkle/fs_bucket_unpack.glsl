@@ -0,0 +1,22 @@
+#version 410 core
+
+// Depth buckets sort : write the particle indices of the partitioned keys to
+// the sorted texture, four consecutive ones per texel.
+
+#include "sparkle/inc_sort_key.glsl"
+
+uniform uint width;               // in texels.
+uniform uint uCount;              // visible particles.
+
+uniform usamplerBuffer keys;
+
+out uvec4 color;
+
+void main(void) {
+  uint t = uint(gl_FragCoord.y) * width + uint(gl_FragCoord.x);
+
+  for (uint c = 0u; c < 4u; ++c) {
+    uint i = 4u * t + c;
+    color[c] = (i < uCount) ? UnpackSortIndex(texelFetch(keys, int(i)).x) : 0u;
+  }
+}
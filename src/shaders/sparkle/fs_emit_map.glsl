@@ -0,0 +1,11 @@
+#version 410 core
+
+// write the batch index of the particle emitted in the slot.
+
+flat in uint vBatchIndex;
+
+out uint fragBatchIndex;
+
+void main() {
+  fragBatchIndex = vBatchIndex;
+}
@@ -1,16 +1,25 @@
 #version 410 core
 
-// fill a buffer with continuous indices, used in the sorting step.
+// fill the sort keys texture : the depth key of each visible particle packed
+// with its index, four consecutive ones per texel, used in the sorting step.
 
-in vec2 outTexcoord;
+#include "sparkle/inc_sort_key.glsl"
 
-uniform uint width;
-uniform uint height;
+uniform uint width;             // in texels.
 
-out uint indice;
+//depth keys written by the culling.
+uniform samplerBuffer dp;
+//visible particles, counted on the device. The keys past them are padding.
+uniform usampler2D uVisibleCount;
 
-void main(void) {
+out uvec4 key;
 
-  indice = uint(floor(outTexcoord.x * width) + floor(outTexcoord.y * height) * width);
+void main(void) {
+  uint t = uint(gl_FragCoord.y) * width + uint(gl_FragCoord.x);
+  uint count = texelFetch(uVisibleCount, ivec2(0), 0).x;
 
+  for (uint c = 0u; c < 4u; ++c) {
+    uint i = 4u * t + c;
+    key[c] = (i < count) ? PackSortKey(texelFetch(dp, int(i)).x, i) : SORT_KEY_PADDING;
+  }
 }
@@ -0,0 +1,9 @@
+#version 410 core
+
+// a particle in the cell, blended with GL_FUNC_ADD.
+
+out float fragCount;
+
+void main() {
+  fragCount = 1.0f;
+}
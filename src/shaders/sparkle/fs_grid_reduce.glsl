@@ -0,0 +1,24 @@
+#version 410 core
+
+// Neighbours grid, transform feedback backend : sum of each group of
+// uGroupWidth consecutive values of a finer level of the cells counts.
+
+#include "sparkle/inc_grid.glsl"
+
+uniform uint width;               // in texels.
+uniform uint uGroupWidth;
+
+uniform sampler2D uValues;
+
+out float fragSum;
+
+void main(void) {
+  uint i = uint(gl_FragCoord.y) * width + uint(gl_FragCoord.x);
+  uint values_width = uint(textureSize(uValues, 0).x);
+
+  float sum = 0.0f;
+  for (uint j = i * uGroupWidth; j < (i + 1u) * uGroupWidth; ++j) {
+    sum += texelFetch(uValues, GetTableTexel(j, values_width), 0).r;
+  }
+  fragSum = sum;
+}
@@ -0,0 +1,32 @@
+#version 410 core
+
+// Neighbours grid, transform feedback backend : first slot of each value
+// within its group of uGroupWidth, the exclusive sum of the ones before it,
+// offset by the first slot of the group from the coarser level. Written with
+// its end, the range of a cell once at the finest level.
+
+#include "sparkle/inc_grid.glsl"
+
+uniform uint width;               // in texels.
+uniform uint uGroupWidth;
+uniform bool uTopLevel;           // a single group, without coarser level.
+
+uniform sampler2D uValues;
+uniform sampler2D uGroupStarts;
+
+out vec2 fragRange;
+
+void main(void) {
+  uint i = uint(gl_FragCoord.y) * width + uint(gl_FragCoord.x);
+  uint group = i / uGroupWidth;
+
+  float start = 0.0f;
+  if (!uTopLevel) {
+    uint starts_width = uint(textureSize(uGroupStarts, 0).x);
+    start = texelFetch(uGroupStarts, GetTableTexel(group, starts_width), 0).r;
+  }
+  for (uint j = group * uGroupWidth; j < i; ++j) {
+    start += texelFetch(uValues, GetTableTexel(j, width), 0).r;
+  }
+  fragRange = vec2(start, start + texelFetch(uValues, GetTableTexel(i, width), 0).r);
+}
@@ -0,0 +1,25 @@
+#version 410 core
+
+/* Weighted blended order independent transparency : resolve the sprites
+ * accumulated offscreen, blended over the target by (1 - revealage, revealage).
+ * [McGuire & Bavoil 2013]
+ */
+
+uniform sampler2D uAccumulation;  // weighted premultiplied colors, weighted alpha.
+uniform sampler2D uRevealage;     // product of the sprites (1 - alpha).
+uniform ivec2 uOffset;            // viewport origin.
+
+layout(location = 0) out vec4 fragColor;
+
+void main() {
+  ivec2 texel = ivec2(gl_FragCoord.xy) - uOffset;
+
+  float revealage = texelFetch(uRevealage, texel, 0).r;
+  if (revealage >= 1.0f) {
+    discard;
+  }
+  vec4 accumulation = texelFetch(uAccumulation, texel, 0);
+
+  //weighted average color.
+  fragColor = vec4(accumulation.rgb / clamp(accumulation.a, 1.0e-4f, 5.0e4f), revealage);
+}
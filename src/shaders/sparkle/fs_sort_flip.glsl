@@ -0,0 +1,56 @@
+#version 410 core
+
+/* Incremental sort : merge step of two adjacent blocks sorted by decreasing
+ * keys. Each key is compared with its mirror in the pair, the lower block
+ * keeping the greatest : both blocks are left bitonic, all keys of the lower
+ * block above those of the upper one, and are sorted by the half-cleaner
+ * stages of the bitonic sort.
+ *
+ * Keys are packed by four consecutive ones per texel, the blocks spanning
+ * whole texels : the mirrors of a texel keys are the ones of a single texel,
+ * reversed.
+ */
+
+#include "sparkle/inc_sort_key.glsl"
+
+uniform uint uBlockWidth;       // width of the sorted blocks.
+uniform uint uOffset;           // first key of the merged pairs, to alternate them.
+uniform uint uSize;             // keys sorted, padding included.
+uniform uint uCount;            // live keys, followed by the padding.
+uniform uint width;             // in texels.
+
+uniform usampler2D keys;
+
+out uvec4 color;
+
+//the sort textures have a power of two width.
+ivec2 GetTexel(in uint t) {
+  uint shift = uint(findMSB(width));
+  return ivec2(t & (width - 1u), t >> shift);
+}
+
+//texels past the live keys are not drawn, they hold the padding.
+uvec4 FetchKeys(in uint t) {
+  return (4u * t < uCount) ? texelFetch(keys, GetTexel(t), 0) : uvec4(SORT_KEY_PADDING);
+}
+
+void main(void) {
+  uint t = uint(gl_FragCoord.y) * width + uint(gl_FragCoord.x);
+  uint i = 4u * t;
+  uint span = 2u * uBlockWidth;
+
+  uvec4 keys0 = FetchKeys(t);
+
+  //keys before the first pair, or of an incomplete last one, are kept.
+  uint base = (i >= uOffset) ? ((i - uOffset) / span) * span + uOffset : 0u;
+  if ((i < uOffset) || (base + span > uSize)) {
+    color = keys0;
+    return;
+  }
+
+  uint j = base + span - 4u - (i - base);
+  uvec4 keys1 = FetchKeys(j / 4u).wzyx;
+
+  bool lower_block = (i - base) < uBlockWidth;
+  color = (lower_block) ? max(keys0, keys1) : min(keys0, keys1);
+}
@@ -0,0 +1,47 @@
+#version 410 core
+
+/* Incremental sort : keep the fragments of the sorted particles nearer than
+ * the one a distance after them, counted by an occlusion query. Depths are
+ * compared quantised, as sorted.
+ *
+ * A refined order is sorted by blocks : its errors are particles left blocks
+ * away from their place, missed by adjacent comparisons.
+ *
+ * The carried order, the culling one, is measured before it is sorted : how
+ * much the order changed since the last sort.
+ *
+ * Indices are packed by four consecutive ones per texel : a pass per
+ * component covers them all, one fragment per particle.
+ */
+
+#include "sparkle/inc_sort_key.glsl"
+
+uniform uint width;               // in texels.
+uniform uint uComponent;          // of the texels, for the particles measured.
+uniform uint uDistance;           // between the compared particles.
+uniform bool uCarried;            // measure the culling order instead of the sorted one.
+
+uniform usampler2D sorted;        // indices written by the last sort pass.
+uniform samplerBuffer dp;         // depth keys written by the culling.
+uniform usampler2D uVisibleCount; // visible particles, counted on the device.
+
+//the sort textures have a power of two width.
+ivec2 GetTexel(in uint t) {
+  uint shift = uint(findMSB(width));
+  return ivec2(t & (width - 1u), t >> shift);
+}
+
+uint GetQuantizedDepth(in uint i) {
+  uint index = (uCarried) ? i : texelFetch(sorted, GetTexel(i / 4u), 0)[i % 4u];
+  return PackSortKey(texelFetch(dp, int(index)).x, 0u) >> 16u;
+}
+
+void main(void) {
+  uint t = uint(gl_FragCoord.y) * width + uint(gl_FragCoord.x);
+  uint i = 4u * t + uComponent;
+  uint count = texelFetch(uVisibleCount, ivec2(0), 0).x;
+
+  if ((i + uDistance >= count) || (GetQuantizedDepth(i) >= GetQuantizedDepth(i + uDistance))) {
+    discard;
+  }
+}
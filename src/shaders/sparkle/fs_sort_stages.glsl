@@ -0,0 +1,60 @@
+#version 410 core
+
+/* The last stages of a bitonic merge, of pair distances 2 and 1, within the
+ * texels of four consecutive keys : each fragment owns the keys of its texel,
+ * runs the stages in registers and writes them all.
+ *
+ * Keys are sorted by decreasing order in every block. The first stage of a
+ * merge compares each key with its mirror in the block, the lower index of
+ * each pair keeping the greatest key. The padding stays after the live keys,
+ * which are the only ones drawn and fetched.
+ */
+
+#include "sparkle/inc_sort_key.glsl"
+
+uniform uint uBlockWidth;       // block width of the first stage, 4 or 2.
+uniform uint uStageCount;       // stages run by the pass, 2 at most.
+uniform bool uFlip;             // the first stage is the first one of a merge.
+uniform uint uCount;            // live keys, followed by the padding.
+uniform uint width;             // in texels.
+uniform bool uUnpackIndices;    // last pass : write the particle indices.
+
+uniform usampler2D keys;
+
+out uvec4 color;
+
+//the sort textures have a power of two width.
+ivec2 GetTexel(in uint t) {
+  uint shift = uint(findMSB(width));
+  return ivec2(t & (width - 1u), t >> shift);
+}
+
+//texels past the live keys are not drawn, they hold the padding.
+uvec4 FetchKeys(in uint t) {
+  return (4u * t < uCount) ? texelFetch(keys, GetTexel(t), 0) : uvec4(SORT_KEY_PADDING);
+}
+
+void main(void) {
+  uint t = uint(gl_FragCoord.y) * width + uint(gl_FragCoord.x);
+  uvec4 k = FetchKeys(t);
+
+  uint distance = uBlockWidth / 2u;
+  for (uint stage = 0u; stage < uStageCount; ++stage, distance /= 2u) {
+    if (distance == 2u) {
+      //pairs (x, z) and (y, w), or the mirrors (x, w) and (y, z).
+      bool flip = uFlip && (stage == 0u);
+      uvec2 upper = (flip) ? k.wz : k.zw;
+      uvec2 greatest = max(k.xy, upper);
+      uvec2 lowest = min(k.xy, upper);
+      k = (flip) ? uvec4(greatest, lowest.yx) : uvec4(greatest, lowest);
+    } else {
+      //pairs (x, y) and (z, w), their own mirrors.
+      uvec2 greatest = max(k.xz, k.yw);
+      uvec2 lowest = min(k.xz, k.yw);
+      k = uvec4(greatest.x, lowest.x, greatest.y, lowest.y);
+    }
+  }
+
+  color = (uUnpackIndices) ? uvec4(UnpackSortIndex(k.x), UnpackSortIndex(k.y),
+                                  UnpackSortIndex(k.z), UnpackSortIndex(k.w)) : k;
+}
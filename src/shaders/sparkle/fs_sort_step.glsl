@@ -1,43 +1,50 @@
 #version 410 core
 
-in vec2 outTexcoord;
+/* Single stage of the bitonic sort between texels : the keys are packed by
+ * four consecutive ones per texel, and a pair distance of four keys at least
+ * pairs whole texels. Each fragment compares its four keys with the ones of
+ * the paired texel, both fetched from the same texture.
+ *
+ * Keys are sorted by decreasing order in every block, the first stage of a
+ * merge comparing each key with its mirror in the block : the padding stays
+ * after the live keys, which are the only ones drawn and fetched.
+ */
+
+#include "sparkle/inc_sort_key.glsl"
 
-uniform uint uMaxBlockWidth;
 uniform uint uBlockWidth;
-uniform uint width;
-uniform uint height;
-uniform uint texWidth;
-uniform uint texHeight;
+uniform bool uFlip;               // first stage of a merge.
+uniform uint uCount;              // live keys, followed by the padding.
+uniform uint width;               // in texels.
 
-uniform sampler2D dp;
-uniform usampler2D indices;
+uniform usampler2D keys;
 
-out uint color;
+out uvec4 color;
 
-void main(void) {
-
-  vec2 ownPosition = outTexcoord;
-  //does not compile when using const qualifier.
-  uint max_block_width = uMaxBlockWidth;
-  uint block_width = uBlockWidth;
-  uint pair_distance = block_width / 2u;
-
-  // get self
-  uvec4 val0 =  texture(indices, vec2(ownPosition.x * float(width) / texWidth, ownPosition.y * float(height) / texHeight));
-  uint i = uint(floor(ownPosition.x * width) + floor(ownPosition.y * height) * width);
-
-  int direction =  ((i % uBlockWidth) < pair_distance) ? 1: -1; // which half in the block ?
-  int orientation = ((i / max_block_width ) % 2 == 0) ? 1 : -1; // orientation of the comparison arrow in the block.
-
-  uint j = i + direction * pair_distance;
-
-  uvec4 val1 = texture(indices, vec2( float((j % width)) / float(width) * float(width) / texWidth,
-                                      float(j) / (float(width * height )) * float(height) / texHeight ));
-
-  int order = direction * orientation;
+//the sort textures have a power of two width.
+ivec2 GetTexel(in uint t) {
+  uint shift = uint(findMSB(width));
+  return ivec2(t & (width - 1u), t >> shift);
+}
 
-  float dp0 = (texture(dp, vec2(float((val0.x % width)) / float(width) * float(width) / texWidth, float(val0.x) / (float(width * height ))* float(height) / texHeight) ) ).x;
-  float dp1 = (texture(dp, vec2(float((val1.x % width)) / float(width)* float(width) / texWidth, float(val1.x) / (float(width * height ))* float(height) / texHeight) ) ).x;
-  color = ( order*dp0 > order*dp1 ) ? val0.x : val1.x ;
+//texels past the live keys are not drawn, they hold the padding.
+uvec4 FetchKeys(in uint t) {
+  return (4u * t < uCount) ? texelFetch(keys, GetTexel(t), 0) : uvec4(SORT_KEY_PADDING);
+}
 
+void main(void) {
+  uint t = uint(gl_FragCoord.y) * width + uint(gl_FragCoord.x);
+  uint i = 4u * t;
+  uint pair_distance = uBlockWidth / 2u;
+
+  //which half of the block, its pair being mirrored, the keys of the texel
+  //reversed, or translated.
+  bool lower_half = (i % uBlockWidth) < pair_distance;
+  uvec4 keys0 = FetchKeys(t);
+  uvec4 keys1 = (uFlip) ? FetchKeys((i ^ (uBlockWidth - 1u)) / 4u).wzyx :
+                (lower_half) ? FetchKeys((i + pair_distance) / 4u) :
+                               FetchKeys((i - pair_distance) / 4u);
+
+  //the lower half keeps the greatest keys.
+  color = (lower_half) ? max(keys0, keys1) : min(keys0, keys1);
 }
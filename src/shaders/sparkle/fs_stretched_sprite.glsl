@@ -8,17 +8,32 @@
 
 
 uniform sampler2D uSpriteSampler2d;
+//weighted blended order independent transparency, accumulated in two targets.
+uniform bool uWeighted;
 
 layout(location = 0) out vec4 fragColor;
+layout(location = 1) out float fragRevealage;
 
 in GDataBlock {
   vec3 color;
   vec2 texcoord;
   float decay;
+  float depth;    // view space distance along the view vector.
 } IN;
 
+//weight of a fragment, decreasing with its depth [McGuire & Bavoil 2013, eq. 9].
+float GetBlendWeight(in float alpha, in float depth) {
+  return alpha * clamp(0.03f / (1.0e-5f + pow(depth / 200.0f, 4.0f)), 1.0e-2f, 3.0e3f);
+}
+
 void main() {
   fragColor = compute_color(IN.color, IN.texcoord);
   fragColor *=IN.decay;
+
+  //premultiplied color and alpha, weighted, then alpha to multiply the revealage.
+  if (uWeighted) {
+    fragRevealage = fragColor.a;
+    fragColor *= GetBlendWeight(fragColor.a, IN.depth);
+  }
   //fragColor = vec4(IN.Color, IN.decay);
 }
@@ -0,0 +1,11 @@
+#version 410 core
+
+// write the count of the particles drawn so far.
+
+flat in uint vCount;
+
+out uint fragCount;
+
+void main() {
+  fragCount = vCount;
+}
@@ -0,0 +1,34 @@
+#version 410 core
+
+// ============================================================================
+
+/* Depth buckets sort : one digit of a radix sort on the bucket bits of the
+ * keys, least significant first.
+ * - write the keys whose bit is the one searched, in their order.
+ *
+ * Drawn for the set bit then the clear one, the keys are partitioned stably,
+ * the farthest first.
+ */
+
+// ============================================================================
+
+uniform uint uBit;
+uniform uint uBitValue;
+
+flat in uint vsKey[1];
+
+layout(points) in;
+layout(points, max_vertices = 1) out;
+
+flat out uint tfKey;
+
+void main(void) {
+
+  if (((vsKey[0] >> uBit) & 1u) == uBitValue) {
+    tfKey = vsKey[0];
+
+    EmitVertex();
+    EndPrimitive();
+  }
+
+}
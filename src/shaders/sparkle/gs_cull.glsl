@@ -0,0 +1,48 @@
+#version 410 core
+
+// ============================================================================
+
+/* Culling stage of the rendering :
+ * - filter particles out of the view frustum or too far
+ * - write the visible ones, their depth keys and storage index, packed,
+ * - write the storage index of the others on a second stream.
+ */
+
+// ============================================================================
+
+in vec3 vsPosition[1];
+in vec3 vsVelocity[1];
+in vec2 vsAge[1];
+in float vsDp[1];
+flat in int vsVisible[1];
+flat in uint vsId[1];
+
+layout(points) in;
+layout(points, max_vertices = 1) out;
+
+layout(stream = 0) out vec3 tfPosition;
+layout(stream = 0) out vec3 tfVelocity;
+layout(stream = 0) out vec2 tfAge;
+layout(stream = 0) out float tfDp;
+layout(stream = 0) flat out uint tfId;
+layout(stream = 1) flat out uint tfHiddenId;
+
+void main(void) {
+
+  if (vsVisible[0] != 0) {
+    tfPosition = vsPosition[0];
+    tfVelocity = vsVelocity[0];
+    tfAge = vsAge[0];
+    tfDp = vsDp[0];
+    tfId = vsId[0];
+
+    EmitStreamVertex(0);
+    EndStreamPrimitive(0);
+  } else {
+    tfHiddenId = vsId[0];
+
+    EmitStreamVertex(1);
+    EndStreamPrimitive(1);
+  }
+
+}
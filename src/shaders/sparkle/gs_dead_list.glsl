@@ -0,0 +1,28 @@
+#version 410 core
+
+// ============================================================================
+
+/* Stable slots storage :
+ * - write the slot of dead particles only.
+ */
+
+// ============================================================================
+
+flat in uint vsSlot[1];
+flat in int vsDead[1];
+
+layout(points) in;
+layout(points, max_vertices = 1) out;
+
+flat out uint tfSlot;
+
+void main(void) {
+
+  if (vsDead[0] != 0) {
+    tfSlot = vsSlot[0];
+
+    EmitVertex();
+    EndPrimitive();
+  }
+
+}
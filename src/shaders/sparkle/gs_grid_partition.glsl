@@ -0,0 +1,56 @@
+#version 410 core
+
+// ============================================================================
+
+/* Neighbours grid, transform feedback backend : one digit of a radix sort on
+ * the cell ids of the keys, least significant first.
+ * - write each key to the vertex stream of its digit, in their order.
+ *
+ * The streams drawn in turn by the next pass, the keys are partitioned
+ * stably. Keys past the cells, of dead particles, are dropped.
+ */
+
+// ============================================================================
+
+#include "sparkle/interop.h"
+
+uniform uint uShift;
+
+flat in uvec2 vsKey[1];
+
+layout(points) in;
+layout(points, max_vertices = 1) out;
+
+layout(stream = 0) flat out uvec2 tfKey0;
+layout(stream = 1) flat out uvec2 tfKey1;
+layout(stream = 2) flat out uvec2 tfKey2;
+layout(stream = 3) flat out uvec2 tfKey3;
+
+void main(void) {
+
+  uvec2 key = vsKey[0];
+  if (key.x >= uint(GRID_CELL_COUNT)) {
+    return;
+  }
+
+  //stream ids must be constant.
+  uint digit = (key.x >> uShift) & uint(GRID_PARTITION_COUNT - 1);
+  if (digit == 0u) {
+    tfKey0 = key;
+    EmitStreamVertex(0);
+    EndStreamPrimitive(0);
+  } else if (digit == 1u) {
+    tfKey1 = key;
+    EmitStreamVertex(1);
+    EndStreamPrimitive(1);
+  } else if (digit == 2u) {
+    tfKey2 = key;
+    EmitStreamVertex(2);
+    EndStreamPrimitive(2);
+  } else {
+    tfKey3 = key;
+    EmitStreamVertex(3);
+    EndStreamPrimitive(3);
+  }
+
+}
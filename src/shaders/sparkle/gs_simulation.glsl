@@ -3,13 +3,15 @@
 // ============================================================================
 
 /* Second Stage of the particle system :
- * - filter dead particles
+ * - filter dead particles, unless the storage keeps particles in their slots.
  */
 
 // ============================================================================
 in vec3 vsPosition[1];
 in vec2 vsAge[1];
 in vec3 vsVelocity[1];
+flat in uint vsAnchor[1];
+in vec3 vsCurl[1];
 
 layout(points) in;
 layout(points, max_vertices = 1) out;
@@ -17,13 +19,19 @@ layout(points, max_vertices = 1) out;
 out vec3 tfPosition;
 out vec3 tfVelocity;
 out vec2 tfAge;
+flat out uint tfAnchor;
+out vec3 tfCurl;
+
+uniform bool uStableSlots = false;
 
 void main(void) {
 
-  if ( vsAge[0].y > 0) {
+  if (uStableSlots || (vsAge[0].y > 0)) {
     tfPosition = vsPosition[0];
     tfVelocity = vsVelocity[0];
     tfAge = vsAge[0];
+    tfAnchor = vsAnchor[0];
+    tfCurl = vsCurl[0];
 
     EmitVertex();
     EndPrimitive();
@@ -1,8 +1,9 @@
 #version 410 core
 
+#include "sparkle/inc_sprite.glsl"
+
 uniform mat4 uMVP;
 uniform mat4 uView;
-uniform float uSpriteSizeRatio = 50.0f;
 
 layout(points) in;
 layout(triangle_strip, max_vertices = 4) out;
@@ -19,6 +20,7 @@ out GDataBlock {
   vec3 color;
   vec2 texcoord;
   float decay;
+  float depth;
 } OUT;
 
 void main() {
@@ -28,17 +30,9 @@ void main() {
   vec3 u = view * IN[0].velocity;
 
   //stretched billboard dimensions.
-  float w =0.15f;
-
-  float speed = smoothstep(0.0f, 500.0f, dot(u, u));
-  float h = w * mix(1.0f, uSpriteSizeRatio, speed);
-
-  //closer to 1, the particle velocity face the camera.
-  float nz = abs(normalize(u).z);
-  nz *= nz;
-
-  //when face to the camera, the particle is not stretched.
-  h = mix(h, w, nz);
+  vec2 half_size = GetSpriteHalfSize(u);
+  float w = half_size.x;
+  float h = half_size.y;
 
   //compute screen-space velocity.
   u.z = 0.0;
@@ -63,6 +57,7 @@ void main() {
   //emit the quad primitive.
   OUT.color = IN[0].color;
   OUT.decay = IN[0].decay;
+  OUT.depth = -(uView * vec4(IN[0].position, 1.0f)).z;
 
   vec3 p = IN[0].position;
   OUT.texcoord = vec2(0.0f, 0.0f); gl_Position = uMVP * vec4(p+W+S, 1.0f); EmitVertex();
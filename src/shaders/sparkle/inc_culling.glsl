@@ -0,0 +1,52 @@
+#ifndef SHADERS_CULLING_GLSL_
+#define SHADERS_CULLING_GLSL_
+
+// ----------------------------------------------------------------------------
+
+uniform mat4 uViewMatrix;
+//world space frustum planes, normals pointing inside.
+uniform vec4 uFrustumPlanes[6];
+//bounding radius of a rendered particle.
+uniform float uCullMargin;
+//upper bound of the rendering interpolation lag.
+uniform float uTimeStep;
+uniform float uMaxDistance;
+uniform bool uEnableCulling;
+
+// ----------------------------------------------------------------------------
+
+bool IsVisible(in vec3 pos, in float radius, in float distance) {
+  if (distance > uMaxDistance + radius) {
+    return false;
+  }
+  for (int i = 0; i < 6; ++i) {
+    if (dot(uFrustumPlanes[i].xyz, pos) + uFrustumPlanes[i].w < -radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+//dot product between the view space position and the view vector, giving the
+//distance of the particle to the camera.
+float GetDepthKey(in vec3 position) {
+  vec4 positionVS = uViewMatrix * vec4(position, 1.0f);
+
+  //the default front of camera in view space.
+  vec3 targetVS = vec3(0.0f, 0.0f, -1.0f);
+
+  return dot(targetVS, positionVS.xyz);
+}
+
+bool CullParticle(in vec3 position, in vec3 velocity, in vec2 age, in float dp) {
+  //the rendered position may lag behind along the velocity.
+  float radius = uCullMargin + uTimeStep * length(velocity);
+
+  //dead particles are kept in their slots by the stable storage.
+  bool alive = (age.y > 0.0f);
+  return !(alive && (!uEnableCulling || IsVisible(position, radius, dp)));
+}
+
+// ----------------------------------------------------------------------------
+
+#endif //SHADERS_CULLING_GLSL_
@@ -0,0 +1,108 @@
+#ifndef SHADERS_EMISSION_GLSL_
+#define SHADERS_EMISSION_GLSL_
+
+// -----------------------------------------------------------------------------
+//
+//      Particles creation from the emitters of the current batch.
+//
+//      Shared by the emission stage and the fused emission / simulation stage,
+//      a particle only depends on its slot index, so both produce the same
+//      particles.
+//
+//      This is not a MAIN shader, it must be included.
+//
+//------------------------------------------------------------------------------
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_math.glsl"
+#include "sparkle/inc_random.glsl"
+
+struct TEmitter {
+  mat4 transform;
+  vec4 velocity;  // xyz : initial velocity in emitter space.
+  vec4 params;    // x : shape, y : min age, z : max age.
+  uvec4 batch;    // x : first particle of the batch, y : particle count.
+};
+
+//emitters with at least one particle to emit this frame, ordered by batch.
+layout(std140) uniform Emitters {
+  TEmitter uEmitters[MAX_NUM_EMITTERS];
+};
+uniform uint uNumEmitters;
+//first slot written by the batch.
+uniform uint uEmitFirst;
+//target anchors, from which emitted particles pick one.
+uniform uint uAnchorCount;
+
+//return the emitter responsible for the given batch index.
+uint FindEmitter(const uint batch_id) {
+  uint first = 0u;
+  uint last = uNumEmitters - 1u;
+
+  while (first < last) {
+    uint mid = (first + last + 1u) / 2u;
+    if (uEmitters[mid].batch.x <= batch_id) {
+      first = mid;
+    } else {
+      last = mid - 1u;
+    }
+  }
+  return first;
+}
+
+//random position in the emitter local space.
+vec3 SampleShape(const int shape, in vec3 rn) {
+  vec3 pos = vec3(0.0f);
+
+  float theta = TwoPi() * rn.y;
+
+  if (shape == EMITTER_SHAPE_SPHERE) {
+    //uniform in the unit ball.
+    float cos_phi = 2.0f * rn.z - 1.0f;
+    float sin_phi = sqrt(1.0f - cos_phi * cos_phi);
+    float r = pow(rn.x, 1.0f / 3.0f);
+    pos = r * vec3(sin_phi * cos(theta), cos_phi, sin_phi * sin(theta));
+  } else if (shape == EMITTER_SHAPE_DISK) {
+    //uniform on the unit disk.
+    float r = sqrt(rn.x);
+    pos = vec3(r * cos(theta), 0.0f, r * sin(theta));
+  } else if (shape == EMITTER_SHAPE_BOX) {
+    pos = 2.0f * rn - 1.0f;
+  }
+
+  return pos;
+}
+
+//new particle of the batch index batch_id, stored in the slot gid.
+TParticle EmitParticle(const uint batch_id, const uint gid, const uint frame, const uint seed) {
+  TEmitter emitter = uEmitters[FindEmitter(batch_id)];
+
+  vec4 rn = RandomVec4(gid, frame, seed, 0u);
+
+  vec3 pos = SampleShape(int(emitter.params.x), rn.xyz);
+  pos = (emitter.transform * vec4(pos, 1.0f)).xyz;
+
+  //velocity follows the emitter orientation but not its scale.
+  mat3 basis = mat3(normalize(emitter.transform[0].xyz),
+                    normalize(emitter.transform[1].xyz),
+                    normalize(emitter.transform[2].xyz));
+
+  TParticle p;
+  p.position = pos;
+  p.velocity = rn.w * basis * emitter.velocity.xyz;
+  p.start_age = mix(emitter.params.y, emitter.params.z, RandomFloat(gid, frame, seed, 1u));
+  p.age = p.start_age;
+  p.anchor_id = (uAnchorCount > 0u) ? pcg4d(uvec4(gid, frame, seed, 3u)).x % uAnchorCount
+                                    : ANCHOR_NONE;
+  //evaluated on the first simulation step.
+  p.curl = vec3(0.0f);
+
+  return p;
+}
+
+//new particle for the slot gid, in [uEmitFirst, uEmitFirst + batch size).
+TParticle CreateParticle(const uint gid, const uint frame, const uint seed) {
+  return EmitParticle(gid - uEmitFirst, gid, frame, seed);
+}
+
+#endif //SHADERS_EMISSION_GLSL_
@@ -0,0 +1,34 @@
+#ifndef SHADERS_GRID_GLSL_
+#define SHADERS_GRID_GLSL_
+
+// -----------------------------------------------------------------------------
+//
+//      Uniform grid over the simulation box.
+//
+//      Cells are identified by their linear index, x varying fastest. The
+//      tables of the transform feedback backend lay them out in 2D textures,
+//      GRID_TABLE_WIDTH cells per row.
+//
+//      This is not a MAIN shader, it must be included.
+//
+//------------------------------------------------------------------------------
+
+#include "sparkle/interop.h"
+
+//cell containing a position, clamped to the grid.
+ivec3 GetCell(in vec3 pos, in float bbox_size) {
+  float cell_size = bbox_size / float(GRID_RESOLUTION);
+  ivec3 cell = ivec3(floor((pos + 0.5f * bbox_size) / cell_size));
+  return clamp(cell, ivec3(0), ivec3(GRID_RESOLUTION - 1));
+}
+
+uint GetCellId(in ivec3 cell) {
+  return uint((cell.z * GRID_RESOLUTION + cell.y) * GRID_RESOLUTION + cell.x);
+}
+
+//texel of the i-th value of a table laid out in rows of 'width' texels.
+ivec2 GetTableTexel(in uint i, in uint width) {
+  return ivec2(i % width, i / width);
+}
+
+#endif //SHADERS_GRID_GLSL_
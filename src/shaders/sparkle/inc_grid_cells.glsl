@@ -0,0 +1,59 @@
+#ifndef SHADERS_GRID_CELLS_GLSL_
+#define SHADERS_GRID_CELLS_GLSL_
+
+// -----------------------------------------------------------------------------
+//
+//      Cells lists of the uniform grid, compute backend.
+//
+//      A counting sort of the particles by cell : each cell lists all of its
+//      particles, contiguously in the indices buffer. The cells are scanned by
+//      blocks of GRID_SCAN_BLOCK_WIDTH, a list spanning from the first slot of
+//      its block plus its end within the block, minus its count. The
+//      positions are listed with the indices : the neighbours are read from
+//      that copy, the storage being updated in place with stable slots.
+//
+//      This is not a MAIN shader, it must be included.
+//
+//------------------------------------------------------------------------------
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_grid.glsl"
+
+layout(std430, binding = STORAGE_BINDING_GRID_CELLS)
+buffer GridCells {
+  uint cell_counts[GRID_CELL_COUNT];
+  //first slot of each cell within its block, its end once scattered.
+  uint cell_ends[GRID_CELL_COUNT];
+  //first slot of each block.
+  uint block_starts[GRID_SCAN_BLOCK_COUNT];
+};
+
+//particle indices, sorted by cell.
+layout(std430, binding = STORAGE_BINDING_GRID_INDICES)
+buffer GridIndices {
+  uint grid_indices[];
+};
+
+//particle positions, sorted by cell as their indices.
+layout(std430, binding = STORAGE_BINDING_GRID_POSITIONS)
+buffer GridPositions {
+  vec4 grid_positions[];
+};
+
+//slots of the particles of a cell, its list being [x, y).
+uvec2 GetCellRange(in uint cell_id) {
+  uint end = block_starts[cell_id / GRID_SCAN_BLOCK_WIDTH] + cell_ends[cell_id];
+  return uvec2(end - cell_counts[cell_id], end);
+}
+
+//particle listed in a slot.
+uint GetGridIndex(in uint slot) {
+  return grid_indices[slot];
+}
+
+//position of the particle listed in a slot.
+vec3 GetGridPosition(in uint slot, in uint index) {
+  return grid_positions[slot].xyz;
+}
+
+#endif //SHADERS_GRID_CELLS_GLSL_
@@ -0,0 +1,42 @@
+#ifndef SHADERS_GRID_TABLES_GLSL_
+#define SHADERS_GRID_TABLES_GLSL_
+
+// -----------------------------------------------------------------------------
+//
+//      Cells lists of the uniform grid, transform feedback backend.
+//
+//      The counting sort of the compute backend, without atomics : the cells
+//      counts are blended into a table, scanned into the range of each cell,
+//      and the particle indices partitioned by cell into a buffer. Ranges are
+//      stored as floats, exact for any particle count.
+//
+//      This is not a MAIN shader, it must be included.
+//
+//------------------------------------------------------------------------------
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_grid.glsl"
+
+//first slot and end of each cell list.
+uniform sampler2D uGridRangesSampler;
+//particle indices, sorted by cell.
+uniform usamplerBuffer uGridIndicesSampler;
+//positions of the particles read (first texel of each particle).
+uniform samplerBuffer uParticlesSampler;
+
+//slots of the particles of a cell, its list being [x, y).
+uvec2 GetCellRange(in uint cell_id) {
+  return uvec2(texelFetch(uGridRangesSampler, GetTableTexel(cell_id, GRID_TABLE_WIDTH), 0).xy);
+}
+
+//particle listed in a slot.
+uint GetGridIndex(in uint slot) {
+  return texelFetch(uGridIndicesSampler, int(slot)).x;
+}
+
+//position of the particle listed in a slot, read from its storage.
+vec3 GetGridPosition(in uint slot, in uint index) {
+  return texelFetch(uParticlesSampler, PARTICLE_ATTRIB_BUFFER_COUNT * int(index)).xyz;
+}
+
+#endif //SHADERS_GRID_TABLES_GLSL_
@@ -0,0 +1,54 @@
+#ifndef SHADERS_RANDOM_GLSL_
+#define SHADERS_RANDOM_GLSL_
+
+// -----------------------------------------------------------------------------
+//
+//      Stateless counter-based random numbers.
+//
+//      ref : 'Hash Functions for GPU Rendering' - Mark Jarzynski & Marc Olano
+//
+//      Each call hashes its whole key (particle slot, frame index, seed and a
+//      stream id), so there is no state to store nor to upload from the host.
+//
+//      This is not a MAIN shader, it must be included.
+//
+//------------------------------------------------------------------------------
+
+//PCG-based 4d hash, every input bit affects every output bit.
+uvec4 pcg4d(in uvec4 v) {
+  v = v * 1664525u + 1013904223u;
+
+  v.x += v.y * v.w;
+  v.y += v.z * v.x;
+  v.z += v.x * v.y;
+  v.w += v.y * v.z;
+
+  v ^= v >> 16u;
+
+  v.x += v.y * v.w;
+  v.y += v.z * v.x;
+  v.z += v.x * v.y;
+  v.w += v.y * v.z;
+
+  return v;
+}
+
+//map the 24 upper bits of an uint to a float in [0, 1).
+vec4 UintToUnitFloat(in uvec4 u) {
+  return vec4(u >> 8u) * (1.0f / 16777216.0f);
+}
+
+//four uniform values in [0, 1) for the given key.
+vec4 RandomVec4(in uint slot, in uint frame, in uint seed, in uint stream) {
+  return UintToUnitFloat(pcg4d(uvec4(slot, frame, seed, stream)));
+}
+
+vec3 RandomVec3(in uint slot, in uint frame, in uint seed, in uint stream) {
+  return RandomVec4(slot, frame, seed, stream).xyz;
+}
+
+float RandomFloat(in uint slot, in uint frame, in uint seed, in uint stream) {
+  return RandomVec4(slot, frame, seed, stream).x;
+}
+
+#endif //SHADERS_RANDOM_GLSL_
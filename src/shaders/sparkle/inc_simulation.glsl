@@ -0,0 +1,432 @@
+#ifndef SHADERS_SIMULATION_GLSL_
+#define SHADERS_SIMULATION_GLSL_
+
+// -----------------------------------------------------------------------------
+//
+//      Simulation step of a particle.
+//
+//      Shared by the transform feedback simulation stage and the compute
+//      simulation kernel, which only differ by how particles are read and
+//      written.
+//
+//      This is not a MAIN shader, it must be included.
+//
+//------------------------------------------------------------------------------
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_curlnoise.glsl"
+#include "sparkle/inc_random.glsl"
+#include "sparkle/inc_emission.glsl"
+#include "sparkle/inc_grid.glsl"
+
+#define ENABLE_SCATTERING         0
+#define ENABLE_VECTORFIELD        0
+#define ENABLE_CURLNOISE          1
+
+//advection scheme, chosen at shader-build time.
+#define INTEGRATOR_EULER          0
+#define INTEGRATOR_MIDPOINT       1
+#define INTEGRATOR_RK2            2   // Heun.
+#define INTEGRATOR_RK4            3
+
+#define SIMULATION_INTEGRATOR     INTEGRATOR_EULER
+
+//speed of the particles.
+#define PARTICLE_SPEED            10.0f
+
+//time integration step.
+uniform float uDeltaT;
+//vector field sampler.
+uniform sampler3D uVectorFieldSampler;
+//simulation box dimension.
+uniform float uBBoxSize;
+//random keys.
+uniform uint uFrame;
+uniform uint uSeed;
+//cells lists and positions of the particles read are included beforehand by
+//each backend.
+//neighbours interactions, disabled by a null radius.
+uniform float uInteractionRadius;
+uniform float uRepulsion;
+uniform float uCohesion;
+//target meshes anchors, in mesh space, and their model matrices.
+uniform samplerBuffer uAnchorsSampler;
+layout(std140) uniform AnchorModels {
+  mat4 uAnchorModels[MAX_NUM_ANCHOR_MODELS];
+};
+//pull toward the anchors, disabled when null.
+uniform float uTargetAttraction;
+//camera, used to select the particles level of detail.
+uniform mat4 uViewMatrix;
+//world space frustum planes, normals pointing inside.
+uniform vec4 uFrustumPlanes[6];
+//particles farther, or out of view, are updated every uLodPeriod steps.
+uniform float uLodDistance;
+uniform uint uLodPeriod = 1u;
+//curl noise added to the flow, refreshed every uCurlNoisePeriod steps and
+//cached in between. Disabled when null.
+uniform uint uCurlNoisePeriod = 0u;
+
+void UpdateParticle(inout TParticle p, in vec3 pos, in vec3 vel, in float age) {
+  p.position.xyz = pos;
+  p.velocity.xyz = vel;
+  p.age = age;
+}
+
+float UpdateAge(in TParticle p) {
+  float decay = 0.01*uDeltaT;
+  float age = clamp(p.age - decay, 0.0f, p.start_age);
+  return age;
+}
+
+vec3 ApplyForces() {
+  vec3 force = vec3(0.0f);
+
+#if ENABLE_SCATTERING
+  //add a random force to each particles.
+  const float scattering = 0.45f;
+  vec3 randvec = RandomVec3(uint(gl_VertexID), uFrame, uSeed, 2u);
+  vec3 randforce  = 2.0f * randvec - 1.0f;
+  force += scattering * randforce;
+#endif
+
+  return force;
+}
+
+vec3 ApplyRepulsion(in TParticle p) {
+  vec3 push = vec3(0.0f);
+/*
+  //IDEA
+  const vec3 vel = p.velocity.xyz;
+  const vec3 pos = p.position.xyz;
+  const float MAX_INFLUENCE_DISTANCE = 8.0f;
+
+  vec3 n;
+  float d = compute_gradient(pos, n);
+  float coeff = smoothstep(0.0f, MAX_INFLUENCE_DISTANCE, abs(d));
+  push = coeff * (n);
+  //vec3 side = cross(cross(n, normalize(vel + vec3(1e-5))), n);
+  //push = mix(push, side, coeff * coeff);
+*/
+  return push;
+}
+
+//repulsion from a neighbour within the radius, its position added to the center.
+void AddNeighbour(in TParticle p, in vec3 q, in float h,
+                  inout vec3 force, inout vec3 center, inout float count) {
+  vec3 d = p.position - q;
+  float r = length(d);
+
+  if ((r > 0.0f) && (r < h)) {
+    //repulsion fades out linearly with the distance.
+    float w = 1.0f - r / h;
+    force += (w * w / r) * d;
+    center += q;
+    count += 1.0f;
+  }
+}
+
+vec3 ApplyNeighbours(in TParticle p, in uint gid) {
+  vec3 force = vec3(0.0f);
+
+  if (uInteractionRadius <= 0.0f) {
+    return force;
+  }
+
+  float h = uInteractionRadius;
+  vec3 center = vec3(0.0f);
+  float count = 0.0f;
+
+  //the radius does not exceed a cell, so only the adjacent cells are visited.
+  ivec3 cell = GetCell(p.position, uBBoxSize);
+  for (int z = -1; z <= 1; ++z)
+  for (int y = -1; y <= 1; ++y)
+  for (int x = -1; x <= 1; ++x) {
+    ivec3 c = cell + ivec3(x, y, z);
+    if (any(lessThan(c, ivec3(0))) || any(greaterThanEqual(c, ivec3(GRID_RESOLUTION)))) {
+      continue;
+    }
+
+    //every particle of the cell, from its list.
+    uvec2 range = GetCellRange(GetCellId(c));
+    for (uint slot = range.x; slot < range.y; ++slot) {
+      uint index = GetGridIndex(slot);
+      if (index != gid) {
+        AddNeighbour(p, GetGridPosition(slot, index), h, force, center, count);
+      }
+    }
+  }
+  force *= uRepulsion;
+
+  //cohesion pulls toward the neighbours center.
+  if (count > 0.0f) {
+    force += uCohesion * (center / count - p.position);
+  }
+
+  return force;
+}
+
+vec3 ApplyTargetMesh(in TParticle p) {
+  vec3 pull = vec3(0.0f);
+
+  if ((p.anchor_id >= uAnchorCount) || (uTargetAttraction <= 0.0f)) {
+    return pull;
+  }
+
+  //the anchor is assigned at emission, and moved by its model matrix.
+  vec4 anchor = texelFetch(uAnchorsSampler, int(p.anchor_id));
+  mat4 anchorModel = uAnchorModels[int(anchor.w)];
+  vec3 target = (anchorModel * vec4(anchor.xyz, 1.0f)).xyz;
+
+  //full strength far from the anchor, fading when reaching it.
+  const float kPullFadeDistance = 4.0f;
+  pull = target - p.position;
+  float length_pull = length(pull);
+  float factor = uTargetAttraction * smoothstep(0.0f, kPullFadeDistance, length_pull);
+  pull *= factor / max(length_pull, 1.0e-5f);
+
+  return pull;
+}
+
+vec3 SampleVectorField(in vec3 pt) {
+  vec3 vfield = vec3(0.0f);
+
+#if 1 //ENABLE_VECTORFIELD
+
+  ivec3 texsize = textureSize(uVectorFieldSampler, 0).xyz;
+  vec3 extent = 0.5f * vec3(texsize.x, texsize.y, texsize.z);
+  vec3 texcoord = (pt + extent) / (2.0f * extent);
+
+  vfield = texture(uVectorFieldSampler, texcoord).xyz;
+
+  //custom GL_CLAMP_TO_BORDER
+  vec3 clamp_to_border = step(-extent, pt) * step(pt, +extent);
+  bool b = any(lessThan(clamp_to_border, vec3(1.0f)));
+  vfield = mix(vfield, vec3(0.0f), float(b));
+#endif
+
+  return vfield;
+}
+
+vec3 ApplyVectorField(in TParticle p) {
+  return SampleVectorField(p.position.xyz);
+}
+
+vec3 GetCurlNoise(in TParticle p) {
+  vec3 curl = vec3(0.0f);
+
+#if ENABLE_CURLNOISE
+  const float effect = 2.0f;
+  const float scale = 1.0f / 256.0f;
+  curl  = effect * compute_curl(p.position.xyz * scale);
+#endif
+
+  return curl;
+}
+
+//newborns have not been simulated yet.
+bool IsNewborn(in TParticle p) {
+  return (p.age >= p.start_age);
+}
+
+//staggers the periodic updates of the particles.
+//slots change as particles die, so phases are keyed by the particle lifetime,
+//random and constant over its life.
+uint GetPhase(in TParticle p) {
+  return pcg4d(uvec4(floatBitsToUint(p.start_age), p.anchor_id, uSeed, 4u)).x;
+}
+
+//curl noise of the particle in the slot gid, cached in its record. Whole
+//groups of slots refresh it on the same step, for their threads not to
+//diverge on its cost, and groups are staggered over the period. Newborns
+//have nothing cached yet.
+vec3 UpdateCurlNoise(inout TParticle p, in uint gid, in bool refresh) {
+  if (uCurlNoisePeriod == 0u) {
+    return vec3(0.0f);
+  }
+
+  uint phase = gid / PARTICLES_KERNEL_GROUP_WIDTH;
+  if (refresh || IsNewborn(p) || ((uFrame + phase) % uCurlNoisePeriod == 0u)) {
+    p.curl = GetCurlNoise(p);
+  }
+  return p.curl;
+}
+
+//true when the particle is far from the camera, or out of its view.
+bool IsLowDetail(in TParticle p) {
+  if ((uLodPeriod <= 1u) || IsNewborn(p)) {
+    return false;
+  }
+
+  //distance along the view direction.
+  float depth = -(uViewMatrix * vec4(p.position, 1.0f)).z;
+  if (depth > uLodDistance) {
+    return true;
+  }
+
+  //keep the particles about to enter the view at full detail.
+  float margin = PARTICLE_SPEED * uDeltaT * float(uLodPeriod);
+  for (int i = 0; i < 6; ++i) {
+    if (dot(uFrustumPlanes[i].xyz, p.position) + uFrustumPlanes[i].w < -margin) {
+      return true;
+    }
+  }
+  return false;
+}
+
+//particle velocity, given its own velocity and the flow where it is.
+vec3 AdvectionVelocity(in vec3 vel, in vec3 flow) {
+  return PARTICLE_SPEED * normalize(vel + flow);
+}
+
+//mean velocity over a step starting at pos, flow being the flow at pos.
+vec3 IntegrateAdvection(in vec3 pos, in vec3 vel, in vec3 flow, in float dt) {
+  vec3 k1 = AdvectionVelocity(vel, flow);
+
+#if SIMULATION_INTEGRATOR == INTEGRATOR_MIDPOINT
+  vec3 k2 = AdvectionVelocity(vel, SampleVectorField(pos + 0.5f * dt * k1));
+  return k2;
+#elif SIMULATION_INTEGRATOR == INTEGRATOR_RK2
+  vec3 k2 = AdvectionVelocity(vel, SampleVectorField(pos + dt * k1));
+  return 0.5f * (k1 + k2);
+#elif SIMULATION_INTEGRATOR == INTEGRATOR_RK4
+  vec3 k2 = AdvectionVelocity(vel, SampleVectorField(pos + 0.5f * dt * k1));
+  vec3 k3 = AdvectionVelocity(vel, SampleVectorField(pos + 0.5f * dt * k2));
+  vec3 k4 = AdvectionVelocity(vel, SampleVectorField(pos + dt * k3));
+  return (k1 + 2.0f * (k2 + k3) + k4) / 6.0f;
+#else
+  return k1;
+#endif
+}
+
+
+// ----------------------------------------------------------------------------
+
+void CollideSphere(float r, in vec3 center, inout vec3 pos, inout vec3 vel) {
+  vec3 p = pos - center;
+
+  float dp = dot(p, p);
+  float r2 = r*r;
+
+  if (dp > r2) {
+    vec3 n = -p * inversesqrt(dp);
+    vel = reflect(vel, n);
+
+    pos = center - r*n;
+  }
+}
+
+void CollideBox(in vec3 corner, in vec3 center, inout vec3 pos, inout vec3 vel) {
+  vec3 p = pos - center;
+
+  if (p.x < -corner.x) {
+    p.x = -corner.x;
+    vel = reflect(vel, vec3(1.0f,0.0f,0.0f));
+  }
+
+  if (p.x > corner.x) {
+    p.x = corner.x;
+    vel = reflect(vel, vec3(-1.0f,0.0f,0.0f));
+  }
+
+  if (p.y < -corner.y) {
+    p.y = -corner.y;
+    vel = reflect(vel, vec3(0.0f,1.0f,0.0f));
+  }
+
+  if (p.y > corner.y) {
+    p.y = corner.y;
+    vel = reflect(vel, vec3(0.0f,-1.0f,0.0f));
+  }
+
+  if (p.z < -corner.z) {
+    p.z = -corner.z;
+    vel = reflect(vel, vec3(0.0f,0.0f,1.0f));
+  }
+
+  if (p.z > corner.z) {
+    p.z = corner.z;
+    vel = reflect(vel, vec3(0.0f,0.0f,-1.0f));
+  }
+
+  pos = p + center;
+}
+
+void CollisionHandling(inout vec3 pos, inout vec3 vel) {
+  float r = 0.5f * uBBoxSize;
+
+  CollideSphere(r, vec3(0.0f), pos, vel);
+  CollideBox(vec3(r), vec3(0.0f), pos, vel);
+
+}
+
+//advance the particle gid by one step, return false once it is dead.
+bool SimulateParticle(inout TParticle p, in uint gid) {
+  vec3 dt = vec3(uDeltaT);
+
+  //update age.
+  /// [ dead particles still have a positive age, but are not push in render buffer.
+  ///   Still set their age to zero ? ]
+  float age = UpdateAge(p);
+
+  if ((age > 0.0f) && IsLowDetail(p)) {
+    //low detail : forces and flow are evaluated every uLodPeriod steps, over
+    //the time accumulated since, and the particle drifts in between.
+    vec3 vel = p.velocity.xyz;
+
+    if ((uFrame + GetPhase(p)) % uLodPeriod == 0u) {
+      vec3 lod_dt = dt * float(uLodPeriod);
+      vec3 force = ApplyForces() + ApplyTargetMesh(p);
+      vel = fma(force, lod_dt, vel);
+
+      //a single sample of the baked field, without neighbours. The curl
+      //noise is refreshed with them, already amortised.
+      vel = AdvectionVelocity(vel, ApplyVectorField(p) + UpdateCurlNoise(p, gid, true));
+    }
+
+    vec3 pos = fma(vel, dt, p.position.xyz);
+    CollisionHandling(pos, vel);
+
+    UpdateParticle(p, pos, vel, age);
+  } else if (age > 0.0f) {
+    //apply external forces.
+    vec3 force = ApplyForces();
+
+    //apply repulsion on simple objects.
+    //force += ApplyRepulsion(p);
+
+    //apply repulsion and cohesion between particles.
+    force += ApplyNeighbours(p, gid);
+
+    //apply mesh targeting.
+    force += ApplyTargetMesh(p);
+
+    //apply vector field.
+    //force += ApplyVectorField(p);
+
+    //integrate velocity.
+    vec3 vel = fma(force, dt, p.velocity.xyz);
+
+    //get curling noise.
+    vec3 noise_vel = ApplyVectorField(p) + UpdateCurlNoise(p, gid, false);
+
+    //advect through the flow.
+    vel = IntegrateAdvection(p.position.xyz, vel, noise_vel, uDeltaT);
+
+    //integrate position.
+    vec3 pos = fma(vel, dt, p.position.xyz);
+
+    //handle collision.
+    CollisionHandling(pos, vel);
+
+    //update particle.
+    UpdateParticle(p, pos, vel, age);
+  } else {
+    //dead, kept in its slot when the storage is stable.
+    p.age = 0.0f;
+  }
+
+  return (p.age > 0.0f);
+}
+
+#endif //SHADERS_SIMULATION_GLSL_
@@ -0,0 +1,54 @@
+#ifndef SHADERS_SORT_CARRY_GLSL_
+#define SHADERS_SORT_CARRY_GLSL_
+
+// -----------------------------------------------------------------------------
+//
+//      Carried order of the incremental sort, compute backend.
+//
+//      The simulation appends the particles in any order : instead of their
+//      storage, each one carries its rank in the last sorted order. The keys
+//      of the visible particles are packed by rank, compacted by blocks of
+//      SORT_RANK_BLOCK_WIDTH ranks, a slot spanning from the first one of its
+//      block plus its offset within the block. The particles without a rank
+//      are appended after them.
+//
+//      This is not a MAIN shader, it must be included.
+//
+//------------------------------------------------------------------------------
+
+#include "sparkle/interop.h"
+
+//rank of the particles of the second buffer, the ones culled.
+layout(std430, binding = STORAGE_BINDING_SORT_RANKS_SECOND)
+buffer SortRanks {
+  uint sort_ranks[];
+};
+
+//storage index of the visible particles, in culling order.
+layout(std430, binding = STORAGE_BINDING_CULLED_IDS)
+buffer CulledIds {
+  uint culled_ids[];
+};
+
+layout(std430, binding = STORAGE_BINDING_SORT_CARRY)
+buffer SortCarry {
+  //ranks of the visible particles marked, then their slot within the block.
+  uint rank_offsets[MAX_SORT_RANK_COUNT];
+  //first slot of each block, the last one past the ranked particles.
+  uint rank_block_starts[SORT_RANK_BLOCK_COUNT + 1];
+  //particles without a rank, appended.
+  uint unranked_count;
+  //inversions of the sorted order, then of the carried one.
+  uint inversion_counts[2];
+};
+
+//ranks of the last sort, the ones past it being none.
+uniform uint uRankCount;
+
+//rank of a visible particle in the last sorted order.
+uint GetCarriedRank(in uint culled_id) {
+  uint rank = sort_ranks[culled_ids[culled_id]];
+  return (rank < uRankCount) ? rank : SORT_RANK_NONE;
+}
+
+#endif //SHADERS_SORT_CARRY_GLSL_
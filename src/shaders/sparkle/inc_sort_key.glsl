@@ -0,0 +1,33 @@
+#ifndef SHADERS_SORT_KEY_GLSL_
+#define SHADERS_SORT_KEY_GLSL_
+
+// ----------------------------------------------------------------------------
+
+/* Sort keys pack the depth of a visible particle, quantised on the high 16
+ * bits, with its index on the low ones : comparing two keys compares their
+ * depth, and the index moves along with it.
+ */
+
+//maps the depth range of the visible particles to [0, 65535].
+uniform float uDepthScale;
+
+//keys past the visible particles, sorting last.
+#define SORT_KEY_PADDING    0u
+
+uint PackSortKey(in float depth, in uint index) {
+  uint quantized_depth = uint(clamp(depth * uDepthScale, 0.0f, 65535.0f));
+  return (quantized_depth << 16u) | (index & 0xffffu);
+}
+
+uint UnpackSortIndex(in uint key) {
+  return key & 0xffffu;
+}
+
+//depth bucket of a key among 2^bucket_bits, the farthest first.
+uint GetSortBucket(in uint key, in uint bucket_bits) {
+  return (~key) >> (32u - bucket_bits);
+}
+
+// ----------------------------------------------------------------------------
+
+#endif //SHADERS_SORT_KEY_GLSL_
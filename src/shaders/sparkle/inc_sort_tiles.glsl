@@ -0,0 +1,65 @@
+#ifndef SHADERS_SORT_TILES_GLSL_
+#define SHADERS_SORT_TILES_GLSL_
+
+// ----------------------------------------------------------------------------
+
+/* Screen tiles of the tiled sort : the viewport is split in a grid of tiles,
+ * a sprite being listed in every tile its bounds overlap. Tiles are indexed
+ * by rows, from the bottom left one.
+ */
+
+#include "sparkle/inc_sprite.glsl"
+
+uniform mat4 uView;
+uniform mat4 uViewProj;
+//tiles per side of the viewport.
+uniform uint uTileGrid;
+//upper bound of the rendering interpolation lag.
+uniform float uTimeStep;
+
+//bounds slightly enlarged against the rounding of the rasterization.
+#define SORT_TILE_EPSILON   1.0e-3f
+
+// ----------------------------------------------------------------------------
+
+//first and last tiles, inclusive, overlapped by the box around a sprite.
+//False when off screen, the whole screen when the box crosses the camera plane.
+bool GetSpriteTiles(in vec3 position, in vec3 velocity, out uvec4 tiles) {
+  //the rendered position may lag behind along the velocity.
+  vec2 half_size = GetSpriteHalfSize(mat3(uView) * velocity);
+  float radius = length(half_size) + uTimeStep * length(velocity);
+
+  vec2 lo = vec2(1.0e30f);
+  vec2 hi = vec2(-1.0e30f);
+  bool crossing = false;
+  for (int i = 0; i < 8; ++i) {
+    vec3 corner = vec3(((i & 1) != 0) ? radius : -radius,
+                       ((i & 2) != 0) ? radius : -radius,
+                       ((i & 4) != 0) ? radius : -radius);
+    vec4 clip = uViewProj * vec4(position + corner, 1.0f);
+    if (clip.w <= 0.0f) {
+      crossing = true;
+    } else {
+      lo = min(lo, clip.xy / clip.w);
+      hi = max(hi, clip.xy / clip.w);
+    }
+  }
+  if (crossing) {
+    lo = vec2(-1.0f);
+    hi = vec2(1.0f);
+  }
+  if (any(greaterThan(lo, vec2(1.0f))) || any(lessThan(hi, vec2(-1.0f)))) {
+    return false;
+  }
+
+  //from normalized device coordinates to tiles.
+  float grid = float(uTileGrid);
+  vec2 first = clamp((0.5f * lo + 0.5f) * grid - SORT_TILE_EPSILON, 0.0f, grid - 1.0f);
+  vec2 last = clamp((0.5f * hi + 0.5f) * grid + SORT_TILE_EPSILON, 0.0f, grid - 1.0f);
+  tiles = uvec4(uvec2(first), uvec2(last));
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+
+#endif //SHADERS_SORT_TILES_GLSL_
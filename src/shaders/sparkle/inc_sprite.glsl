@@ -0,0 +1,27 @@
+#ifndef SHADERS_SPRITE_GLSL_
+#define SHADERS_SPRITE_GLSL_
+
+// ----------------------------------------------------------------------------
+
+//stretch of the sprites at full speed.
+uniform float uSpriteSizeRatio = 50.0f;
+
+//half width and half height of a stretched sprite, from its view space
+//velocity : stretched along the velocity as it speeds up, but not when the
+//velocity faces the camera.
+vec2 GetSpriteHalfSize(in vec3 u) {
+  float w = 0.15f;
+
+  float speed = smoothstep(0.0f, 500.0f, dot(u, u));
+  float h = w * mix(1.0f, uSpriteSizeRatio, speed);
+
+  //closer to 1, the particle velocity face the camera.
+  float nz = (dot(u, u) > 0.0f) ? abs(normalize(u).z) : 1.0f;
+  nz *= nz;
+
+  return vec2(w, mix(h, w, nz));
+}
+
+// ----------------------------------------------------------------------------
+
+#endif //SHADERS_SPRITE_GLSL_
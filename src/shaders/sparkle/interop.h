@@ -12,16 +12,136 @@
 
 // ----------------------------------------------------------------------------
 
+#ifdef __cplusplus
+# define SHADER_UINT  unsigned int
+#else
+# define SHADER_UINT  uint
+#endif
+
+// ----------------------------------------------------------------------------
+
 // Kernel group width used across the particles pipeline.
 #define PARTICLES_KERNEL_GROUP_WIDTH      256u
 
+// Maximum number of emitters serviced by one emission pass.
+#define MAX_NUM_EMITTERS                  64
+
+// Depth buckets of the approximate sort at most, scanned by a single kernel group.
+#define MAX_SORT_BUCKET_COUNT             1024
+
+// Compute backend incremental sort : rank of each particle in the last sorted
+// order, none for the ones not sorted. The ranks of the visible particles are
+// compacted by blocks, 16 bits sort indices bounding their count.
+#define SORT_RANK_NONE                    0xffffffffu
+#define MAX_SORT_RANK_COUNT               65536
+#define SORT_RANK_BLOCK_WIDTH             1024
+#define SORT_RANK_BLOCK_COUNT             (MAX_SORT_RANK_COUNT / SORT_RANK_BLOCK_WIDTH)
+
+// Screen tiles per side of the tiled sort at most, their counts scanned as buckets.
+#define MAX_SORT_TILE_GRID                16
+// Keys of a tile list sorted in shared memory at most, longer lists in place.
+#define SORT_TILE_SHARED_KEYS             2048
+
+// Emitter shapes, in emitter local space.
+#define EMITTER_SHAPE_POINT               0
+#define EMITTER_SHAPE_SPHERE              1   // unit ball.
+#define EMITTER_SHAPE_DISK                2   // unit disk in the XZ plane.
+#define EMITTER_SHAPE_BOX                 3   // [-1, 1] cube.
+
+// vec4 per particle in the particles buffers.
+#define PARTICLE_ATTRIB_BUFFER_COUNT      3
+// vec4 per particle in the culled buffer (position, velocity, age).
+#define CULLED_ATTRIB_BUFFER_COUNT        2
+
+// Uniform buffer binding points.
+#define UNIFORM_BINDING_EMITTERS          0
+#define UNIFORM_BINDING_ANCHOR_MODELS     1
+
+// Shader storage and atomic counter binding points, compute backend.
+#define STORAGE_BINDING_PARTICLES_FIRST   0
+#define STORAGE_BINDING_PARTICLES_SECOND  1
+#define STORAGE_BINDING_COUNTERS          2
+#define STORAGE_BINDING_INDIRECT_ARGS     3
+#define STORAGE_BINDING_DOT_PRODUCTS      4
+#define STORAGE_BINDING_INDICES_FIRST     5
+#define STORAGE_BINDING_INDICES_SECOND    6
+#define STORAGE_BINDING_SORTED_INDICES    7
+#define STORAGE_BINDING_CULLED_PARTICLES  8
+#define STORAGE_BINDING_DRAW_ARGS         9
+#define STORAGE_BINDING_SORT_BUCKETS      10
+#define STORAGE_BINDING_SORT_TILES        11
+#define STORAGE_BINDING_TILE_DRAW_ARGS    12
+#define STORAGE_BINDING_GRID_CELLS        13
+#define STORAGE_BINDING_GRID_INDICES      14
+#define STORAGE_BINDING_SORT_RANKS_FIRST  15
+#define STORAGE_BINDING_SORT_RANKS_SECOND 16
+#define STORAGE_BINDING_CULLED_IDS        17
+#define STORAGE_BINDING_SORT_CARRY        18
+#define STORAGE_BINDING_DEAD_SLOTS        19
+#define STORAGE_BINDING_GRID_POSITIONS    20
+#define ATOMIC_COUNTER_BINDING_COUNTERS   0
+
+// Model matrices of the target meshes anchors.
+#define MAX_NUM_ANCHOR_MODELS             64
+// Anchor of a particle without target.
+#define ANCHOR_NONE                       0xffffffffu
+
+// Uniform grid used for the neighbours search, in the simulation box.
+#define GRID_RESOLUTION                   64  // cells per axis.
+// Cells lists, a counting sort of the particles by cell.
+#define GRID_CELL_COUNT                   (GRID_RESOLUTION * GRID_RESOLUTION * GRID_RESOLUTION)
+// Compute backend, cells counts scanned by blocks of cells.
+#define GRID_SCAN_BLOCK_WIDTH             1024
+#define GRID_SCAN_BLOCK_COUNT             (GRID_CELL_COUNT / GRID_SCAN_BLOCK_WIDTH)
+// Cells tables of the transform feedback backend, and the cell id bits its
+// scatter partitions per pass, one vertex stream per digit.
+#define GRID_TABLE_WIDTH                  512
+#define GRID_PARTITION_BITS               2
+#define GRID_PARTITION_COUNT              (1 << GRID_PARTITION_BITS)
+
 struct TParticle {
   vec3 position;
   vec3 velocity;
   float start_age;
   float age;
-//  float _padding0;
-//  uint id;
+  SHADER_UINT anchor_id;
+  vec3 curl;          // curl noise, cached between two refreshes.
+};
+
+// Indirect dispatch arguments of the simulation, and its particle counts.
+struct TIndirectArgs {
+  SHADER_UINT dispatch_x;
+  SHADER_UINT dispatch_y;
+  SHADER_UINT dispatch_z;
+  SHADER_UINT read_count;   // particles consumed from the first buffer.
+  SHADER_UINT emit_count;   // particles created after them.
+};
+
+// Queue of the dead slots of the stable storage, compute backend : a ring of
+// positions kept by the dead slots themselves, the oldest ones taken first by
+// the newborns.
+struct TDeadSlots {
+  SHADER_UINT head;         // oldest dead slot queued.
+  SHADER_UINT count;        // dead slots queued, from the head on.
+  SHADER_UINT pushed;       // slots died this step, queued after them.
+  SHADER_UINT popped;       // slots taken by the newborns of this step.
+};
+
+// Indirect draw arguments, as read by glDrawArraysIndirect.
+struct TDrawArraysArgs {
+  SHADER_UINT count;
+  SHADER_UINT instance_count;
+  SHADER_UINT first;
+  SHADER_UINT base_instance;
+};
+
+// Indirect draw arguments, as read by glDrawElementsIndirect.
+struct TDrawElementsArgs {
+  SHADER_UINT count;
+  SHADER_UINT instance_count;
+  SHADER_UINT first_index;
+  SHADER_UINT base_vertex;
+  SHADER_UINT base_instance;
 };
 
 #undef SHADER_UINT
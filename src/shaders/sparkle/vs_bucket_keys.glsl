@@ -0,0 +1,22 @@
+#version 410 core
+
+/*
+ * Depth buckets sort : pack the depth key of each visible particle with its
+ * index, in culling order. The keys past the visible ones are padding, left
+ * after them by the partitions.
+*/
+
+#include "sparkle/inc_sort_key.glsl"
+
+//depth key written by the culling.
+layout(location = 0) in float dp;
+
+//visible particles, counted on the device.
+uniform usampler2D uVisibleCount;
+
+flat out uint tfKey;
+
+void main() {
+  uint count = texelFetch(uVisibleCount, ivec2(0), 0).x;
+  tfKey = (uint(gl_VertexID) < count) ? PackSortKey(dp, uint(gl_VertexID)) : SORT_KEY_PADDING;
+}
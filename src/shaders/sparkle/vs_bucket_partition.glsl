@@ -0,0 +1,9 @@
+#version 410 core
+
+in uint key;
+
+flat out uint vsKey;
+
+void main() {
+  vsKey = key;
+}
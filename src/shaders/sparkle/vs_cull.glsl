@@ -0,0 +1,34 @@
+#version 410 core
+
+/*
+ * Test particles against the view frustum and the culling distance, and
+ * compute in view space the dot product between the position of those kept
+ * and the view vector, giving their distance to the camera.
+ *
+ * Used to sort only the visible particles for alpha-blending before rendering.
+*/
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_culling.glsl"
+
+in vec3 position;
+in vec3 velocity;
+in vec2 age;
+
+out vec3 vsPosition;
+out vec3 vsVelocity;
+out vec2 vsAge;
+out float vsDp;
+flat out int vsVisible;
+flat out uint vsId;
+
+void main() {
+  float dp = GetDepthKey(position);
+
+  vsPosition = position;
+  vsVelocity = velocity;
+  vsAge = age;
+  vsDp = dp;
+  vsVisible = CullParticle(position, velocity, age, dp) ? 0 : 1;
+  vsId = uint(gl_VertexID);
+}
@@ -0,0 +1,20 @@
+#version 410 core
+
+/*
+ * Stable slots storage : list the slots of the dead particles, by increasing
+ * index, to be filled by the next emission. The fresh slots past the ones
+ * used are listed last, whatever they hold.
+*/
+
+//shares the grid building vertex arrays.
+layout(location = 1) in vec2 age;
+
+uniform uint uFirstFreshSlot;
+
+flat out uint vsSlot;
+flat out int vsDead;
+
+void main() {
+  vsSlot = uint(gl_VertexID);
+  vsDead = ((vsSlot >= uFirstFreshSlot) || (age.y <= 0.0f)) ? 1 : 0;
+}
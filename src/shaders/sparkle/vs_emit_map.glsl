@@ -0,0 +1,29 @@
+#version 410 core
+
+/*
+ * Stable slots storage : write in the slot receiving each particle of the
+ * emission batch its batch index, plus one so that zero marks no emission.
+ *
+ * The batch indices take the listed slots in order : the dead ones, then the
+ * fresh ones past the last one used. The list holds a slot per newborn at
+ * least, its count is never read back.
+*/
+
+//slots of the dead particles, then the fresh ones.
+uniform usamplerBuffer uDeadSlotsSampler;
+//dimensions of the emission map, one texel per slot.
+uniform ivec2 uEmitMapSize;
+
+flat out uint vBatchIndex;
+
+void main() {
+  uint batch_id = uint(gl_VertexID);
+  uint slot = texelFetch(uDeadSlotsSampler, int(batch_id)).r;
+
+  ivec2 texel = ivec2(int(slot) % uEmitMapSize.x, int(slot) / uEmitMapSize.x);
+  vec2 ndc = 2.0f * (vec2(texel) + 0.5f) / vec2(uEmitMapSize) - 1.0f;
+
+  gl_Position = vec4(ndc, 0.0f, 1.0f);
+  gl_PointSize = 1.0f;
+  vBatchIndex = batch_id + 1u;
+}
@@ -0,0 +1,15 @@
+#version 410 core
+
+/*
+ * Incremental sort : gather the storage index of the visible particles in
+ * their sorted order, for the next simulation to write them in that order.
+*/
+
+//storage index of the culled particles, read through the sorted indices.
+in uint id;
+
+flat out uint tfSortedId;
+
+void main() {
+  tfSortedId = id;
+}
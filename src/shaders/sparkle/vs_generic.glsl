@@ -5,6 +5,8 @@ layout(location = 1) in vec3 velocity;
 layout(location = 2) in vec2 age_info;
 
 uniform mat4 uMVP;
+//time between the rendered instant and the last simulated state.
+uniform float uTimeLag = 0.0f;
 
 out VDataBlock {
   vec3 position;
@@ -44,7 +46,9 @@ float compute_size(float z, float decay) {
 }
 
 void main() {
-  vec3 p = position.xyz;
+  //positions are integrated with the last velocity, so stepping back along it
+  //interpolates between the two last simulated states.
+  vec3 p = position.xyz - uTimeLag * velocity.xyz;
 
   //time alived in [0, 1].
   float dAge = 1.0f - maprange(0.0f, age_info.x, age_info.y);
@@ -0,0 +1,26 @@
+#version 410 core
+
+/*
+ * Neighbours grid, transform feedback backend : count the alive particles of
+ * each cell, each one drawn to the texel of its cell with an additive blending.
+*/
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_grid.glsl"
+
+uniform float uBBoxSize;
+
+//shared with the dead slots listing.
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec2 age;
+
+void main() {
+  ivec2 texel = GetTableTexel(GetCellId(GetCell(position, uBBoxSize)), GRID_TABLE_WIDTH);
+  vec2 texsize = vec2(GRID_TABLE_WIDTH, GRID_CELL_COUNT / GRID_TABLE_WIDTH);
+
+  //dead : move out of the viewport.
+  vec2 ndc = (age.y > 0.0f) ? (2.0f * (vec2(texel) + 0.5f) / texsize - 1.0f) : vec2(2.0f);
+
+  gl_Position = vec4(ndc, 0.0f, 1.0f);
+  gl_PointSize = 1.0f;
+}
@@ -0,0 +1,14 @@
+#version 410 core
+
+/*
+ * Neighbours grid, transform feedback backend : particle index of the keys
+ * partitioned by cell, the streams of the last partition drawn in turn.
+*/
+
+layout(location = 0) in uvec2 key;
+
+flat out uint tfIndex;
+
+void main() {
+  tfIndex = key.y;
+}
@@ -0,0 +1,22 @@
+#version 410 core
+
+/*
+ * Neighbours grid, transform feedback backend : key of each particle, its
+ * cell with its index, partitioned next. Dead particles get past the cells.
+*/
+
+#include "sparkle/interop.h"
+#include "sparkle/inc_grid.glsl"
+
+uniform float uBBoxSize;
+
+//shared with the dead slots listing.
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec2 age;
+
+flat out uvec2 vsKey;
+
+void main() {
+  uint cell_id = (age.y > 0.0f) ? GetCellId(GetCell(position, uBBoxSize)) : uint(GRID_CELL_COUNT);
+  vsKey = uvec2(cell_id, uint(gl_VertexID));
+}
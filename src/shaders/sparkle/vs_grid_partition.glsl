@@ -0,0 +1,9 @@
+#version 410 core
+
+layout(location = 0) in uvec2 key;
+
+flat out uvec2 vsKey;
+
+void main() {
+  vsKey = key;
+}
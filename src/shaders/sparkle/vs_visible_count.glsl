@@ -0,0 +1,22 @@
+#version 410 core
+
+/*
+ * Culling : count the visible particles on the device, drawn from the
+ * transform feedback of the culling without reading its count back.
+ *
+ * Every particle covers the single texel of the count, and fragments are
+ * written in drawing order : the last one leaves the count.
+*/
+
+//depth key written by the culling. Read for the draw to be sized from its
+//buffer : some drivers count the vertices of a feedback with the stride of
+//the first vertex buffer read.
+layout(location = 0) in float dp;
+
+flat out uint vCount;
+
+void main() {
+  gl_Position = vec4(0.0f, 0.0f, clamp(dp, -1.0f, 1.0f), 1.0f);
+  gl_PointSize = 1.0f;
+  vCount = uint(gl_VertexID) + 1u;
+}
@@ -0,0 +1,314 @@
+// ============================================================================
+//
+//  Pass count and device time of the particles back-to-front sort, per
+//  particle count and number of bitonic stages within a texel of four keys
+//  fused in a fragment pass.
+//
+//  For each count, the particles are emitted in a single step, culling is
+//  disabled so all of them are sorted, and the sort of the following updates
+//  is timed with timestamp queries. The host sort is timed on the host, from
+//  the readback of the depths to the upload of the indices.
+//
+//  The depth buckets sort is then timed per number of buckets, and its visual
+//  error measured against the exact sort : two systems seeded alike are
+//  updated in turn, alpha-blended offscreen, and their images compared.
+//
+//  Last, the weighted blended order independent transparency, unsorted, is
+//  compared to the premultiplied blending of the exact sort : device time of
+//  an update and its rendering, and visual error.
+//
+//  Build from src/, then run from a scratch directory out of the source tree :
+//  the vector field cache velocities.dat (200 MB) is read from, or written to,
+//  the working directory.
+//    g++ -std=c++14 -O2 -DUSE_GLEW -DSHADERS_DIR=\"$PWD/shaders\" -I. -I../thirdparty \
+//        ../tools/sort_benchmark/sort_benchmark.cc opengl.cc api/*.cc \
+//        -lglfw -lGLEW -lGL -lpthread -o /tmp/sort_benchmark
+//    mkdir -p /tmp/sparkle_run && cd /tmp/sparkle_run && /tmp/sort_benchmark
+//
+// ============================================================================
+
+#include "opengl.h"
+#include "api/gpu_particle.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+unsigned int const kMinParticleCount = 1u << 10u;
+unsigned int const kMaxParticleCount = 1u << 16u;
+unsigned int const kNumIterations = 16u;
+unsigned int const kMinSortBucketCount = 16u;
+int const kImageSize = 256;
+
+//particles emitted in a sphere in front of the camera.
+struct TSetup {
+  float distance;     //< from the camera to the sphere center.
+  float radius;
+  float lifetime;
+  float speed;
+};
+
+//long lived particles, for the timings.
+TSetup const kTimingSetup = {300.0f, 64.0f, 1000.0f, 0.0f};
+
+//for the images, the sprites fade in and out over their life and stretch
+//along their velocity : a dense cloud of visible ones, seen from close.
+TSetup const kImageSetup = {14.0f, 8.0f, 0.5f, 20.0f};
+
+GLFWwindow* CreateContext() {
+  if (!glfwInit()) {
+    fprintf(stderr, "Error: failed to initialize GLFW.\n");
+    return nullptr;
+  }
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, 0);
+
+  GLFWwindow *window = glfwCreateWindow(64, 64, "sort_benchmark", nullptr, nullptr);
+  if (!window) {
+    fprintf(stderr, "Error: failed to create the window.\n");
+    glfwTerminate();
+    return nullptr;
+  }
+  glfwMakeContextCurrent(window);
+  return window;
+}
+
+void GetCamera(TSetup const &setup, mat4x4 view, mat4x4 viewProj) {
+  mat4x4 proj;
+  vec3 eye = {0.0f, 0.0f, setup.distance};
+  vec3 center = {0.0f, 0.0f, 0.0f};
+  vec3 up = {0.0f, 1.0f, 0.0f};
+  mat4x4_look_at(view, eye, center, up);
+  mat4x4_perspective(proj, 1.0f, 1.0f, 0.1f, 1000.0f);
+  mat4x4_mul(viewProj, proj, view);
+}
+
+//the random seeds of a system are drawn at init, systems initialized from
+//the same seed simulate alike.
+void InitParticles(GPUParticle &particle, unsigned int const count, TSetup const &setup,
+                   mat4x4 const &view, mat4x4 const &viewProj) {
+  srand(0u);
+  particle.backend(GPUParticle::kBackendTransformFeedback);
+  particle.init();
+  particle.enable_culling(false);
+
+  //emit every particle in the first step.
+  float const dt = 1.0f / particle.simulation_rate();
+  GPUParticle::Emitter emitter;
+  emitter.shape = GPUParticle::kEmitterSphere;
+  emitter.rate = count / dt;
+  emitter.min_age = emitter.max_age = setup.lifetime;
+  emitter.velocity[1] = setup.speed;
+  mat4x4_scale_aniso(emitter.transform, emitter.transform, setup.radius, setup.radius, setup.radius);
+  particle.add_emitter(emitter);
+  particle.update(dt, view, viewProj);
+  particle.emitter(0u).rate = 0.0f;
+}
+
+//mean sort time in ms, and the passes of the sort.
+float BenchmarkSort(unsigned int const count, unsigned int const stages_per_pass,
+                    GPUParticle::SortMode const mode, unsigned int const bucket_count,
+                    unsigned int *pass_count) {
+  mat4x4 view, viewProj;
+  GetCamera(kTimingSetup, view, viewProj);
+
+  GPUParticle particle;
+  InitParticles(particle, count, kTimingSetup, view, viewProj);
+  particle.sort_stages_per_pass(stages_per_pass);
+  particle.sort_mode(mode);
+  particle.sort_bucket_count(bucket_count);
+
+  float const dt = 1.0f / particle.simulation_rate();
+  particle.enable_sort_timing(true);
+  float total = 0.0f;
+  for (unsigned int i = 0u; i < kNumIterations; ++i) {
+    particle.update(dt, view, viewProj);
+    total += particle.sort_time();
+  }
+  *pass_count = particle.sort_pass_count();
+
+  particle.deinit();
+  return total / kNumIterations;
+}
+
+//alpha-blended particles, as rendered by the scene, read back as RGBA8.
+void RenderImage(GPUParticle &particle, mat4x4 const &view, mat4x4 const &viewProj,
+                 std::vector<GLubyte> &pixels) {
+  glViewport(0, 0, kImageSize, kImageSize);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  particle.render(view, viewProj);
+  glDisable(GL_BLEND);
+
+  pixels.resize(4u * kImageSize * kImageSize);
+  glReadPixels(0, 0, kImageSize, kImageSize, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+}
+
+//images of the updates of a system, rendered offscreen, and the mean device
+//time in ms of an update and its rendering.
+float RenderSequence(unsigned int const count, GPUParticle::SortMode const mode,
+                     unsigned int const bucket_count, GPUParticle::BlendMode const blend_mode,
+                     std::vector<std::vector<GLubyte>> &images) {
+  mat4x4 view, viewProj;
+  GetCamera(kImageSetup, view, viewProj);
+
+  GLuint framebuffer = 0u;
+  GLuint renderbuffer = 0u;
+  glGenRenderbuffers(1, &renderbuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, kImageSize, kImageSize);
+  glGenFramebuffers(1, &framebuffer);
+
+  GLuint queries[2] = {0u, 0u};
+  glGenQueries(2, queries);
+
+  GPUParticle particle;
+  InitParticles(particle, count, kImageSetup, view, viewProj);
+  particle.sort_mode(mode);
+  particle.sort_bucket_count(bucket_count);
+  particle.blend_mode(blend_mode);
+
+  float const dt = 1.0f / particle.simulation_rate();
+  float total = 0.0f;
+  images.resize(kNumIterations);
+  for (unsigned int i = 0u; i < kNumIterations; ++i) {
+    glQueryCounter(queries[0], GL_TIMESTAMP);
+    particle.update(dt, view, viewProj);
+
+    //the sort binds the default framebuffer back.
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+    RenderImage(particle, view, viewProj, images[i]);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0u);
+    glQueryCounter(queries[1], GL_TIMESTAMP);
+
+    GLuint64 start = 0u;
+    GLuint64 end = 0u;
+    glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &end);
+    total += static_cast<float>(end - start) * 1.0e-6f;
+  }
+
+  particle.deinit();
+  glDeleteQueries(2, queries);
+  glDeleteFramebuffers(1, &framebuffer);
+  glDeleteRenderbuffers(1, &renderbuffer);
+
+  return total / kNumIterations;
+}
+
+//root mean square and max difference of the color channels, in [0, 255],
+//between two sequences of images.
+void MeasureImageError(std::vector<std::vector<GLubyte>> const &reference_images,
+                       std::vector<std::vector<GLubyte>> const &images,
+                       float *rms, float *max_error) {
+  double sum = 0.0;
+  int max_diff = 0;
+  for (unsigned int i = 0u; i < kNumIterations; ++i) {
+    std::vector<GLubyte> const& reference = reference_images[i];
+    std::vector<GLubyte> const& image = images[i];
+    for (size_t p = 0u; p < reference.size(); ++p) {
+      //colors only, the alpha channel is blended as well.
+      if ((p & 3u) == 3u) {
+        continue;
+      }
+      int const diff = std::abs(reference[p] - image[p]);
+      sum += diff * diff;
+      max_diff = std::max(max_diff, diff);
+    }
+  }
+  *rms = static_cast<float>(std::sqrt(sum / (3.0 * kImageSize * kImageSize * kNumIterations)));
+  *max_error = static_cast<float>(max_diff);
+}
+
+//visual error of the depth buckets sort against the exact one. The systems
+//are run one after the other, from the same seed.
+void MeasureBucketsError(unsigned int const count, unsigned int const bucket_count,
+                         float *rms, float *max_error) {
+  std::vector<std::vector<GLubyte>> exact_images;
+  std::vector<std::vector<GLubyte>> buckets_images;
+  RenderSequence(count, GPUParticle::kSortExact, 0u, GPUParticle::kBlendAlpha, exact_images);
+  RenderSequence(count, GPUParticle::kSortBuckets, bucket_count, GPUParticle::kBlendAlpha, buckets_images);
+  MeasureImageError(exact_images, buckets_images, rms, max_error);
+}
+
+} //namespace
+
+int main() {
+  GLFWwindow *window = CreateContext();
+  if (!window) {
+    return EXIT_FAILURE;
+  }
+  InitGL();
+
+  fprintf(stdout, "%10s |", "particles");
+  for (unsigned int s = 1u; s <= GPUParticle::kMaxSortStagesPerPass; ++s) {
+    fprintf(stdout, " %u stage%s/pass: passes      ms |", s, (s > 1u) ? "s" : " ");
+  }
+  fprintf(stdout, "  host radix: passes      ms |\n");
+
+  for (unsigned int count = kMinParticleCount; count <= kMaxParticleCount; count <<= 1u) {
+    fprintf(stdout, "%10u |", count);
+    for (unsigned int s = 1u; s <= GPUParticle::kMaxSortStagesPerPass; ++s) {
+      unsigned int passes = 0u;
+      float const ms = BenchmarkSort(count, s, GPUParticle::kSortExact, 0u, &passes);
+      fprintf(stdout, "               %6u %7.3f |", passes, ms);
+    }
+    unsigned int passes = 0u;
+    float const ms = BenchmarkSort(count, 1u, GPUParticle::kSortHost, 0u, &passes);
+    fprintf(stdout, "              %6u %7.3f |\n", passes, ms);
+    fflush(stdout);
+  }
+
+  //depth buckets, with the visual error against the exact sort.
+  fprintf(stdout, "\n%10s |", "particles");
+  for (unsigned int b = kMinSortBucketCount; b <= GPUParticle::kMaxSortBucketCount; b <<= 2u) {
+    fprintf(stdout, " %4u buckets: passes      ms   rms   max |", b);
+  }
+  fprintf(stdout, "\n");
+
+  for (unsigned int count = kMinParticleCount; count <= kMaxParticleCount; count <<= 1u) {
+    fprintf(stdout, "%10u |", count);
+    for (unsigned int b = kMinSortBucketCount; b <= GPUParticle::kMaxSortBucketCount; b <<= 2u) {
+      unsigned int passes = 0u;
+      float rms = 0.0f;
+      float max_error = 0.0f;
+      float const ms = BenchmarkSort(count, GPUParticle::kMaxSortStagesPerPass,
+                                     GPUParticle::kSortBuckets, b, &passes);
+      MeasureBucketsError(count, b, &rms, &max_error);
+      fprintf(stdout, "               %6u %7.3f %5.2f %5.0f |", passes, ms, rms, max_error);
+    }
+    fprintf(stdout, "\n");
+    fflush(stdout);
+  }
+
+  //weighted blended transparency against the exact sort, both premultiplied.
+  fprintf(stdout, "\n%10s | premultiplied sorted:      ms | weighted blended:      ms   rms   max |\n",
+          "particles");
+  for (unsigned int count = kMinParticleCount; count <= kMaxParticleCount; count <<= 1u) {
+    std::vector<std::vector<GLubyte>> sorted_images;
+    std::vector<std::vector<GLubyte>> weighted_images;
+    float const sorted_ms = RenderSequence(count, GPUParticle::kSortExact, 0u,
+                                           GPUParticle::kBlendPremultiplied, sorted_images);
+    float const weighted_ms = RenderSequence(count, GPUParticle::kSortExact, 0u,
+                                             GPUParticle::kBlendWeighted, weighted_images);
+    float rms = 0.0f;
+    float max_error = 0.0f;
+    MeasureImageError(sorted_images, weighted_images, &rms, &max_error);
+    fprintf(stdout, "%10u |                      %7.3f |                  %7.3f %5.2f %5.0f |\n",
+            count, sorted_ms, weighted_ms, rms, max_error);
+    fflush(stdout);
+  }
+
+  glfwDestroyWindow(window);
+  glfwTerminate();
+
+  return EXIT_SUCCESS;
+}